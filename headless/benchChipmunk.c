@@ -0,0 +1,322 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Carlos Rafael Gimenes das Neves
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// https://github.com/carlosrafaelgn/pixel
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+#include <chipmunk/chipmunk_private.h>
+
+#include "headless.h"
+
+// Isolated benchmarks for the Chipmunk kernels that dominate step(), so that
+// changes made to lib/Chipmunk2D/src can be judged without the noise produced
+// by the rest of the game. Every kernel runs a few times before being measured
+// (warming up the caches), and the best of several runs is reported.
+
+#define PairCount 1024
+#define BallCount 40
+#define BallRadius 6
+#define RunCount 7
+#define MinRunMilliseconds 20.0
+
+typedef long long (*BenchFunc)(void* context);
+
+static volatile long long sink;
+
+static double measureNanosecondsPerOperation(BenchFunc func, void* context) {
+	long long operations = 0;
+	int repetitions = 1;
+
+	// Warm up and calibrate the amount of repetitions needed for each run
+	for (;;) {
+		const double start = getTimeMilliseconds();
+		for (int r = repetitions; r > 0; r--)
+			operations = func(context);
+		const double elapsed = getTimeMilliseconds() - start;
+		if (elapsed >= MinRunMilliseconds || repetitions >= (1 << 24))
+			break;
+		repetitions <<= 1;
+	}
+
+	double best = 0;
+	for (int run = 0; run < RunCount; run++) {
+		const double start = getTimeMilliseconds();
+		for (int r = repetitions; r > 0; r--)
+			operations = func(context);
+		const double elapsed = getTimeMilliseconds() - start;
+		if (!run || best > elapsed)
+			best = elapsed;
+	}
+
+	return (best * 1000000.0) / ((double)repetitions * (double)(operations ? operations : 1));
+}
+
+static cpFloat randomFloat(unsigned int* state, cpFloat min, cpFloat max) {
+	return min + ((max - min) * (cpFloat)(nextRandom(state) & 0xffffff) / (cpFloat)0xffffff);
+}
+
+static cpShape* createSegment(cpBody* staticBody, unsigned int* state, cpFloat minLength, cpFloat maxLength) {
+	// Short segments, just like the ones created from the polygons in init()
+	const cpVect a = cpv(randomFloat(state, 0, baseWidth), randomFloat(state, 0, maxHeight));
+	const cpFloat angle = randomFloat(state, 0, (cpFloat)6.283185307);
+	const cpFloat length = randomFloat(state, minLength, maxLength);
+	cpShape* const shape = cpSegmentShapeNew(staticBody, a, cpvadd(a, cpvmult(cpvforangle(angle), length)), (cpFloat)0.5);
+	cpShapeSetElasticity(shape, (cpFloat)0.5);
+	cpShapeSetFriction(shape, (cpFloat)0);
+	cpShapeSetCollisionType(shape, CollisionWall);
+	return shape;
+}
+
+static cpShape* createBall(cpBody** body, cpVect position) {
+	*body = cpBodyNew(1, cpMomentForCircle(1, 0, BallRadius, cpvzero));
+	cpBodySetPosition(*body, position);
+	cpShape* const shape = cpCircleShapeNew(*body, BallRadius, cpvzero);
+	cpShapeSetElasticity(shape, (cpFloat)0.5);
+	cpShapeSetFriction(shape, (cpFloat)0.5);
+	cpShapeSetCollisionType(shape, CollisionBall);
+	return shape;
+}
+
+//
+// cpCollide()
+//
+
+typedef struct CollideContextStruct {
+	cpShape* a[PairCount];
+	cpShape* b[PairCount];
+	cpBody* bodies[PairCount * 2];
+	int bodyCount;
+	struct cpContact contacts[CP_MAX_CONTACTS_PER_ARBITER];
+} CollideContext;
+
+static long long benchCollide(void* context) {
+	CollideContext* const collideContext = (CollideContext*)context;
+	int count = 0;
+	for (int i = 0; i < PairCount; i++)
+		count += cpCollide(collideContext->a[i], collideContext->b[i], 0, collideContext->contacts).count;
+	sink += count;
+	return PairCount;
+}
+
+static void initCollideContext(CollideContext* context, cpBody* staticBody, int circleVsCircle, unsigned int seed) {
+	unsigned int state = seed;
+
+	context->bodyCount = 0;
+
+	for (int i = 0; i < PairCount; i++) {
+		cpShape* other;
+		cpVect p;
+		if (circleVsCircle) {
+			const cpVect center = cpv(randomFloat(&state, 0, baseWidth), randomFloat(&state, 0, maxHeight));
+			other = createBall(&(context->bodies[context->bodyCount++]), center);
+			// Roughly half of the pairs touch each other
+			p = cpvadd(center, cpvmult(cpvforangle(randomFloat(&state, 0, (cpFloat)6.283185307)), randomFloat(&state, BallRadius, BallRadius * 3)));
+		} else {
+			other = createSegment(staticBody, &state, 4, 20);
+			const cpVect a = cpSegmentShapeGetA(other), b = cpSegmentShapeGetB(other);
+			p = cpvadd(cpvlerp(a, b, randomFloat(&state, 0, 1)), cpvmult(cpvforangle(randomFloat(&state, 0, (cpFloat)6.283185307)), randomFloat(&state, 0, BallRadius * 2)));
+		}
+		cpShape* const ball = createBall(&(context->bodies[context->bodyCount++]), p);
+		cpShapeCacheBB(ball);
+		cpShapeCacheBB(other);
+		context->a[i] = ball;
+		context->b[i] = other;
+	}
+}
+
+static void destroyCollideContext(CollideContext* context) {
+	for (int i = 0; i < PairCount; i++) {
+		cpShapeFree(context->a[i]);
+		cpShapeFree(context->b[i]);
+	}
+	for (int i = context->bodyCount - 1; i >= 0; i--)
+		cpBodyFree(context->bodies[i]);
+}
+
+//
+// cpBBTree, cpHashSetFilter() and cpArbiterApplyImpulse()
+//
+
+typedef struct SpaceContextStruct {
+	cpSpace* space;
+	int segmentCount, frame;
+	cpShape** segments;
+	cpBody* ballBodies[BallCount];
+	cpShape* balls[BallCount];
+	cpVect ballCenters[BallCount];
+	long long pairs;
+} SpaceContext;
+
+static cpCollisionID countPair(void* obj1, void* obj2, cpCollisionID id, void* data) {
+	(void)obj1;
+	(void)obj2;
+	((SpaceContext*)data)->pairs++;
+	return id;
+}
+
+static long long benchSubtreeQuery(void* context) {
+	SpaceContext* const spaceContext = (SpaceContext*)context;
+	cpSpatialIndex* const staticShapes = spaceContext->space->staticShapes;
+	for (int i = 0; i < BallCount; i++) {
+		cpShape* const ball = spaceContext->balls[i];
+		cpSpatialIndexQuery(staticShapes, ball, ball->bb, countPair, spaceContext);
+	}
+	return BallCount;
+}
+
+static long long benchReindexQuery(void* context) {
+	SpaceContext* const spaceContext = (SpaceContext*)context;
+	const int frame = ++spaceContext->frame;
+
+	// Move the balls around (at about 3 pixels per frame, the fastest a ball moves
+	// in the game), forcing the tree to update their leaves from time to time
+	for (int i = 0; i < BallCount; i++) {
+		const cpFloat a = (cpFloat)(frame + (i * 7)) * (cpFloat)0.125;
+		cpBodySetPosition(spaceContext->ballBodies[i], cpvadd(spaceContext->ballCenters[i], cpv(24 * cpfcos(a), 24 * cpfsin(a))));
+		cpShapeCacheBB(spaceContext->balls[i]);
+	}
+
+	cpSpatialIndexReindexQuery(spaceContext->space->dynamicShapes, countPair, spaceContext);
+	return 1;
+}
+
+static long long benchHashSetFilter(void* context) {
+	cpSpace* const space = ((SpaceContext*)context)->space;
+	// The space stamp does not change between calls, so no arbiter is ever
+	// thrown away, and the filter produces the same results every time
+	cpHashSetFilter(space->cachedArbiters, (cpHashSetFilterFunc)cpSpaceArbiterSetFilter, space);
+	return cpHashSetCount(space->cachedArbiters);
+}
+
+static long long benchApplyImpulse(void* context) {
+	cpArray* const arbiters = ((SpaceContext*)context)->space->arbiters;
+	for (int i = 0; i < arbiters->num; i++)
+		cpArbiterApplyImpulse((cpArbiter*)arbiters->arr[i]);
+	return arbiters->num;
+}
+
+static void initSpaceContext(SpaceContext* context, int segmentCount, unsigned int seed) {
+	unsigned int state = seed;
+	cpSpace* const space = cpSpaceNew();
+
+	// Must be in sync with init() in lib/physics.c
+	cpSpaceSetGravity(space, cpv(0, 360));
+	cpSpaceSetDamping(space, (cpFloat)0.5);
+	cpSpaceSetCollisionSlop(space, (cpFloat)0.5);
+
+	context->space = space;
+	context->segmentCount = segmentCount;
+	context->frame = 0;
+	context->pairs = 0;
+	context->segments = (cpShape**)malloc(sizeof(cpShape*) * (size_t)segmentCount);
+
+	cpBody* const staticBody = cpSpaceGetStaticBody(space);
+	for (int i = 0; i < segmentCount; i++)
+		context->segments[i] = cpSpaceAddShape(space, createSegment(staticBody, &state, 4, 20));
+
+	for (int i = 0; i < BallCount; i++) {
+		context->ballCenters[i] = cpv(randomFloat(&state, 30, baseWidth - 30), randomFloat(&state, 30, maxHeight - 30));
+		context->balls[i] = createBall(&(context->ballBodies[i]), context->ballCenters[i]);
+		cpSpaceAddBody(space, context->ballBodies[i]);
+		cpSpaceAddShape(space, context->balls[i]);
+	}
+
+	// Let the balls fall for a while, so there are arbiters to work with
+	for (int i = 0; i < 30; i++)
+		cpSpaceStep(space, (cpFloat)(1.0 / 60.0));
+}
+
+static void destroySpaceContext(SpaceContext* context) {
+	cpSpace* const space = context->space;
+	for (int i = 0; i < BallCount; i++) {
+		cpSpaceRemoveShape(space, context->balls[i]);
+		cpSpaceRemoveBody(space, context->ballBodies[i]);
+		cpShapeFree(context->balls[i]);
+		cpBodyFree(context->ballBodies[i]);
+	}
+	for (int i = context->segmentCount - 1; i >= 0; i--) {
+		cpSpaceRemoveShape(space, context->segments[i]);
+		cpShapeFree(context->segments[i]);
+	}
+	free(context->segments);
+	cpSpaceFree(space);
+}
+
+int commandBenchChipmunk(int argc, char** argv) {
+	int seed = 1;
+
+	if (argc >= 2 && !strcmp(argv[0], "-s")) {
+		if (!parseIntArgument(argv[1], &seed)) {
+			fprintf(stderr, "Invalid seed %s\n", argv[1]);
+			return 1;
+		}
+	} else if (argc) {
+		fprintf(stderr, "Usage: pixel-headless bench-chipmunk [-s seed]\n");
+		return 1;
+	}
+
+	printf("Chipmunk kernels | best of %d runs (at least %.0f ms each) | seed %d\n", RunCount, MinRunMilliseconds, seed);
+	printf("%-34s %10s %12s\n", "kernel", "ns/op", "ops/run");
+
+	cpBody* const staticBody = cpBodyNewStatic();
+	CollideContext* const collideContext = (CollideContext*)malloc(sizeof(CollideContext));
+
+	initCollideContext(collideContext, staticBody, 0, (unsigned int)seed);
+	printf("%-34s %10.2f %12d\n", "cpCollide circle vs segment", measureNanosecondsPerOperation(benchCollide, collideContext), PairCount);
+	destroyCollideContext(collideContext);
+
+	initCollideContext(collideContext, staticBody, 1, (unsigned int)seed);
+	printf("%-34s %10.2f %12d\n", "cpCollide circle vs circle", measureNanosecondsPerOperation(benchCollide, collideContext), PairCount);
+	destroyCollideContext(collideContext);
+
+	free(collideContext);
+	cpBodyFree(staticBody);
+
+	static const int segmentCounts[] = { 4096, 8192, 16384, 20000 };
+	char name[64];
+
+	for (int i = 0; i < (int)(sizeof(segmentCounts) / sizeof(int)); i++) {
+		SpaceContext spaceContext;
+		initSpaceContext(&spaceContext, segmentCounts[i], (unsigned int)seed);
+
+		snprintf(name, sizeof(name), "SubtreeQuery (%d segments)", segmentCounts[i]);
+		printf("%-34s %10.2f %12d\n", name, measureNanosecondsPerOperation(benchSubtreeQuery, &spaceContext), BallCount);
+
+		snprintf(name, sizeof(name), "ReindexQuery (%d segments)", segmentCounts[i]);
+		printf("%-34s %10.2f %12d\n", name, measureNanosecondsPerOperation(benchReindexQuery, &spaceContext), 1);
+
+		snprintf(name, sizeof(name), "cpHashSetFilter (%d segments)", segmentCounts[i]);
+		printf("%-34s %10.2f %12d\n", name, measureNanosecondsPerOperation(benchHashSetFilter, &spaceContext), cpHashSetCount(spaceContext.space->cachedArbiters));
+
+		snprintf(name, sizeof(name), "cpArbiterApplyImpulse (%d segs)", segmentCounts[i]);
+		printf("%-34s %10.2f %12d\n", name, measureNanosecondsPerOperation(benchApplyImpulse, &spaceContext), spaceContext.space->arbiters->num);
+
+		destroySpaceContext(&spaceContext);
+	}
+
+	return 0;
+}
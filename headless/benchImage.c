@@ -0,0 +1,700 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Carlos Rafael Gimenes das Neves
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// https://github.com/carlosrafaelgn/pixel
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+
+#include "headless.h"
+
+// Benchmarks each phase of processImage(), either over the images given in the
+// command line, or over a corpus of synthetic drawings, with different stroke
+// densities. The polygon and point counts must remain the same across algorithm
+// changes (unless the change is supposed to alter them, of course).
+//
+// With -m, processImageMarch() is measured instead, so that the time and the
+// number of points and walls of both ways of finding the polygons can be
+// compared (trace4 then stands for the time spent in cpMarchSoft() or
+// cpMarchHard(), and dPeucker for cpPolylineSimplifyCurves()).
+//
+// bench-batch measures processImageBatch() instead, over copies of the same
+// drawings, with a single thread and with -t threads, and checks whether the
+// polygons of every job match the ones produced by processImage().
+//
+// bench-region applies random brush and eraser strokes to each drawing, and
+// processes every edit with processImageRegion(), restoring the results of the
+// previous pass into a new ImageInfo, just like ImageProcessor does in
+// scripts/image/imageProcessor.ts, and checks whether the polygons (in any
+// order) and the repainted image match the ones produced by processImage().
+
+typedef struct SyntheticDrawingStruct {
+	const char* name;
+	int strokeCount, minThickness, maxThickness;
+	unsigned int seed;
+} SyntheticDrawing;
+
+static const SyntheticDrawing syntheticDrawings[] = {
+	{ "sparse", 12, 10, 25, 1 },
+	{ "medium", 48, 10, 25, 2 },
+	{ "dense", 192, 10, 25, 3 },
+	// Thin strokes produce lots of 1-pixels and small components
+	{ "thin", 400, 1, 6, 4 }
+};
+
+#define SyntheticDrawingCount ((int)(sizeof(syntheticDrawings) / sizeof(SyntheticDrawing)))
+
+// Must be in sync with the values of march in commandBenchImage()
+#define MarchNone 0
+#define MarchHard 1
+#define MarchSoft 2
+
+static void benchImage(const char* name, const unsigned char* source, int width, int height, int iterations, int threadCount, int centerlines, int march) {
+	const size_t dataSize = (size_t)width * (size_t)height * 4;
+	ImageInfo* const imageInfo = allocateImageInfo(width, height);
+	if (!imageInfo) {
+		fprintf(stderr, "Not enough memory for a %d x %d image\n", width, height);
+		return;
+	}
+
+	unsigned char* const data = getImageInfoData(imageInfo);
+	const ImageProcessingStats* const stats = getImageInfoStats(imageInfo);
+	ImageProcessingStats sum;
+	PolygonList polygonList;
+	double minTotal = 0;
+	int maxY = 0;
+
+	memset(&sum, 0, sizeof(ImageProcessingStats));
+	initPolygonList(&polygonList);
+
+	setImageInfoThreadCount(imageInfo, threadCount);
+	setImageInfoCenterlines(imageInfo, centerlines);
+
+	// Warm up the caches (and check the results) before measuring
+	memcpy(data, source, dataSize);
+	maxY = (march ? processImageMarchIntoPolygonList(imageInfo, march == MarchSoft, &polygonList) : processImageIntoPolygonList(imageInfo, &polygonList));
+
+	for (int i = 0; i < iterations; i++) {
+		// processImage() repaints data, so it must be restored on every iteration
+		memcpy(data, source, dataSize);
+		const double start = getTimeMilliseconds();
+		if (march)
+			processImageMarchIntoPolygonList(imageInfo, march == MarchSoft, &polygonList);
+		else
+			processImageIntoPolygonList(imageInfo, &polygonList);
+		const double total = getTimeMilliseconds() - start;
+
+		if (!i || minTotal > total)
+			minTotal = total;
+
+		sum.binarizeMilliseconds += stats->binarizeMilliseconds;
+		sum.erase1Milliseconds += stats->erase1Milliseconds;
+		sum.labelMilliseconds += stats->labelMilliseconds;
+		sum.floodFillMilliseconds += stats->floodFillMilliseconds;
+		sum.trace4Milliseconds += (march ? stats->marchMilliseconds : stats->trace4Milliseconds);
+		sum.douglasPeuckerMilliseconds += stats->douglasPeuckerMilliseconds;
+		sum.centerlineMilliseconds += stats->centerlineMilliseconds;
+		sum.repaintMilliseconds += stats->repaintMilliseconds;
+		sum.totalMilliseconds += total;
+	}
+
+	// Walls created by initFromPolygonTable() (refer to lib/physics.c)
+	int wallCount = 0;
+	for (int i = 0; i < polygonList.polygonCount; i++) {
+		const int first = polygonList.firstPoint[i], l = polygonList.firstPoint[i + 1] - first;
+		if (l >= 2)
+			wallCount += ((l == 2 || polygonList.radius[first]) ? (l - 1) : l);
+	}
+
+	const double n = (double)iterations;
+	printf("%-12s %4dx%-4d %9.4f %9.4f %9.4f %9.4f %9.4f %9.4f %9.4f %9.4f %9.4f %9.4f %6d %7d %6d %6d %6d %6d\n",
+		name, width, height,
+		sum.binarizeMilliseconds / n,
+		sum.erase1Milliseconds / n,
+		sum.labelMilliseconds / n,
+		sum.floodFillMilliseconds / n,
+		sum.trace4Milliseconds / n,
+		sum.douglasPeuckerMilliseconds / n,
+		sum.centerlineMilliseconds / n,
+		sum.repaintMilliseconds / n,
+		sum.totalMilliseconds / n,
+		minTotal,
+		polygonList.polygonCount,
+		polygonList.pointCount,
+		stats->componentCount,
+		stats->holeCount,
+		wallCount,
+		maxY);
+
+	freePolygonList(&polygonList);
+	freeImageInfo(imageInfo);
+}
+
+int commandBenchImage(int argc, char** argv) {
+	int iterations = 100, threadCount = 1, cacheCapacity = 0, centerlines = 0, march = MarchNone, first = 0;
+
+	for (; first < argc && argv[first][0] == '-'; first += 2) {
+		if (!strcmp(argv[first], "-l")) {
+			// The only option without a value
+			centerlines = 1;
+			first--;
+		} else if (first + 1 >= argc) {
+			break;
+		} else if (!strcmp(argv[first], "-n")) {
+			if (!parseIntArgument(argv[first + 1], &iterations) || iterations <= 0) {
+				fprintf(stderr, "Invalid iteration count %s\n", argv[first + 1]);
+				return 1;
+			}
+		} else if (!strcmp(argv[first], "-c")) {
+			if (!parseIntArgument(argv[first + 1], &cacheCapacity) || cacheCapacity < 0) {
+				fprintf(stderr, "Invalid cache capacity %s\n", argv[first + 1]);
+				return 1;
+			}
+		} else if (!strcmp(argv[first], "-m")) {
+			if (!strcmp(argv[first + 1], "hard")) {
+				march = MarchHard;
+			} else if (!strcmp(argv[first + 1], "soft")) {
+				march = MarchSoft;
+			} else {
+				fprintf(stderr, "Invalid marching squares mode %s\n", argv[first + 1]);
+				return 1;
+			}
+		} else if (!strcmp(argv[first], "-t")) {
+			if (!parseIntArgument(argv[first + 1], &threadCount) || threadCount <= 0) {
+				fprintf(stderr, "Invalid thread count %s\n", argv[first + 1]);
+				return 1;
+			}
+		} else {
+			break;
+		}
+	}
+
+	if ((argc - first) % 3) {
+		fprintf(stderr, "Usage: pixel-headless bench-image [-n iterations] [-t threads] [-c cacheBytes] [-m hard|soft] [-l] [image.rgba width height ...]\n");
+		return 1;
+	}
+
+#if !profileImageProcessing
+	printf("Warning: lib/ was built without profileImageProcessing, only the total time will be available\n");
+#endif
+
+	// The cache is disabled by default, as every iteration would be a hit
+	setImageCacheCapacity(cacheCapacity);
+
+	static const char* const marchNames[] = { "off", "hard", "soft" };
+	printf("processImage() | %d iterations | %d thread(s) | %d cache bytes | centerlines %s | marching squares %s | mean time per call in ms (min is the fastest total)\n", iterations, threadCount, cacheCapacity, centerlines ? "on" : "off", marchNames[march]);
+	printf("%-12s %9s %9s %9s %9s %9s %9s %9s %9s %9s %9s %9s %6s %7s %6s %6s %6s %6s\n", "drawing", "size", "binarize", "erase1", "label", "floodFill", "trace4", "dPeucker", "cLine", "repaint", "total", "min", "polys", "points", "comps", "holes", "walls", "maxY");
+
+	if (first == argc) {
+		unsigned char* const data = (unsigned char*)malloc((size_t)baseWidth * (size_t)maxHeight * 4);
+		for (int i = 0; i < SyntheticDrawingCount; i++) {
+			const SyntheticDrawing* const drawing = &(syntheticDrawings[i]);
+			generateDrawing(data, baseWidth, maxHeight, drawing->strokeCount, drawing->minThickness, drawing->maxThickness, drawing->seed);
+			benchImage(drawing->name, data, baseWidth, maxHeight, iterations, threadCount, centerlines, march);
+		}
+		free(data);
+		return 0;
+	}
+
+	for (int i = first; i < argc; i += 3) {
+		int width, height;
+		if (!parseIntArgument(argv[i + 1], &width) || !parseIntArgument(argv[i + 2], &height)) {
+			fprintf(stderr, "Invalid size %s x %s\n", argv[i + 1], argv[i + 2]);
+			return 1;
+		}
+
+		ImageInfo* const imageInfo = loadImageInfo(argv[i], width, height);
+		if (!imageInfo)
+			return 1;
+
+		// Keep a copy of the original image, as processImage() changes it
+		const size_t dataSize = (size_t)width * (size_t)height * 4;
+		unsigned char* const source = (unsigned char*)malloc(dataSize);
+		memcpy(source, getImageInfoData(imageInfo), dataSize);
+		freeImageInfo(imageInfo);
+
+		const char* name = strrchr(argv[i], '/');
+		benchImage(name ? (name + 1) : argv[i], source, width, height, iterations, threadCount, centerlines, march);
+
+		free(source);
+	}
+
+	return 0;
+}
+
+typedef struct BatchSourceStruct {
+	unsigned char* data;
+	int width, height;
+} BatchSource;
+
+static int samePolygonTables(const PolygonTable* a, const PolygonTable* b) {
+	return (a->polygonCount == b->polygonCount &&
+		a->pointCount == b->pointCount &&
+		!a->overflowed && !b->overflowed &&
+		!memcmp(a->firstPoint, b->firstPoint, (size_t)(a->polygonCount + 1) * sizeof(int)) &&
+		!memcmp(a->points, b->points, (size_t)a->pointCount * 2 * sizeof(short)) &&
+		!memcmp(a->parent, b->parent, (size_t)a->polygonCount * sizeof(int)) &&
+		!memcmp(a->hole, b->hole, (size_t)a->polygonCount) &&
+		!memcmp(a->radius, b->radius, (size_t)a->pointCount));
+}
+
+static int benchBatch(const BatchSource* sources, int sourceCount, int copies, int iterations, int threadCount, int centerlines, const int* referenceMaxY, PolygonTable* const* referenceTables) {
+	const int jobCount = sourceCount * copies;
+	ImageBatchJob* const jobs = (ImageBatchJob*)malloc(sizeof(ImageBatchJob) * (size_t)jobCount);
+	ImageBatch* const imageBatch = allocateImageBatch(threadCount, centerlines);
+	double sumTotal = 0, minTotal = 0;
+	int workerCount = 0, mismatchCount = 0, result = 1;
+
+	for (int j = 0; j < jobCount; j++) {
+		const BatchSource* const source = &(sources[j % sourceCount]);
+		jobs[j].data = (unsigned char*)malloc(((size_t)source->width * (size_t)source->height) << 2);
+		jobs[j].width = source->width;
+		jobs[j].height = source->height;
+		jobs[j].polygonTable = allocatePolygonTable(HeadlessPolygonCapacity, HeadlessPointCapacity);
+	}
+
+	// The first batch allocates the ImageInfo of each thread, and it is
+	// measured just like the others (the batches that come after it reuse them)
+	for (int i = 0; i < iterations; i++) {
+		// processImageBatch() repaints the images, so they must be restored
+		for (int j = 0; j < jobCount; j++)
+			memcpy(jobs[j].data, sources[j % sourceCount].data, ((size_t)jobs[j].width * (size_t)jobs[j].height) << 2);
+
+		const double start = getTimeMilliseconds();
+		workerCount = processImageBatch(imageBatch, jobs, jobCount);
+		const double total = getTimeMilliseconds() - start;
+
+		if (!workerCount) {
+			fprintf(stderr, "Not enough memory for the batch\n");
+			result = 0;
+			break;
+		}
+
+		if (!i || minTotal > total)
+			minTotal = total;
+		sumTotal += total;
+	}
+
+	if (result) {
+		for (int j = 0; j < jobCount; j++) {
+			if (jobs[j].maxY != referenceMaxY[j % sourceCount] || !samePolygonTables(jobs[j].polygonTable, referenceTables[j % sourceCount]))
+				mismatchCount++;
+		}
+
+		const double mean = sumTotal / (double)iterations;
+		printf("%7d %7d %9.4f %9.4f %9.4f %10d\n", threadCount, workerCount, mean, minTotal, mean / (double)jobCount, mismatchCount);
+	}
+
+	for (int j = 0; j < jobCount; j++) {
+		freePolygonTable(jobs[j].polygonTable);
+		free(jobs[j].data);
+	}
+	freeImageBatch(imageBatch);
+	free(jobs);
+
+	return (result && !mismatchCount);
+}
+
+int commandBenchBatch(int argc, char** argv) {
+	int iterations = 20, threadCount = 4, copies = 8, centerlines = 0, first = 0;
+
+	for (; first < argc && argv[first][0] == '-'; first += 2) {
+		if (!strcmp(argv[first], "-l")) {
+			// The only option without a value
+			centerlines = 1;
+			first--;
+		} else if (first + 1 >= argc) {
+			break;
+		} else if (!strcmp(argv[first], "-n")) {
+			if (!parseIntArgument(argv[first + 1], &iterations) || iterations <= 0) {
+				fprintf(stderr, "Invalid iteration count %s\n", argv[first + 1]);
+				return 1;
+			}
+		} else if (!strcmp(argv[first], "-t")) {
+			if (!parseIntArgument(argv[first + 1], &threadCount) || threadCount <= 0) {
+				fprintf(stderr, "Invalid thread count %s\n", argv[first + 1]);
+				return 1;
+			}
+		} else if (!strcmp(argv[first], "-j")) {
+			if (!parseIntArgument(argv[first + 1], &copies) || copies <= 0) {
+				fprintf(stderr, "Invalid copy count %s\n", argv[first + 1]);
+				return 1;
+			}
+		} else {
+			break;
+		}
+	}
+
+	if ((argc - first) % 3) {
+		fprintf(stderr, "Usage: pixel-headless bench-batch [-n iterations] [-t threads] [-j copies] [-l] [image.rgba width height ...]\n");
+		return 1;
+	}
+
+	const int sourceCount = ((first == argc) ? SyntheticDrawingCount : ((argc - first) / 3));
+	BatchSource* const sources = (BatchSource*)malloc(sizeof(BatchSource) * (size_t)sourceCount);
+	int* const referenceMaxY = (int*)malloc(sizeof(int) * (size_t)sourceCount);
+	PolygonTable** const referenceTables = (PolygonTable**)malloc(sizeof(PolygonTable*) * (size_t)sourceCount);
+	int loadedCount = 0, result = 0;
+
+	for (; loadedCount < sourceCount; loadedCount++) {
+		BatchSource* const source = &(sources[loadedCount]);
+		ImageInfo* imageInfo;
+		if (first == argc) {
+			source->width = baseWidth;
+			source->height = maxHeight;
+			imageInfo = allocateImageInfo(source->width, source->height);
+			if (imageInfo) {
+				const SyntheticDrawing* const drawing = &(syntheticDrawings[loadedCount]);
+				generateDrawing(getImageInfoData(imageInfo), source->width, source->height, drawing->strokeCount, drawing->minThickness, drawing->maxThickness, drawing->seed);
+			}
+		} else {
+			const int i = first + (loadedCount * 3);
+			if (!parseIntArgument(argv[i + 1], &(source->width)) || !parseIntArgument(argv[i + 2], &(source->height))) {
+				fprintf(stderr, "Invalid size %s x %s\n", argv[i + 1], argv[i + 2]);
+				result = 1;
+				break;
+			}
+			imageInfo = loadImageInfo(argv[i], source->width, source->height);
+		}
+
+		if (!imageInfo) {
+			result = 1;
+			break;
+		}
+
+		// Keep a copy of the original image, as processImage() changes it
+		const size_t dataSize = ((size_t)source->width * (size_t)source->height) << 2;
+		source->data = (unsigned char*)malloc(dataSize);
+		memcpy(source->data, getImageInfoData(imageInfo), dataSize);
+
+		// The reference results, to which all jobs are compared
+		setImageInfoCenterlines(imageInfo, centerlines);
+		referenceTables[loadedCount] = allocatePolygonTable(HeadlessPolygonCapacity, HeadlessPointCapacity);
+		referenceMaxY[loadedCount] = processImage(imageInfo, referenceTables[loadedCount]);
+		freeImageInfo(imageInfo);
+	}
+
+	if (!result) {
+		printf("processImageBatch() | %d images | %d iterations | centerlines %s | mean time per batch in ms (min is the fastest batch)\n", sourceCount * copies, iterations, centerlines ? "on" : "off");
+		printf("%7s %7s %9s %9s %9s %10s\n", "threads", "used", "mean", "min", "perImage", "mismatches");
+
+		if (!benchBatch(sources, sourceCount, copies, iterations, 1, centerlines, referenceMaxY, referenceTables) ||
+			(threadCount > 1 && !benchBatch(sources, sourceCount, copies, iterations, threadCount, centerlines, referenceMaxY, referenceTables)))
+			result = 1;
+	}
+
+	for (int i = 0; i < loadedCount; i++) {
+		freePolygonTable(referenceTables[i]);
+		free(sources[i].data);
+	}
+	free(referenceTables);
+	free(referenceMaxY);
+	free(sources);
+
+	return result;
+}
+
+// Must be in sync with ImageProcessor in scripts/image/imageProcessor.ts
+typedef struct RegionResultsStruct {
+	unsigned char* buffer; // (width + 2) * (height + 2) bytes (refer to getImageInfoBuffer())
+	PolygonTable* polygonTable; // Only firstPoint, points, startPixel and radius are kept
+} RegionResults;
+
+static void saveRegionResults(RegionResults* results, ImageInfo* imageInfo, const PolygonTable* polygonTable, size_t bufferSize) {
+	PolygonTable* const saved = results->polygonTable;
+	memcpy(results->buffer, getImageInfoBuffer(imageInfo), bufferSize);
+	saved->polygonCount = polygonTable->polygonCount;
+	saved->pointCount = polygonTable->pointCount;
+	memcpy(saved->firstPoint, polygonTable->firstPoint, (size_t)(polygonTable->polygonCount + 1) * sizeof(int));
+	memcpy(saved->points, polygonTable->points, (size_t)polygonTable->pointCount * 2 * sizeof(short));
+	memcpy(saved->startPixel, polygonTable->startPixel, (size_t)polygonTable->polygonCount * sizeof(int));
+	memcpy(saved->radius, polygonTable->radius, (size_t)polygonTable->pointCount);
+}
+
+static void restoreRegionResults(const RegionResults* results, ImageInfo* imageInfo, PolygonTable* polygonTable, size_t bufferSize) {
+	// parent and hole are left as they are, just like process() does
+	const PolygonTable* const saved = results->polygonTable;
+	memcpy(getImageInfoBuffer(imageInfo), results->buffer, bufferSize);
+	polygonTable->polygonCount = saved->polygonCount;
+	polygonTable->pointCount = saved->pointCount;
+	memcpy(polygonTable->firstPoint, saved->firstPoint, (size_t)(saved->polygonCount + 1) * sizeof(int));
+	memcpy(polygonTable->points, saved->points, (size_t)saved->pointCount * 2 * sizeof(short));
+	memcpy(polygonTable->startPixel, saved->startPixel, (size_t)saved->polygonCount * sizeof(int));
+	memcpy(polygonTable->radius, saved->radius, (size_t)saved->pointCount);
+}
+
+static int samePolygonSets(const PolygonTable* a, const PolygonTable* b, int* match) {
+	// processImageRegion() appends the polygons it finds again after the ones
+	// it keeps, so the polygons of a may be anywhere in b (match must have room
+	// for 2 * polygonCount ints, and match[i] ends up as the index of polygon i
+	// of a in b)
+	if (a->polygonCount != b->polygonCount || a->pointCount != b->pointCount || a->overflowed || b->overflowed)
+		return 0;
+
+	int* const used = match + a->polygonCount;
+	memset(used, 0, (size_t)a->polygonCount * sizeof(int));
+
+	for (int i = 0; i < a->polygonCount; i++) {
+		const int first = a->firstPoint[i], count = a->firstPoint[i + 1] - first;
+		int j = 0;
+		for (; j < b->polygonCount; j++) {
+			const int bFirst = b->firstPoint[j];
+			if (!used[j] &&
+				b->startPixel[j] == a->startPixel[i] &&
+				b->hole[j] == a->hole[i] &&
+				(b->firstPoint[j + 1] - bFirst) == count &&
+				!memcmp(a->points + (first << 1), b->points + (bFirst << 1), (size_t)count * 2 * sizeof(short)) &&
+				!memcmp(a->radius + first, b->radius + bFirst, (size_t)count))
+				break;
+		}
+		if (j == b->polygonCount)
+			return 0;
+		used[j] = 1;
+		match[i] = j;
+	}
+
+	for (int i = 0; i < a->polygonCount; i++) {
+		const int parent = a->parent[i];
+		if (b->parent[match[i]] != ((parent < 0) ? -1 : match[parent]))
+			return 0;
+	}
+
+	return 1;
+}
+
+static void paintRegionStamp(unsigned char* data, int width, int height, int cx, int cy, int radius, int erase, unsigned int color) {
+	// A hard-edged round brush (or eraser), painted over the image repainted by
+	// the previous pass, just like the editor does
+	const int r2 = radius * radius;
+	for (int y = cy - radius; y <= cy + radius; y++) {
+		if (y < 0 || y >= height)
+			continue;
+		for (int x = cx - radius; x <= cx + radius; x++) {
+			if (x < 0 || x >= width || ((x - cx) * (x - cx)) + ((y - cy) * (y - cy)) > r2)
+				continue;
+			unsigned char* const pixel = data + (((y * width) + x) << 2);
+			pixel[0] = (erase ? 0 : (unsigned char)color);
+			pixel[1] = (erase ? 0 : (unsigned char)(color >> 8));
+			pixel[2] = (erase ? 0 : (unsigned char)(color >> 16));
+			pixel[3] = (erase ? 0 : 255);
+		}
+	}
+}
+
+static int benchRegion(const char* name, const unsigned char* source, int width, int height, int passes, int centerlines, unsigned int seed) {
+	// Returns the number of mismatches, or -1 when there is not enough memory
+	const size_t dataSize = ((size_t)width * (size_t)height) << 2, bufferSize = (size_t)(width + 2) * (size_t)(height + 2);
+	unsigned char* const image = (unsigned char*)malloc(dataSize);
+	int* const match = (int*)malloc(sizeof(int) * 2 * (size_t)HeadlessPolygonCapacity);
+	RegionResults results;
+	results.buffer = (unsigned char*)malloc(bufferSize);
+	results.polygonTable = allocatePolygonTable(HeadlessPolygonCapacity, HeadlessPointCapacity);
+	ImageInfo* const reference = allocateImageInfo(width, height);
+	PolygonTable* const referenceTable = allocatePolygonTable(HeadlessPolygonCapacity, HeadlessPointCapacity);
+	unsigned int state = (seed ? seed : 1);
+	double regionTotal = 0, fullTotal = 0;
+	int mismatchCount = -1;
+
+	if (!image || !match || !results.buffer || !results.polygonTable || !reference || !referenceTable) {
+		fprintf(stderr, "Not enough memory for a %d x %d image\n", width, height);
+		goto cleanup;
+	}
+
+	setImageInfoCenterlines(reference, centerlines);
+
+	// The first pass always processes the entire image
+	memcpy(getImageInfoData(reference), source, dataSize);
+	processImage(reference, referenceTable);
+	memcpy(image, getImageInfoData(reference), dataSize);
+	saveRegionResults(&results, reference, referenceTable, bufferSize);
+
+	mismatchCount = 0;
+
+	for (int pass = 0; pass < passes; pass++) {
+		// A few strokes between two passes, with their bounds accumulated the
+		// same way ImageProcessor.markDirty() accumulates them (the dirty
+		// region may extend beyond the image)
+		const int strokeCount = 1 + (int)(nextRandom(&state) % 3);
+		int dirtyLeft = 0, dirtyTop = 0, dirtyRight = 0, dirtyBottom = 0;
+		for (int s = 0; s < strokeCount; s++) {
+			const int radius = 1 + (int)(nextRandom(&state) % 16), erase = (int)(nextRandom(&state) & 1);
+			const unsigned int color = nextRandom(&state) | 0x404040;
+			int x = (int)(nextRandom(&state) % (unsigned int)width);
+			int y = (int)(nextRandom(&state) % (unsigned int)height);
+			const int nextX = x + (int)(nextRandom(&state) % 81) - 40;
+			const int nextY = y + (int)(nextRandom(&state) % 81) - 40;
+			const int left = ((x < nextX) ? x : nextX) - radius, top = ((y < nextY) ? y : nextY) - radius,
+				right = ((x > nextX) ? x : nextX) + radius + 1, bottom = ((y > nextY) ? y : nextY) + radius + 1;
+			if (!s || dirtyLeft > left)
+				dirtyLeft = left;
+			if (!s || dirtyTop > top)
+				dirtyTop = top;
+			if (!s || dirtyRight < right)
+				dirtyRight = right;
+			if (!s || dirtyBottom < bottom)
+				dirtyBottom = bottom;
+
+			const int dx = nextX - x, dy = nextY - y;
+			const int steps = ((dx < 0 ? -dx : dx) > (dy < 0 ? -dy : dy) ? (dx < 0 ? -dx : dx) : (dy < 0 ? -dy : dy));
+			for (int t = 0; t <= steps; t++)
+				paintRegionStamp(image, width, height, steps ? (x + ((dx * t) / steps)) : x, steps ? (y + ((dy * t) / steps)) : y, radius, erase, color);
+		}
+
+		// Just like ImageProcessor.process(), a new ImageInfo and a new
+		// PolygonTable are allocated on every pass, and the results of the
+		// previous pass are restored into them
+		ImageInfo* const imageInfo = allocateImageInfo(width, height);
+		PolygonTable* const polygonTable = allocatePolygonTable(HeadlessPolygonCapacity, HeadlessPointCapacity);
+		if (!imageInfo || !polygonTable) {
+			fprintf(stderr, "Not enough memory for a %d x %d image\n", width, height);
+			if (polygonTable)
+				freePolygonTable(polygonTable);
+			if (imageInfo)
+				freeImageInfo(imageInfo);
+			mismatchCount = -1;
+			goto cleanup;
+		}
+
+		setImageInfoCenterlines(imageInfo, centerlines);
+		memcpy(getImageInfoData(imageInfo), image, dataSize);
+		restoreRegionResults(&results, imageInfo, polygonTable, bufferSize);
+
+		const double regionStart = getTimeMilliseconds();
+		const int maxY = processImageRegion(imageInfo, polygonTable, dirtyLeft, dirtyTop, dirtyRight - dirtyLeft, dirtyBottom - dirtyTop);
+		regionTotal += getTimeMilliseconds() - regionStart;
+
+		memcpy(getImageInfoData(reference), image, dataSize);
+		const double fullStart = getTimeMilliseconds();
+		const int referenceMaxY = processImage(reference, referenceTable);
+		fullTotal += getTimeMilliseconds() - fullStart;
+
+		if (maxY == referenceMaxY &&
+			!memcmp(getImageInfoData(imageInfo), getImageInfoData(reference), dataSize) &&
+			samePolygonSets(referenceTable, polygonTable, match)) {
+			// Carry on from the results of processImageRegion(), including the
+			// order of its polygons, as the editor would
+			memcpy(image, getImageInfoData(imageInfo), dataSize);
+			saveRegionResults(&results, imageInfo, polygonTable, bufferSize);
+		} else {
+			// Start over from the correct results, so that a single wrong pass
+			// is not counted again on every pass that comes after it
+			mismatchCount++;
+			memcpy(image, getImageInfoData(reference), dataSize);
+			saveRegionResults(&results, reference, referenceTable, bufferSize);
+		}
+
+		freePolygonTable(polygonTable);
+		freeImageInfo(imageInfo);
+	}
+
+	printf("%-12s %4dx%-4d %6s %7d %9.4f %9.4f %10d\n", name, width, height, centerlines ? "on" : "off", passes, regionTotal / (double)passes, fullTotal / (double)passes, mismatchCount);
+
+cleanup:
+	if (referenceTable)
+		freePolygonTable(referenceTable);
+	if (reference)
+		freeImageInfo(reference);
+	if (results.polygonTable)
+		freePolygonTable(results.polygonTable);
+	free(results.buffer);
+	free(match);
+	free(image);
+
+	return mismatchCount;
+}
+
+int commandBenchRegion(int argc, char** argv) {
+	int passes = 200, seed = 1, first = 0;
+
+	for (; first + 1 < argc && argv[first][0] == '-'; first += 2) {
+		if (!strcmp(argv[first], "-n")) {
+			if (!parseIntArgument(argv[first + 1], &passes) || passes <= 0) {
+				fprintf(stderr, "Invalid pass count %s\n", argv[first + 1]);
+				return 1;
+			}
+		} else if (!strcmp(argv[first], "-s")) {
+			if (!parseIntArgument(argv[first + 1], &seed)) {
+				fprintf(stderr, "Invalid seed %s\n", argv[first + 1]);
+				return 1;
+			}
+		} else {
+			break;
+		}
+	}
+
+	if ((argc - first) % 3) {
+		fprintf(stderr, "Usage: pixel-headless bench-region [-n passes] [-s seed] [image.rgba width height ...]\n");
+		return 1;
+	}
+
+	const int sourceCount = ((first == argc) ? SyntheticDrawingCount : ((argc - first) / 3));
+	int result = 0;
+
+	printf("processImageRegion() | %d passes | seed %d | mean time per pass in ms, compared to processImage()\n", passes, seed);
+	printf("%-12s %9s %6s %7s %9s %9s %10s\n", "drawing", "size", "cLines", "passes", "region", "full", "mismatches");
+
+	for (int i = 0; i < sourceCount; i++) {
+		const char* name;
+		int width, height;
+		ImageInfo* imageInfo;
+		if (first == argc) {
+			const SyntheticDrawing* const drawing = &(syntheticDrawings[i]);
+			name = drawing->name;
+			width = baseWidth;
+			height = maxHeight;
+			imageInfo = allocateImageInfo(width, height);
+			if (imageInfo)
+				generateDrawing(getImageInfoData(imageInfo), width, height, drawing->strokeCount, drawing->minThickness, drawing->maxThickness, drawing->seed);
+		} else {
+			const int a = first + (i * 3);
+			if (!parseIntArgument(argv[a + 1], &width) || !parseIntArgument(argv[a + 2], &height)) {
+				fprintf(stderr, "Invalid size %s x %s\n", argv[a + 1], argv[a + 2]);
+				return 1;
+			}
+			name = strrchr(argv[a], '/');
+			name = (name ? (name + 1) : argv[a]);
+			imageInfo = loadImageInfo(argv[a], width, height);
+		}
+
+		if (!imageInfo)
+			return 1;
+
+		const size_t dataSize = ((size_t)width * (size_t)height) << 2;
+		unsigned char* const source = (unsigned char*)malloc(dataSize);
+		memcpy(source, getImageInfoData(imageInfo), dataSize);
+		freeImageInfo(imageInfo);
+
+		// The same edits, with and without centerlines
+		for (int centerlines = 0; centerlines <= 1; centerlines++) {
+			if (benchRegion(name, source, width, height, passes, centerlines, (unsigned int)seed + (unsigned int)i))
+				result = 1;
+		}
+
+		free(source);
+	}
+
+	return result;
+}
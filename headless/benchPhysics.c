@@ -0,0 +1,333 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Carlos Rafael Gimenes das Neves
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// https://github.com/carlosrafaelgn/pixel
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+#include <math.h>
+#include <chipmunk/chipmunk_private.h>
+
+#include "headless.h"
+
+// Replays levels at a fixed dt, with a deterministic gravity script, in order to
+// track the performance of step() (physics.c + Chipmunk) across releases.
+//
+// Since Level.createLevelPtr() sends gravity to step() using ControlMode.mode,
+// we use AccelerometerV here, which just scales (and limits) the vector given.
+//
+// The per-phase statistics (refer to setPhysicsStatsEnabled()) read the clock
+// for every pair in the narrow-phase, which would make step() look up to 3x
+// slower than it actually is. That's why they are only enabled by -p.
+
+#define ScriptDown 0
+#define ScriptSweep 1
+#define ScriptZigzag 2
+#define ScriptShake 3
+#define ScriptCount 4
+
+static const char* const scriptNames[ScriptCount] = { "down", "sweep", "zigzag", "shake" };
+
+typedef struct GravityScriptStruct {
+	int script;
+	unsigned int state;
+	cpFloat x, y;
+} GravityScript;
+
+static void nextGravity(GravityScript* gravityScript, int frame) {
+	switch (gravityScript->script) {
+		case ScriptSweep: {
+			// Slowly rotate the device 360 degrees every 10 seconds (at 60 fps),
+			// always keeping some downwards gravity
+			const cpFloat a = (cpFloat)frame * (cpFloat)(6.283185307 / 600.0);
+			gravityScript->x = (cpFloat)5.0 * cpfcos(a);
+			gravityScript->y = (cpFloat)2.5 + ((cpFloat)2.5 * cpfsin(a));
+			break;
+		}
+		case ScriptZigzag:
+			// Tilt the device to the left and to the right every 2 seconds
+			gravityScript->x = ((((frame / 120) & 1)) ? (cpFloat)-4.0 : (cpFloat)4.0);
+			gravityScript->y = (cpFloat)3.0;
+			break;
+		case ScriptShake: {
+			// Random targets, filtered the same way ControlMode filters accelerometer readings
+			if (!(frame % 30)) {
+				gravityScript->state = nextRandom(&(gravityScript->state));
+			}
+			const unsigned int r = gravityScript->state;
+			const cpFloat x = (cpFloat)((int)(r & 0xff) - 128) * (cpFloat)(6.0 / 128.0);
+			const cpFloat y = (cpFloat)((int)((r >> 8) & 0xff) - 64) * (cpFloat)(6.0 / 128.0);
+			gravityScript->x = ((cpFloat)0.8 * gravityScript->x) + ((cpFloat)0.2 * x);
+			gravityScript->y = ((cpFloat)0.8 * gravityScript->y) + ((cpFloat)0.2 * y);
+			break;
+		}
+		default:
+			gravityScript->x = (cpFloat)0.0;
+			gravityScript->y = (cpFloat)5.0;
+			break;
+	}
+}
+
+static int compareDouble(const void* a, const void* b) {
+	const double da = *(const double*)a, db = *(const double*)b;
+	return ((da < db) ? -1 : ((da > db) ? 1 : 0));
+}
+
+double percentile(const double* sortedValues, int count, double p) {
+	if (count <= 0)
+		return 0;
+	int i = (int)((p * (double)(count - 1)) + 0.5);
+	if (i >= count)
+		i = count - 1;
+	return sortedValues[i];
+}
+
+void sortDoubles(double* values, int count) {
+	qsort(values, (size_t)count, sizeof(double), compareDouble);
+}
+
+#define OutputLatency 0
+#define OutputPhases 1
+#define OutputReplay 2
+
+static void benchLevel(const LevelDescription* levelDescription, int frameCount, double deltaMilliseconds, int script, unsigned int seed, int output, double* stepTimes) {
+	GravityScript gravityScript;
+	gravityScript.script = script;
+	gravityScript.state = (seed ? seed : 1);
+	gravityScript.x = 0;
+	gravityScript.y = 0;
+
+	Level* const level = createLevel(levelDescription->height, &(levelDescription->polygonList), &(levelDescription->objectList), 0);
+	Recording* const recording = ((output == OutputReplay) ? allocateRecording(frameCount) : 0);
+	if (recording)
+		startRecording(level, recording, seed);
+	else
+		setLevelSeed(level, seed);
+	setPhysicsStatsEnabled(level, output == OutputPhases);
+	const PhysicsStats* const physicsStats = getPhysicsStatsPtr(level);
+	const cpSpaceStepStats* const spaceStats = &(physicsStats->space);
+
+	// This is what renderBackground() does every frame
+	level->deltaMilliseconds = (int)deltaMilliseconds;
+	level->deltaSeconds = (cpFloat)(deltaMilliseconds * 0.001);
+
+	double totalTime = 0;
+	cpSpaceStepStats spaceSum;
+	double gameLogicSum = 0;
+	long long pairSum = 0, arbiterSum = 0, contactSum = 0;
+	int arbiterMax = 0, dynamicTreeDepthMax = 0, frame, finishedFrame = -1;
+
+	memset(&spaceSum, 0, sizeof(spaceSum));
+
+	for (frame = 0; frame < frameCount; frame++) {
+		nextGravity(&gravityScript, frame);
+
+		// Resize the view halfway through, as if the window had been resized,
+		// which replayRecording() must reproduce as well
+		if (recording && frame == (frameCount >> 1))
+			viewResized(level, (cpFloat)baseWidth, (cpFloat)(HeadlessViewHeight >> 1));
+
+		const double start = getTimeMilliseconds();
+		step(level, gravityScript.x, gravityScript.y, AccelerometerV, 0);
+		const double elapsed = getTimeMilliseconds() - start;
+
+		stepTimes[frame] = elapsed;
+		totalTime += elapsed;
+
+		spaceSum.integrate += spaceStats->integrate;
+		spaceSum.shapeUpdate += spaceStats->shapeUpdate;
+		spaceSum.broadphase += spaceStats->broadphase;
+		spaceSum.narrowphase += spaceStats->narrowphase;
+		spaceSum.components += spaceStats->components;
+		spaceSum.arbiterFilter += spaceStats->arbiterFilter;
+		spaceSum.preStep += spaceStats->preStep;
+		spaceSum.solver += spaceStats->solver;
+		spaceSum.postStep += spaceStats->postStep;
+		gameLogicSum += physicsStats->stepMilliseconds - physicsStats->spaceStepMilliseconds;
+
+		// Read straight from the space, as the statistics are disabled while measuring latency
+		const cpArray* const arbiters = level->space->arbiters;
+		arbiterSum += arbiters->num;
+		if (arbiterMax < arbiters->num)
+			arbiterMax = arbiters->num;
+		for (int a = arbiters->num - 1; a >= 0; a--)
+			contactSum += ((const cpArbiter*)arbiters->arr[a])->count;
+
+		pairSum += spaceStats->pairCount;
+		if (dynamicTreeDepthMax < spaceStats->dynamicTreeDepth)
+			dynamicTreeDepthMax = spaceStats->dynamicTreeDepth;
+
+		if (level->finished) {
+			finishedFrame = frame + 1;
+			frame++;
+			break;
+		}
+	}
+
+	if (recording) {
+		stopRecording(level);
+
+		// Play it all again, and check whether the outcome is exactly the same
+		Level* const replayLevel = createLevel(levelDescription->height, &(levelDescription->polygonList), &(levelDescription->objectList), 0);
+		setPhysicsStatsEnabled(replayLevel, 0);
+		replayLevel->deltaMilliseconds = (int)deltaMilliseconds;
+		replayLevel->deltaSeconds = (cpFloat)(deltaMilliseconds * 0.001);
+
+		const double start = getTimeMilliseconds();
+		const int replayElapsedMilliseconds = replayRecording(replayLevel, recording);
+		const double replayTime = getTimeMilliseconds() - start;
+
+		const int match = (replayElapsedMilliseconds == level->totalElapsedMilliseconds &&
+			replayLevel->finished == level->finished &&
+			replayLevel->victory == level->victory &&
+			replayLevel->ballsSaved == level->ballsSaved &&
+			replayLevel->ballsDestroyed == level->ballsDestroyed &&
+			replayLevel->viewY == level->viewY);
+
+		printf("%-10.10s %6d %-10s %8d %5d %5d %10.3f %10.3f %9.0fx %s\n",
+			levelDescription->name,
+			recording->frameCount,
+			(finishedFrame < 0 ? "unfinished" : (level->victory ? "victory" : "loss")),
+			level->totalElapsedMilliseconds,
+			level->ballsSaved,
+			level->ballsDestroyed,
+			totalTime,
+			replayTime,
+			(double)frame * deltaMilliseconds / replayTime,
+			(match ? "match" : "MISMATCH"));
+
+		destroy(replayLevel);
+		freeRecording(recording);
+	} else if (output == OutputPhases) {
+		// All times are mean values per frame
+		const double scale = 1000.0 / (double)frame;
+		printf("%-10.10s %6d %7.2f %7.2f %7.2f %7.2f %7.2f %7.2f %7.2f %7.2f %7.2f %7.2f %7.1f %5d %6d\n",
+			levelDescription->name,
+			frame,
+			spaceSum.integrate * scale,
+			spaceSum.shapeUpdate * scale,
+			spaceSum.broadphase * scale,
+			spaceSum.narrowphase * scale,
+			spaceSum.components * scale,
+			spaceSum.arbiterFilter * scale,
+			spaceSum.preStep * scale,
+			spaceSum.solver * scale,
+			spaceSum.postStep * scale,
+			gameLogicSum * scale,
+			(double)pairSum / (double)frame,
+			dynamicTreeDepthMax,
+			spaceStats->staticTreeDepth);
+	} else {
+		sortDoubles(stepTimes, frame);
+
+		printf("%-10.10s %5d %4d %6d %8.2f %8.2f %8.2f %8.2f %8.2f %7.1f %5d %8.1f %-10s %8d\n",
+			levelDescription->name,
+			level->wallCount,
+			level->objectCount,
+			frame,
+			(totalTime * 1000.0) / (double)frame,
+			percentile(stepTimes, frame, 0.50) * 1000.0,
+			percentile(stepTimes, frame, 0.95) * 1000.0,
+			percentile(stepTimes, frame, 0.99) * 1000.0,
+			stepTimes[frame - 1] * 1000.0,
+			(double)arbiterSum / (double)frame,
+			arbiterMax,
+			(double)contactSum / (double)frame,
+			(finishedFrame < 0 ? "unfinished" : (level->victory ? "victory" : "loss")),
+			level->totalElapsedMilliseconds);
+	}
+
+	destroy(level);
+}
+
+int commandBenchPhysics(int argc, char** argv) {
+	int frameCount = 3600, script = ScriptDown, seed = 1, output = OutputLatency, i;
+	double deltaMilliseconds = 1000.0 / 60.0;
+
+	for (i = 0; i < argc && argv[i][0] == '-'; i += 2) {
+		// -p and -r are the only options without a value
+		if (!strcmp(argv[i], "-p") || !strcmp(argv[i], "-r")) {
+			output = ((argv[i][1] == 'p') ? OutputPhases : OutputReplay);
+			i--;
+			continue;
+		}
+		if ((i + 1) >= argc)
+			break;
+		const char* const value = argv[i + 1];
+		if (!strcmp(argv[i], "-f")) {
+			if (!parseIntArgument(value, &frameCount) || frameCount <= 0)
+				break;
+		} else if (!strcmp(argv[i], "-dt")) {
+			deltaMilliseconds = atof(value);
+			if (deltaMilliseconds < 1.0 || deltaMilliseconds > 1000.0)
+				break;
+		} else if (!strcmp(argv[i], "-g")) {
+			for (script = ScriptCount - 1; script >= 0; script--) {
+				if (!strcmp(value, scriptNames[script]))
+					break;
+			}
+			if (script < 0)
+				break;
+		} else if (!strcmp(argv[i], "-s")) {
+			if (!parseIntArgument(value, &seed))
+				break;
+		} else {
+			break;
+		}
+	}
+
+	if (i >= argc || argv[i][0] == '-') {
+		fprintf(stderr, "Usage: pixel-headless bench-physics [-f frames] [-dt milliseconds] [-g down|sweep|zigzag|shake] [-s seed] [-p | -r] <levels.json|levels.js> ...\n");
+		return 1;
+	}
+
+	double* const stepTimes = (double*)malloc(sizeof(double) * (size_t)frameCount);
+
+	printf("step() | up to %d frames | dt %.3f ms | gravity %s | seed %d | step times in us\n", frameCount, deltaMilliseconds, scriptNames[script], seed);
+	if (output == OutputReplay)
+		printf("%-10s %6s %-10s %8s %5s %5s %10s %10s %10s %s\n", "level", "frames", "outcome", "elapsed", "saved", "lost", "play ms", "replay ms", "realtime", "replay");
+	else if (output == OutputPhases)
+		printf("%-10s %6s %7s %7s %7s %7s %7s %7s %7s %7s %7s %7s %7s %5s %6s\n", "level", "frames", "integr", "shapes", "broad", "narrow", "comps", "filter", "prestep", "solver", "post", "game", "pairs", "dtree", "stree");
+	else
+		printf("%-10s %5s %4s %6s %8s %8s %8s %8s %8s %7s %5s %8s %-10s %8s\n", "level", "walls", "objs", "frames", "mean", "p50", "p95", "p99", "max", "arbs", "max", "contacts", "outcome", "elapsed");
+
+	int result = 0;
+	for (; i < argc; i++) {
+		LevelDescription* levelDescriptions;
+		int levelCount;
+		if (!loadLevelFile(argv[i], &levelDescriptions, &levelCount)) {
+			result = 1;
+			continue;
+		}
+		for (int l = 0; l < levelCount; l++)
+			benchLevel(&(levelDescriptions[l]), frameCount, deltaMilliseconds, script, (unsigned int)seed, output, stepTimes);
+		freeLevelDescriptions(levelDescriptions, levelCount);
+	}
+
+	free(stepTimes);
+
+	return result;
+}
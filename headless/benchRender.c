@@ -0,0 +1,247 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Carlos Rafael Gimenes das Neves
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// https://github.com/carlosrafaelgn/pixel
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "headless.h"
+
+// Measures how long gl.c takes to turn the current state of a level into
+// vertices, without any GPU involved (drawNative() only counts rectangles).
+// The level state is forged directly, in order to reach the worst cases
+// allowed by the game, regardless of how likely they are during gameplay.
+
+#define BenchBallCount 40
+#define BenchBombCount 16
+#define BenchCucumberCount 16
+#define RunCount 5
+
+#define ScenarioIdle 0
+#define ScenarioExplosion 1
+#define ScenarioVictory 2
+#define ScenarioBackground 3
+#define ScenarioCount 4
+
+#define FunctionRenderBackground 0
+#define FunctionRenderCompactBackground 1
+#define FunctionRender 2
+
+static const char* const scenarioNames[ScenarioCount] = { "idle", "explosion", "victory", "background" };
+static const char* const functionNames[] = { "renderBackground", "renderCompactBackground", "render" };
+
+static long long benchRectangleCount, benchFlushCount;
+
+static void drawNative(int rectangleCount) {
+	benchRectangleCount += rectangleCount;
+	benchFlushCount++;
+}
+
+static Level* createBenchLevel(unsigned int seed) {
+	unsigned int state = seed;
+	PolygonList polygonList;
+	LevelObjectList objectList;
+
+	initPolygonList(&polygonList);
+	objectList.objectCount = 0;
+
+	// Objects must be added sorted by type (refer to Level.createLevelPtr())
+	for (int i = 0; i < BenchBallCount; i++)
+		addLevelObject(&objectList, TypeBall, (cpFloat)(20 + (nextRandom(&state) % (baseWidth - 40))), (cpFloat)(20 + (nextRandom(&state) % (HeadlessViewHeight - 40))));
+	addLevelObject(&objectList, TypeGoal, (cpFloat)(baseWidth >> 1), (cpFloat)(HeadlessViewHeight - 20));
+	for (int i = 0; i < BenchBombCount; i++)
+		addLevelObject(&objectList, TypeBomb, (cpFloat)(20 + (nextRandom(&state) % (baseWidth - 40))), (cpFloat)(20 + (nextRandom(&state) % (HeadlessViewHeight - 40))));
+	for (int i = 0; i < BenchCucumberCount; i++)
+		addLevelObject(&objectList, TypeCucumber, (cpFloat)(20 + (nextRandom(&state) % (baseWidth - 40))), (cpFloat)(20 + (nextRandom(&state) % (HeadlessViewHeight - 40))));
+
+	Level* const level = createLevel(HeadlessViewHeight, &polygonList, &objectList, 0);
+
+	freePolygonList(&polygonList);
+
+	return level;
+}
+
+static void prepareScenario(Level* level, int scenario, unsigned int seed) {
+	unsigned int state = seed;
+	const int ballCount = level->countByType[TypeBall];
+	const int fragmentCount = (ballCount * FragmentsPerBall) + VictoryFragmentCount;
+
+	level->finished = 0;
+	level->finishedFading = 0;
+	level->fragmentsAlive = 0;
+	level->fadeBgAlpha = 0.0f;
+	level->explosionBgAlpha = 0.0f;
+	level->globalAlpha = 1.0f;
+	level->cucumbersAnimating = 0;
+	level->pointerCursorAttached = 0;
+	memset(level->fragmentTime, 0, sizeof(float) * ballCount);
+	memset(level->fragmentSaved, 0, sizeof(int) * (ballCount + VictoryFragmentCount));
+
+	// Spread all fragments over the view, so none of them is culled
+	for (int i = 0; i < fragmentCount; i++) {
+		level->fragmentX[i] = (float)(nextRandom(&state) % baseWidth);
+		level->fragmentY[i] = (float)(nextRandom(&state) % HeadlessViewHeight);
+	}
+
+	switch (scenario) {
+	case ScenarioExplosion:
+		// All balls exploding at once, half of them saved, with all
+		// cucumbers animating and the pointer cursor visible
+		level->fragmentsAlive = 1;
+		level->explosionBgAlpha = 1.0f;
+		for (int f = 0; f < ballCount; f++) {
+			level->fragmentSaved[f] = (f & 1);
+			level->fragmentTime[f] = (f & 1) ? FragmentsMaxTimeSaved : FragmentsMaxTime;
+		}
+		level->cucumbersAnimating = 1;
+		for (int c = level->countByType[TypeCucumber], i = level->firstIndexByType[TypeCucumber]; c > 0; c--, i++)
+			level->objectVisibility[i] = VisibilityAll | ((c & 1) ? 0 : (128 << 8));
+		level->pointerCursorAttached = 1;
+		break;
+	case ScenarioVictory:
+		// The level has finished and all victory fragments are visible
+		level->finished = FinishedVictory;
+		level->finishedFading = FinishedGame;
+		level->fadeBgAlpha = 1.0f;
+		level->explosionBgAlpha = 0.5f;
+		for (int i = ballCount + VictoryFragmentCount - 1; i >= ballCount; i--)
+			level->fragmentSaved[i] = 1;
+		break;
+	case ScenarioBackground:
+		// Every optional background layer is drawn
+		level->finished = FinishedLoss;
+		level->explosionBgAlpha = 0.5f;
+		break;
+	}
+}
+
+static double runFunction(int function, int frameCount, float* vertices, Level* level, LevelSpriteSheet* levelSpriteSheet, float* time) {
+	const float explosionBgAlpha = level->explosionBgAlpha;
+	const float fadeBgAlpha = level->fadeBgAlpha;
+
+	const double start = getTimeMilliseconds();
+	for (int frame = frameCount; frame > 0; frame--) {
+		// Simulate a 60 fps display
+		*time += (1000.0f / 60.0f);
+		switch (function) {
+		case FunctionRenderBackground:
+			renderBackground(vertices, level, levelSpriteSheet, (float)HeadlessViewHeight, *time, 1);
+			// Undo the changes made by renderBackground(), so every frame
+			// renders the same amount of rectangles
+			level->fadeBgAlpha = fadeBgAlpha;
+			break;
+		case FunctionRenderCompactBackground:
+			renderCompactBackground(vertices, level, levelSpriteSheet, *time);
+			break;
+		default:
+			render(vertices, level, levelSpriteSheet, 1.0f);
+			// render() recomputes explosionBgAlpha from the fragments
+			level->explosionBgAlpha = explosionBgAlpha;
+			break;
+		}
+	}
+	return getTimeMilliseconds() - start;
+}
+
+int commandBenchRender(int argc, char** argv) {
+	int frameCount = 2000, seed = 1;
+
+	for (int i = 0; i < argc; i += 2) {
+		if (i + 1 >= argc) {
+			fprintf(stderr, "Usage: pixel-headless bench-render [-f frames] [-s seed]\n");
+			return 1;
+		}
+		if (!strcmp(argv[i], "-f")) {
+			if (!parseIntArgument(argv[i + 1], &frameCount) || frameCount <= 0) {
+				fprintf(stderr, "Invalid frame count %s\n", argv[i + 1]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "-s")) {
+			if (!parseIntArgument(argv[i + 1], &seed)) {
+				fprintf(stderr, "Invalid seed %s\n", argv[i + 1]);
+				return 1;
+			}
+		} else {
+			fprintf(stderr, "Unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	Level* const level = createBenchLevel((unsigned int)seed);
+	LevelSpriteSheet* const levelSpriteSheet = initLevelSpriteSheet();
+	float* const vertices = (float*)allocateBuffer(BytesPerRectangle * RectangleCapacity);
+
+	setDrawNativeCallback(drawNative);
+
+	printf("Vertex emission | %d frames | best of %d runs | %d bytes per rectangle | flush every %d rectangles\n", frameCount, RunCount, BytesPerRectangle, RectangleCapacity);
+	printf("%-11s %-24s %10s %12s %9s %10s %9s\n", "scenario", "function", "rect/frame", "bytes/frame", "flushes", "us/frame", "ns/rect");
+
+	// Must be in sync with the way scripts/view/gameView.ts calls these functions
+	static const int functionsByScenario[ScenarioCount][2] = {
+		{ FunctionRenderBackground, FunctionRender },
+		{ FunctionRenderBackground, FunctionRender },
+		{ FunctionRenderCompactBackground, FunctionRender },
+		{ FunctionRenderBackground, -1 }
+	};
+
+	float time = 0.0f;
+
+	for (int scenario = 0; scenario < ScenarioCount; scenario++) {
+		for (int f = 0; f < 2; f++) {
+			const int function = functionsByScenario[scenario][f];
+			if (function < 0)
+				continue;
+
+			prepareScenario(level, scenario, (unsigned int)seed);
+
+			// Warm up, and count how many rectangles each frame produces
+			benchRectangleCount = 0;
+			benchFlushCount = 0;
+			runFunction(function, 1, vertices, level, levelSpriteSheet, &time);
+			const long long rectangleCount = benchRectangleCount;
+			const long long flushCount = benchFlushCount;
+			runFunction(function, frameCount, vertices, level, levelSpriteSheet, &time);
+
+			double best = 0;
+			for (int run = 0; run < RunCount; run++) {
+				const double elapsed = runFunction(function, frameCount, vertices, level, levelSpriteSheet, &time);
+				if (!run || best > elapsed)
+					best = elapsed;
+			}
+
+			const double nanosecondsPerFrame = (best * 1000000.0) / (double)frameCount;
+			printf("%-11s %-24s %10lld %12lld %9lld %10.3f %9.2f\n", scenarioNames[scenario], functionNames[function], rectangleCount, rectangleCount * BytesPerRectangle, flushCount, nanosecondsPerFrame * 0.001, rectangleCount ? (nanosecondsPerFrame / (double)rectangleCount) : 0.0);
+		}
+	}
+
+	setDrawNativeCallback(0);
+
+	freeBuffer(vertices);
+	freeBuffer(levelSpriteSheet);
+	destroy(level);
+
+	return 0;
+}
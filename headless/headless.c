@@ -0,0 +1,303 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Carlos Rafael Gimenes das Neves
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// https://github.com/carlosrafaelgn/pixel
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+
+#include "headless.h"
+
+unsigned int nextRandom(unsigned int* state) {
+	// xorshift32 (https://en.wikipedia.org/wiki/Xorshift), used instead of rand()
+	// so that the same seed produces the same results on every platform
+	unsigned int x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+unsigned char* loadFile(const char* path, size_t* size) {
+	FILE* const file = fopen(path, "rb");
+	if (!file)
+		return 0;
+
+	unsigned char* data = 0;
+	long length;
+	if (!fseek(file, 0, SEEK_END) && (length = ftell(file)) >= 0 && !fseek(file, 0, SEEK_SET)) {
+		// + 1 to allow text files to be zero-terminated
+		data = (unsigned char*)malloc((size_t)length + 1);
+		if (data) {
+			if (fread(data, 1, (size_t)length, file) == (size_t)length) {
+				data[length] = 0;
+				*size = (size_t)length;
+			} else {
+				free(data);
+				data = 0;
+			}
+		}
+	}
+
+	fclose(file);
+	return data;
+}
+
+int saveFile(const char* path, const unsigned char* data, size_t size) {
+	FILE* const file = fopen(path, "wb");
+	if (!file)
+		return 0;
+
+	const int ok = (fwrite(data, 1, size, file) == size);
+	return (fclose(file) == 0 && ok);
+}
+
+int parseIntArgument(const char* str, int* value) {
+	char* end;
+	const long l = strtol(str, &end, 10);
+	if (end == str || *end)
+		return 0;
+	*value = (int)l;
+	return 1;
+}
+
+ImageInfo* loadImageInfo(const char* path, int width, int height) {
+	if (width <= 0 || width > baseWidth || height <= 0 || height > maxHeight) {
+		fprintf(stderr, "Invalid image size %d x %d (max %d x %d)\n", width, height, baseWidth, maxHeight);
+		return 0;
+	}
+
+	size_t size = 0;
+	unsigned char* const data = loadFile(path, &size);
+	if (!data) {
+		fprintf(stderr, "Could not read %s\n", path);
+		return 0;
+	}
+
+	if (size != ((size_t)width * (size_t)height * 4)) {
+		fprintf(stderr, "%s has %zu bytes, but a %d x %d RGBA image should have %d bytes\n", path, size, width, height, width * height * 4);
+		free(data);
+		return 0;
+	}
+
+	ImageInfo* const imageInfo = allocateImageInfo(width, height);
+	memcpy(getImageInfoData(imageInfo), data, size);
+	free(data);
+
+	return imageInfo;
+}
+
+void initPolygonList(PolygonList* polygonList) {
+	memset(polygonList, 0, sizeof(PolygonList));
+}
+
+void clearPolygonList(PolygonList* polygonList) {
+	polygonList->polygonCount = 0;
+	polygonList->pointCount = 0;
+}
+
+void freePolygonList(PolygonList* polygonList) {
+	if (polygonList->firstPoint)
+		free(polygonList->firstPoint);
+	if (polygonList->points)
+		free(polygonList->points);
+	if (polygonList->radius)
+		free(polygonList->radius);
+	if (polygonList->polygonTable)
+		freePolygonTable(polygonList->polygonTable);
+	initPolygonList(polygonList);
+}
+
+// Returns where the pointCount points of the new polygon must be stored
+static Point* reservePolygon(PolygonList* polygonList, int pointCount) {
+	// + 2 because firstPoint always has one extra element at the end
+	if ((polygonList->polygonCount + 2) > polygonList->polygonCapacity) {
+		polygonList->polygonCapacity = (polygonList->polygonCapacity ? (polygonList->polygonCapacity << 1) : 256);
+		polygonList->firstPoint = (int*)realloc(polygonList->firstPoint, sizeof(int) * polygonList->polygonCapacity);
+	}
+
+	if ((polygonList->pointCount + pointCount) > polygonList->pointCapacity) {
+		do {
+			polygonList->pointCapacity = (polygonList->pointCapacity ? (polygonList->pointCapacity << 1) : 4096);
+		} while ((polygonList->pointCount + pointCount) > polygonList->pointCapacity);
+		polygonList->points = (Point*)realloc(polygonList->points, sizeof(Point) * polygonList->pointCapacity);
+		polygonList->radius = (unsigned char*)realloc(polygonList->radius, polygonList->pointCapacity);
+	}
+
+	// Polygons are closed unless the caller says otherwise
+	memset(polygonList->radius + polygonList->pointCount, 0, pointCount);
+
+	Point* const points = polygonList->points + polygonList->pointCount;
+	polygonList->firstPoint[polygonList->polygonCount++] = polygonList->pointCount;
+	polygonList->pointCount += pointCount;
+	polygonList->firstPoint[polygonList->polygonCount] = polygonList->pointCount;
+	return points;
+}
+
+void addPolygon(PolygonList* polygonList, const Point* points, int pointCount) {
+	memcpy(reservePolygon(polygonList, pointCount), points, sizeof(Point) * pointCount);
+}
+
+static void copyPolygonTable(PolygonList* polygonList) {
+	const PolygonTable* const polygonTable = polygonList->polygonTable;
+
+	if (polygonTable->overflowed)
+		fprintf(stderr, "Too many polygons/points (only the first %d polygons have been kept)\n", polygonTable->polygonCount);
+
+	clearPolygonList(polygonList);
+
+	for (int i = 0; i < polygonTable->polygonCount; i++) {
+		const int pointCount = polygonTable->firstPoint[i + 1] - polygonTable->firstPoint[i];
+		const short* const tablePoints = polygonTable->points + (polygonTable->firstPoint[i] << 1);
+		Point* const points = reservePolygon(polygonList, pointCount);
+
+		for (int p = 0; p < pointCount; p++) {
+			points[p].x = tablePoints[p << 1];
+			points[p].y = tablePoints[(p << 1) + 1];
+		}
+
+		memcpy(polygonList->radius + polygonList->firstPoint[i], polygonTable->radius + polygonTable->firstPoint[i], pointCount);
+	}
+}
+
+int processImageIntoPolygonList(ImageInfo* imageInfo, PolygonList* polygonList) {
+	// The table is kept between calls, as the benchmarks call processImage()
+	// several times in a row
+	if (!polygonList->polygonTable)
+		polygonList->polygonTable = allocatePolygonTable(HeadlessPolygonCapacity, HeadlessPointCapacity);
+
+	const int maxY = processImage(imageInfo, polygonList->polygonTable);
+
+	copyPolygonTable(polygonList);
+
+	return maxY;
+}
+
+int processImageMarchIntoPolygonList(ImageInfo* imageInfo, int soft, PolygonList* polygonList) {
+	// Same as processImageIntoPolygonList(), but with processImageMarch()
+	if (!polygonList->polygonTable)
+		polygonList->polygonTable = allocatePolygonTable(HeadlessPolygonCapacity, HeadlessPointCapacity);
+
+	const int maxY = processImageMarch(imageInfo, polygonList->polygonTable, soft);
+
+	copyPolygonTable(polygonList);
+
+	return maxY;
+}
+
+static void stamp(unsigned char* data, int width, int height, int cx, int cy, int radius, unsigned int color) {
+	const int r2 = radius * radius, rOuter2 = (radius + 1) * (radius + 1);
+	for (int y = cy - radius - 1; y <= cy + radius + 1; y++) {
+		if (y < 0 || y >= height)
+			continue;
+		for (int x = cx - radius - 1; x <= cx + radius + 1; x++) {
+			if (x < 0 || x >= width)
+				continue;
+			const int d2 = ((x - cx) * (x - cx)) + ((y - cy) * (y - cy));
+			if (d2 > rOuter2)
+				continue;
+			unsigned char* const pixel = data + (((y * width) + x) << 2);
+			// Emulate the antialiased border produced by the canvas brush
+			const unsigned char alpha = (d2 <= r2 ? 255 : 128);
+			if (pixel[3] >= alpha)
+				continue;
+			pixel[0] = (unsigned char)color;
+			pixel[1] = (unsigned char)(color >> 8);
+			pixel[2] = (unsigned char)(color >> 16);
+			pixel[3] = alpha;
+		}
+	}
+}
+
+void generateDrawing(unsigned char* data, int width, int height, int strokeCount, int minThickness, int maxThickness, unsigned int seed) {
+	// Each stroke is a polyline with a random brush thickness, just like the
+	// ones drawn by players in the editor
+	unsigned int state = (seed ? seed : 1);
+
+	memset(data, 0, (size_t)width * (size_t)height * 4);
+
+	for (int s = 0; s < strokeCount; s++) {
+		const int radius = (minThickness + (int)(nextRandom(&state) % (unsigned int)(maxThickness - minThickness + 1))) >> 1;
+		const unsigned int color = nextRandom(&state) | 0x404040;
+		const int segmentCount = 1 + (int)(nextRandom(&state) & 3);
+		int x = (int)(nextRandom(&state) % (unsigned int)width);
+		int y = (int)(nextRandom(&state) % (unsigned int)height);
+
+		for (int i = 0; i < segmentCount; i++) {
+			const int nextX = x + (int)(nextRandom(&state) % 241) - 120;
+			const int nextY = y + (int)(nextRandom(&state) % 241) - 120;
+			const int dx = nextX - x, dy = nextY - y;
+			const int steps = ((dx < 0 ? -dx : dx) > (dy < 0 ? -dy : dy) ? (dx < 0 ? -dx : dx) : (dy < 0 ? -dy : dy));
+			for (int t = 0; t <= steps; t++) {
+				const int px = (steps ? (x + ((dx * t) / steps)) : x);
+				const int py = (steps ? (y + ((dy * t) / steps)) : y);
+				stamp(data, width, height, px, py, radius, color);
+			}
+			x = nextX;
+			y = nextY;
+		}
+	}
+}
+
+int addLevelObject(LevelObjectList* objectList, int type, cpFloat x, cpFloat y) {
+	if (objectList->objectCount >= MaxObjectCount || type < 0 || type >= TypeCount)
+		return 0;
+
+	objectList->type[objectList->objectCount] = type;
+	objectList->x[objectList->objectCount] = x;
+	objectList->y[objectList->objectCount] = y;
+	objectList->objectCount++;
+	return 1;
+}
+
+Level* createLevel(int height, const PolygonList* polygonList, const LevelObjectList* objectList, int preview) {
+	// Must be in sync with Level.createLevelPtr() in scripts/level/level.ts
+	const cpFloat radiusByType[TypeCount] = { RadiusBall, RadiusGoal, RadiusBomb, RadiusCucumber };
+
+	PolygonTable* const polygonTable = allocatePolygonTable(polygonList->polygonCount, polygonList->pointCount);
+	cpFloat objectRadius[MaxObjectCount];
+
+	polygonTable->polygonCount = polygonList->polygonCount;
+	polygonTable->pointCount = polygonList->pointCount;
+	if (polygonList->polygonCount)
+		memcpy(polygonTable->firstPoint, polygonList->firstPoint, sizeof(int) * (polygonList->polygonCount + 1));
+	for (int i = polygonList->pointCount - 1; i >= 0; i--) {
+		polygonTable->points[i << 1] = (short)polygonList->points[i].x;
+		polygonTable->points[(i << 1) + 1] = (short)polygonList->points[i].y;
+	}
+	if (polygonList->pointCount)
+		memcpy(polygonTable->radius, polygonList->radius, polygonList->pointCount);
+
+	for (int i = objectList->objectCount - 1; i >= 0; i--)
+		objectRadius[i] = radiusByType[objectList->type[i]];
+
+	Level* const level = initFromPolygonTable((cpFloat)height, (cpFloat)baseWidth, (cpFloat)HeadlessViewHeight, polygonTable, objectList->objectCount, objectList->type, objectList->x, objectList->y, objectRadius, preview);
+
+	freePolygonTable(polygonTable);
+
+	return level;
+}
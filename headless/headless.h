@@ -0,0 +1,148 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Carlos Rafael Gimenes das Neves
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// https://github.com/carlosrafaelgn/pixel
+//
+
+#include <stddef.h>
+
+#include "shared.h"
+
+// The functions below are the same ones exported to JS, and must be
+// in sync with lib/*.c (refer to scripts/lib.ts for their JS counterparts).
+
+// Must be in sync with lib/imageProcessing.c
+typedef struct PointStructure {
+	short x, y;
+} Point;
+
+typedef struct ImageInfoStructure ImageInfo;
+
+ImageInfo* allocateImageInfo(int width, int height);
+unsigned char* getImageInfoData(ImageInfo* imageInfo);
+unsigned char* getImageInfoBuffer(ImageInfo* imageInfo);
+void setImageInfoThreadCount(ImageInfo* imageInfo, int threadCount);
+void setImageInfoCenterlines(ImageInfo* imageInfo, int centerlines);
+ImageProcessingStats* getImageInfoStats(ImageInfo* imageInfo);
+void freeImageInfo(ImageInfo* imageInfo);
+int processImage(ImageInfo* imageInfo, PolygonTable* polygonTable);
+int processImageRegion(ImageInfo* imageInfo, PolygonTable* polygonTable, int regionX, int regionY, int regionWidth, int regionHeight);
+int processImageMarch(ImageInfo* imageInfo, PolygonTable* polygonTable, int soft);
+void setImageCacheCapacity(int capacity);
+
+void* allocateBuffer(int size);
+void freeBuffer(void* buffer);
+
+Level* init(cpFloat height, cpFloat viewWidth, cpFloat viewHeight, int wallCount, const cpFloat* wallX0, const cpFloat* wallY0, const cpFloat* wallX1, const cpFloat* wallY1, int objectCount, const int* objectType, const cpFloat* objectX, const cpFloat* objectY, const cpFloat* objectRadius, int preview);
+cpFloat* getViewYPtr(Level* level);
+void* getFirstPropertyPtr(Level* level);
+PhysicsStats* getPhysicsStatsPtr(Level* level);
+void viewResized(Level* level, cpFloat viewWidth, cpFloat viewHeight);
+void step(Level* level, cpFloat gravityX, cpFloat gravityY, int mode, int paused);
+void destroy(Level* level);
+
+// Must be in sync with lib/gl.c
+typedef struct LevelSpriteSheetStruct LevelSpriteSheet;
+
+LevelSpriteSheet* initLevelSpriteSheet();
+void renderBackground(float* vertices, Level* level, LevelSpriteSheet* levelSpriteSheet, float baseHeight, float time, int animate);
+void renderCompactBackground(float* vertices, Level* level, LevelSpriteSheet* levelSpriteSheet, float time);
+int render(float* vertices, Level* level, const LevelSpriteSheet* levelSpriteSheet, float scaleFactor);
+
+// Must be in sync with scripts/main.ts (the view is never taller than it is wide)
+#define HeadlessViewHeight baseWidth
+
+// Must be in sync with scripts/level/levelObject.ts
+#define RadiusBall 6
+#define RadiusGoal 5
+#define RadiusBomb 5
+#define RadiusCucumber 6
+
+// Must be in sync with scripts/level/level.ts
+#define MaxObjectCount 256
+
+// Enough for any image as large as a level (way above the limits imposed
+// by Level.prepare() in scripts/level/level.ts)
+#define HeadlessPointCapacity (((baseWidth + 2) * (maxHeight + 2)) >> 1)
+#define HeadlessPolygonCapacity (HeadlessPointCapacity >> 1)
+
+// Polygons collected from processImage(), stored the same way
+// scripts/image/imageProcessing.ts stores them, but flattened.
+typedef struct PolygonListStruct {
+	int polygonCount, pointCount, polygonCapacity, pointCapacity;
+	int* firstPoint; // firstPoint[polygonCount] == pointCount
+	Point* points;
+	unsigned char* radius; // One per point (refer to PolygonTable in lib/shared.h)
+	PolygonTable* polygonTable; // Filled by processImage() (refer to processImageIntoPolygonList())
+} PolygonList;
+
+typedef struct LevelObjectListStruct {
+	int objectCount;
+	int type[MaxObjectCount];
+	cpFloat x[MaxObjectCount];
+	cpFloat y[MaxObjectCount];
+} LevelObjectList;
+
+typedef struct LevelDescriptionStruct {
+	char name[64];
+	int height;
+	PolygonList polygonList;
+	LevelObjectList objectList;
+} LevelDescription;
+
+unsigned int nextRandom(unsigned int* state);
+void sortDoubles(double* values, int count);
+double percentile(const double* sortedValues, int count, double p);
+
+int parseIntArgument(const char* str, int* value);
+
+unsigned char* loadFile(const char* path, size_t* size);
+int saveFile(const char* path, const unsigned char* data, size_t size);
+
+ImageInfo* loadImageInfo(const char* path, int width, int height);
+
+void initPolygonList(PolygonList* polygonList);
+void clearPolygonList(PolygonList* polygonList);
+void freePolygonList(PolygonList* polygonList);
+void addPolygon(PolygonList* polygonList, const Point* points, int pointCount);
+
+int processImageIntoPolygonList(ImageInfo* imageInfo, PolygonList* polygonList);
+int processImageMarchIntoPolygonList(ImageInfo* imageInfo, int soft, PolygonList* polygonList);
+
+void generateDrawing(unsigned char* data, int width, int height, int strokeCount, int minThickness, int maxThickness, unsigned int seed);
+
+int addLevelObject(LevelObjectList* objectList, int type, cpFloat x, cpFloat y);
+
+Level* createLevel(int height, const PolygonList* polygonList, const LevelObjectList* objectList, int preview);
+
+int loadLevelFile(const char* path, LevelDescription** levelDescriptions, int* levelCount);
+void freeLevelDescriptions(LevelDescription* levelDescriptions, int levelCount);
+
+int commandProcess(int argc, char** argv);
+int commandPlay(int argc, char** argv);
+int commandBenchImage(int argc, char** argv);
+int commandBenchBatch(int argc, char** argv);
+int commandBenchRegion(int argc, char** argv);
+int commandBenchPhysics(int argc, char** argv);
+int commandBenchChipmunk(int argc, char** argv);
+int commandBenchRender(int argc, char** argv);
@@ -0,0 +1,392 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Carlos Rafael Gimenes das Neves
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// https://github.com/carlosrafaelgn/pixel
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+
+#include "headless.h"
+
+// Just enough JSON to read the levels saved by scripts/level/level.ts (either a
+// single level, an array of levels or assets/js/levels.js, which contains one
+// JSON string per built-in level). Everything other than name, height, polygons
+// and objects is skipped, including the (huge) images.
+
+// Must be in sync with scripts/constants.ts
+#define iconSize 12
+#define iconRadius (iconSize >> 1)
+
+typedef struct JsonReaderStruct {
+	const char* p;
+	const char* end;
+} JsonReader;
+
+static void skipWhitespace(JsonReader* reader) {
+	while (reader->p < reader->end && (*reader->p == ' ' || *reader->p == '\t' || *reader->p == '\r' || *reader->p == '\n'))
+		reader->p++;
+}
+
+static int expect(JsonReader* reader, char c) {
+	skipWhitespace(reader);
+	if (reader->p >= reader->end || *reader->p != c)
+		return 0;
+	reader->p++;
+	return 1;
+}
+
+static int peek(JsonReader* reader) {
+	skipWhitespace(reader);
+	return ((reader->p < reader->end) ? *reader->p : 0);
+}
+
+static int readString(JsonReader* reader, char* str, int strSize) {
+	if (!expect(reader, '"'))
+		return 0;
+
+	int length = 0;
+	while (reader->p < reader->end && *reader->p != '"') {
+		char c = *reader->p++;
+		if (c == '\\') {
+			if (reader->p >= reader->end)
+				return 0;
+			c = *reader->p++;
+			if (c == 'u') {
+				// Non-ASCII characters are not important here
+				if ((reader->end - reader->p) < 4)
+					return 0;
+				reader->p += 4;
+				c = '?';
+			}
+		}
+		if (str && length < (strSize - 1))
+			str[length++] = c;
+	}
+
+	if (str)
+		str[length] = 0;
+
+	return expect(reader, '"');
+}
+
+static int readNumber(JsonReader* reader, double* value) {
+	skipWhitespace(reader);
+	char* end;
+	*value = strtod(reader->p, &end);
+	if (end == reader->p || end > reader->end)
+		return 0;
+	reader->p = end;
+	return 1;
+}
+
+static int skipValue(JsonReader* reader) {
+	double number;
+
+	switch (peek(reader)) {
+		case '"':
+			return readString(reader, 0, 0);
+		case '{':
+			reader->p++;
+			if (peek(reader) == '}')
+				return expect(reader, '}');
+			do {
+				if (!readString(reader, 0, 0) || !expect(reader, ':') || !skipValue(reader))
+					return 0;
+			} while (expect(reader, ','));
+			return expect(reader, '}');
+		case '[':
+			reader->p++;
+			if (peek(reader) == ']')
+				return expect(reader, ']');
+			do {
+				if (!skipValue(reader))
+					return 0;
+			} while (expect(reader, ','));
+			return expect(reader, ']');
+		case 't':
+		case 'n':
+			if ((reader->end - reader->p) < 4)
+				return 0;
+			reader->p += 4;
+			return 1;
+		case 'f':
+			if ((reader->end - reader->p) < 5)
+				return 0;
+			reader->p += 5;
+			return 1;
+		default:
+			return readNumber(reader, &number);
+	}
+}
+
+static int readPoint(JsonReader* reader, Point* point) {
+	char key[16];
+	double value;
+
+	point->x = 0;
+	point->y = 0;
+
+	if (!expect(reader, '{'))
+		return 0;
+	if (peek(reader) == '}')
+		return expect(reader, '}');
+	do {
+		if (!readString(reader, key, sizeof(key)) || !expect(reader, ':'))
+			return 0;
+		if (!strcmp(key, "x")) {
+			if (!readNumber(reader, &value))
+				return 0;
+			point->x = (short)value;
+		} else if (!strcmp(key, "y")) {
+			if (!readNumber(reader, &value))
+				return 0;
+			point->y = (short)value;
+		} else if (!skipValue(reader)) {
+			return 0;
+		}
+	} while (expect(reader, ','));
+	return expect(reader, '}');
+}
+
+static int readPolygon(JsonReader* reader, PolygonList* polygonList, Point** points, int* pointCapacity) {
+	char key[16];
+	int pointCount = 0;
+
+	if (!expect(reader, '{'))
+		return 0;
+	if (peek(reader) != '}') {
+		do {
+			if (!readString(reader, key, sizeof(key)) || !expect(reader, ':'))
+				return 0;
+			if (!strcmp(key, "points")) {
+				if (!expect(reader, '['))
+					return 0;
+				if (peek(reader) != ']') {
+					do {
+						if (pointCount >= *pointCapacity) {
+							*pointCapacity = (*pointCapacity ? (*pointCapacity << 1) : 256);
+							*points = (Point*)realloc(*points, sizeof(Point) * *pointCapacity);
+						}
+						if (!readPoint(reader, *points + pointCount))
+							return 0;
+						pointCount++;
+					} while (expect(reader, ','));
+				}
+				if (!expect(reader, ']'))
+					return 0;
+			} else if (!skipValue(reader)) {
+				return 0;
+			}
+		} while (expect(reader, ','));
+	}
+	if (!expect(reader, '}'))
+		return 0;
+
+	// Must be in sync with Polygon.revive() in scripts/image/polygon.ts
+	if (pointCount < 2)
+		return 0;
+
+	addPolygon(polygonList, *points, pointCount);
+	return 1;
+}
+
+static int readObject(JsonReader* reader, LevelObjectList* objectList) {
+	char key[16];
+	double value, type = -1, x = 0, y = 0;
+
+	if (!expect(reader, '{'))
+		return 0;
+	if (peek(reader) != '}') {
+		do {
+			if (!readString(reader, key, sizeof(key)) || !expect(reader, ':'))
+				return 0;
+			if (!strcmp(key, "type") || !strcmp(key, "x") || !strcmp(key, "y")) {
+				if (!readNumber(reader, &value))
+					return 0;
+				switch (key[0]) {
+					case 't':
+						type = value;
+						break;
+					case 'x':
+						x = value;
+						break;
+					default:
+						y = value;
+						break;
+				}
+			} else if (!skipValue(reader)) {
+				return 0;
+			}
+		} while (expect(reader, ','));
+	}
+	if (!expect(reader, '}'))
+		return 0;
+
+	// Must be in sync with LevelObject.move() in scripts/level/levelObject.ts
+	x = (int)x;
+	y = (int)y;
+	x = ((x <= iconRadius) ? iconRadius : ((x > (baseWidth - iconRadius)) ? (baseWidth - iconRadius) : x));
+	y = ((y <= iconRadius) ? iconRadius : ((y > (maxHeight - iconRadius)) ? (maxHeight - iconRadius) : y));
+
+	return addLevelObject(objectList, (int)type, (cpFloat)x, (cpFloat)y);
+}
+
+static int readLevel(JsonReader* reader, LevelDescription* levelDescription) {
+	char key[32];
+	double value;
+	Point* points = 0;
+	int pointCapacity = 0, ok = 0;
+
+	memset(levelDescription, 0, sizeof(LevelDescription));
+
+	if (!expect(reader, '{'))
+		return 0;
+	if (peek(reader) != '}') {
+		do {
+			if (!readString(reader, key, sizeof(key)) || !expect(reader, ':'))
+				goto cleanup;
+			if (!strcmp(key, "name")) {
+				if (!readString(reader, levelDescription->name, sizeof(levelDescription->name)))
+					goto cleanup;
+			} else if (!strcmp(key, "height")) {
+				if (!readNumber(reader, &value))
+					goto cleanup;
+				levelDescription->height = (int)value;
+			} else if (!strcmp(key, "polygons") && peek(reader) == '[') {
+				reader->p++;
+				if (peek(reader) != ']') {
+					do {
+						if (!readPolygon(reader, &(levelDescription->polygonList), &points, &pointCapacity))
+							goto cleanup;
+					} while (expect(reader, ','));
+				}
+				if (!expect(reader, ']'))
+					goto cleanup;
+			} else if (!strcmp(key, "objects") && peek(reader) == '[') {
+				reader->p++;
+				if (peek(reader) != ']') {
+					do {
+						if (!readObject(reader, &(levelDescription->objectList)))
+							goto cleanup;
+					} while (expect(reader, ','));
+				}
+				if (!expect(reader, ']'))
+					goto cleanup;
+			} else if (!skipValue(reader)) {
+				goto cleanup;
+			}
+		} while (expect(reader, ','));
+	}
+	ok = expect(reader, '}');
+
+	// Must be in sync with Level.revive() in scripts/level/level.ts
+	if (levelDescription->height <= iconSize || levelDescription->height > maxHeight)
+		levelDescription->height = maxHeight;
+
+cleanup:
+	if (points)
+		free(points);
+	if (!ok)
+		freePolygonList(&(levelDescription->polygonList));
+	return ok;
+}
+
+void freeLevelDescriptions(LevelDescription* levelDescriptions, int levelCount) {
+	if (!levelDescriptions)
+		return;
+	for (int i = levelCount - 1; i >= 0; i--)
+		freePolygonList(&(levelDescriptions[i].polygonList));
+	free(levelDescriptions);
+}
+
+static int appendLevel(JsonReader* reader, LevelDescription** levelDescriptions, int* levelCount, int* levelCapacity) {
+	if (*levelCount >= *levelCapacity) {
+		*levelCapacity = (*levelCapacity ? (*levelCapacity << 1) : 32);
+		*levelDescriptions = (LevelDescription*)realloc(*levelDescriptions, sizeof(LevelDescription) * *levelCapacity);
+	}
+	if (!readLevel(reader, *levelDescriptions + *levelCount))
+		return 0;
+	(*levelCount)++;
+	return 1;
+}
+
+int loadLevelFile(const char* path, LevelDescription** levelDescriptions, int* levelCount) {
+	size_t size = 0;
+	char* const json = (char*)loadFile(path, &size);
+	int levelCapacity = 0, ok = 1;
+
+	*levelDescriptions = 0;
+	*levelCount = 0;
+
+	if (!json) {
+		fprintf(stderr, "Could not read %s\n", path);
+		return 0;
+	}
+
+	JsonReader reader;
+	reader.p = json;
+	reader.end = json + size;
+
+	switch (peek(&reader)) {
+		case '{':
+			ok = appendLevel(&reader, levelDescriptions, levelCount, &levelCapacity);
+			break;
+		case '[':
+			reader.p++;
+			if (peek(&reader) != ']') {
+				do {
+					if (!(ok = appendLevel(&reader, levelDescriptions, levelCount, &levelCapacity)))
+						break;
+				} while (expect(&reader, ','));
+			}
+			break;
+		default:
+			// assets/js/levels.js (one single-quoted JSON string per level, and the
+			// images do not contain single quotes)
+			for (const char* p = json; ok && (p = strstr(p, "'{")); ) {
+				const char* const end = strstr(p + 1, "}'");
+				if (!end)
+					break;
+				reader.p = p + 1;
+				reader.end = end + 1;
+				ok = appendLevel(&reader, levelDescriptions, levelCount, &levelCapacity);
+				p = end + 2;
+			}
+			break;
+	}
+
+	free(json);
+
+	if (!ok || !*levelCount) {
+		fprintf(stderr, "Invalid level file %s\n", path);
+		freeLevelDescriptions(*levelDescriptions, *levelCount);
+		*levelDescriptions = 0;
+		*levelCount = 0;
+		return 0;
+	}
+
+	return 1;
+}
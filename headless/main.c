@@ -0,0 +1,269 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Carlos Rafael Gimenes das Neves
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// https://github.com/carlosrafaelgn/pixel
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+
+#include "headless.h"
+
+// Must be in sync with scripts/constants.ts
+#define iconSize 12
+#define iconRadius (iconSize >> 1)
+
+static int totalRectangleCount, totalFlushCount;
+
+static void drawNative(int rectangleCount) {
+	totalRectangleCount += rectangleCount;
+	totalFlushCount++;
+}
+
+int commandProcess(int argc, char** argv) {
+	int width, height;
+	if (argc < 3 || !parseIntArgument(argv[1], &width) || !parseIntArgument(argv[2], &height)) {
+		fprintf(stderr, "Usage: pixel-headless process <image.rgba> <width> <height> [processed.rgba]\n");
+		return 1;
+	}
+
+	ImageInfo* const imageInfo = loadImageInfo(argv[0], width, height);
+	if (!imageInfo)
+		return 1;
+
+	PolygonList polygonList;
+	initPolygonList(&polygonList);
+
+	const double start = getTimeMilliseconds();
+	const int maxY = processImageIntoPolygonList(imageInfo, &polygonList);
+	const double elapsed = getTimeMilliseconds() - start;
+
+	printf("polygons %d | points %d | maxY %d | time %.3f ms\n", polygonList.polygonCount, polygonList.pointCount, maxY, elapsed);
+
+	int result = 0;
+	if (argc > 3 && !saveFile(argv[3], getImageInfoData(imageInfo), (size_t)width * (size_t)height * 4)) {
+		fprintf(stderr, "Could not write %s\n", argv[3]);
+		result = 1;
+	}
+
+	freePolygonList(&polygonList);
+	freeImageInfo(imageInfo);
+
+	return result;
+}
+
+int commandPlay(int argc, char** argv) {
+	int width, height, frameCount, centerlines = 0;
+	if (argc > 0 && !strcmp(argv[0], "-l")) {
+		centerlines = 1;
+		argc--;
+		argv++;
+	}
+	if (argc < 5 || !parseIntArgument(argv[1], &width) || !parseIntArgument(argv[2], &height) || !parseIntArgument(argv[3], &frameCount) || frameCount <= 0) {
+		fprintf(stderr, "Usage: pixel-headless play [-l] <image.rgba> <width> <height> <frames> <type,x,y> [type,x,y ...]\n");
+		return 1;
+	}
+
+	LevelObjectList objectList;
+	objectList.objectCount = 0;
+	for (int i = 4; i < argc; i++) {
+		int type, x, y;
+		if (sscanf(argv[i], "%d,%d,%d", &type, &x, &y) != 3 || !addLevelObject(&objectList, type, (cpFloat)x, (cpFloat)y)) {
+			fprintf(stderr, "Invalid object %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	ImageInfo* const imageInfo = loadImageInfo(argv[0], width, height);
+	if (!imageInfo)
+		return 1;
+
+	PolygonList polygonList;
+	initPolygonList(&polygonList);
+	setImageInfoCenterlines(imageInfo, centerlines);
+
+	// Must be in sync with Level.prepare() in scripts/level/level.ts
+	int levelHeight = processImageIntoPolygonList(imageInfo, &polygonList);
+	freeImageInfo(imageInfo);
+	if (levelHeight < iconSize) {
+		levelHeight = iconSize;
+	} else {
+		levelHeight++;
+		if (levelHeight > maxHeight)
+			levelHeight = maxHeight;
+	}
+	for (int i = objectList.objectCount - 1; i >= 0; i--) {
+		const int bottom = (int)objectList.y[i] + iconRadius;
+		if (levelHeight < bottom)
+			levelHeight = bottom;
+	}
+	if (levelHeight > maxHeight)
+		levelHeight = maxHeight;
+
+	Level* const level = createLevel(levelHeight, &polygonList, &objectList, 0);
+	LevelSpriteSheet* const levelSpriteSheet = initLevelSpriteSheet();
+	float* const vertices = (float*)allocateBuffer(BytesPerRectangle * RectangleCapacity);
+
+	setDrawNativeCallback(drawNative);
+	profilerReset();
+	profilerSetEnabled(1);
+
+	double backgroundTime = 0, stepTime = 0, renderTime = 0;
+	int frame;
+	for (frame = 0; frame < frameCount && !level->finishedFading; frame++) {
+		// Simulate a 60 fps display, with the device tilted downwards
+		const float time = (float)frame * (1000.0f / 60.0f);
+		const double t0 = getTimeMilliseconds();
+		renderBackground(vertices, level, levelSpriteSheet, (float)HeadlessViewHeight, time, 1);
+		const double t1 = getTimeMilliseconds();
+		step(level, (cpFloat)0.0, (cpFloat)5.0, AccelerometerV, 0);
+		const double t2 = getTimeMilliseconds();
+		render(vertices, level, levelSpriteSheet, 1.0f);
+		const double t3 = getTimeMilliseconds();
+		backgroundTime += t1 - t0;
+		stepTime += t2 - t1;
+		renderTime += t3 - t2;
+	}
+
+	// Commit the last frame
+	profilerNextFrame();
+	profilerSetEnabled(0);
+	setDrawNativeCallback(0);
+
+	printf("pc %d | bg %.6f | step %.6f | render %.6f\n", frame, backgroundTime / frame, stepTime / frame, renderTime / frame);
+	printf("walls %d | objects %d | rectangles %d | flushes %d | elapsed %d ms | saved %d | destroyed %d | %s\n", level->wallCount, level->objectCount, totalRectangleCount, totalFlushCount, level->totalElapsedMilliseconds, level->ballsSaved, level->ballsDestroyed, (!level->finished ? "unfinished" : (level->victory ? "victory" : "loss")));
+
+	static const char* const markerNames[ProfilerMarkerCount] = { "frame", "background", "step", "render", "flush" };
+	const ProfilerStats* const profilerStats = profilerComputeStats();
+	printf("last %d frames (us) | min | median | p95 | p99 | worst\n", profilerStats->frameCount);
+	for (int m = 0; m < ProfilerMarkerCount; m++) {
+		const ProfilerMarkerStats* const markerStats = &(profilerStats->markers[m]);
+		printf("%-10s %8.2f %8.2f %8.2f %8.2f %8.2f\n", markerNames[m], markerStats->min * 1000.0, markerStats->median * 1000.0, markerStats->p95 * 1000.0, markerStats->p99 * 1000.0, markerStats->worst * 1000.0);
+	}
+
+	static const char* const subsystemNames[MemorySubsystemCount] = { "image", "level", "space", "arbiters", "contacts", "bbtree", "other" };
+	const AllocationStats* const allocationStats = getAllocationStats();
+	printf("memory | live bytes | peak bytes | live allocations | allocations\n");
+	for (int s = 0; s < MemorySubsystemCount; s++)
+		printf("%-10s %10d %10d %8d %8d\n", subsystemNames[s], allocationStats->liveBytes[s], allocationStats->peakBytes[s], allocationStats->liveCount[s], allocationStats->allocationCount[s]);
+	printf("%-10s %10d %10d\n", "total", allocationStats->totalLiveBytes, allocationStats->totalPeakBytes);
+
+	freeBuffer(vertices);
+	freeBuffer(levelSpriteSheet);
+	destroy(level);
+	freePolygonList(&polygonList);
+
+	return 0;
+}
+
+// Returns -1 when the command is unknown
+static int runCommand(int argc, char** argv) {
+	if (!strcmp(argv[0], "process"))
+		return commandProcess(argc - 1, argv + 1);
+	if (!strcmp(argv[0], "play"))
+		return commandPlay(argc - 1, argv + 1);
+	if (!strcmp(argv[0], "bench-image"))
+		return commandBenchImage(argc - 1, argv + 1);
+	if (!strcmp(argv[0], "bench-batch"))
+		return commandBenchBatch(argc - 1, argv + 1);
+	if (!strcmp(argv[0], "bench-region"))
+		return commandBenchRegion(argc - 1, argv + 1);
+	if (!strcmp(argv[0], "bench-physics"))
+		return commandBenchPhysics(argc - 1, argv + 1);
+	if (!strcmp(argv[0], "bench-chipmunk"))
+		return commandBenchChipmunk(argc - 1, argv + 1);
+	if (!strcmp(argv[0], "bench-render"))
+		return commandBenchRender(argc - 1, argv + 1);
+	return -1;
+}
+
+static int runTracedCommand(const char* path, int argc, char** argv) {
+	// 1M events (32 MiB) is enough for a few minutes of gameplay
+	if (!traceStart(1 << 20)) {
+		fprintf(stderr, "Could not allocate the trace buffer\n");
+		return 1;
+	}
+
+	int result = runCommand(argc, argv);
+	tracePause();
+
+	if (result >= 0) {
+		char* const json = traceExportJson();
+		if (!json || !saveFile(path, (const unsigned char*)json, strlen(json))) {
+			fprintf(stderr, "Could not write %s\n", path);
+			result = 1;
+		} else {
+			fprintf(stderr, "%d trace events written to %s (%d dropped)\n", getTraceEventCount(), path, getTraceDroppedEventCount());
+		}
+		freeBuffer(json);
+	}
+
+	traceStop();
+
+	return result;
+}
+
+int main(int argc, char** argv) {
+	int result = -1;
+
+	if (argc >= 4 && !strcmp(argv[1], "trace"))
+		result = runTracedCommand(argv[2], argc - 3, argv + 3);
+	else if (argc >= 2)
+		result = runCommand(argc - 1, argv + 1);
+
+	if (result >= 0)
+		return result;
+
+	fprintf(stderr,
+		"Usage: pixel-headless <command> [arguments]\n"
+		"\n"
+		"Commands:\n"
+		"  process <image.rgba> <width> <height> [processed.rgba]\n"
+		"      Runs processImage() over a raw RGBA image (e.g. convert level.png rgba:level.rgba)\n"
+		"  play [-l] <image.rgba> <width> <height> <frames> <type,x,y> [type,x,y ...]\n"
+		"      Processes the image (turning thick strokes into centerlines, with -l), creates a level\n"
+		"      and runs renderBackground(), step() and render()\n"
+		"  bench-image [-n iterations] [-t threads] [-c cacheBytes] [-m hard|soft] [-l] [image.rgba width height ...]\n"
+		"      Benchmarks each phase of processImage() (uses synthetic drawings when no image is given), or\n"
+		"      of processImageMarch(), with -m (-l turns thick strokes into centerlines)\n"
+		"  bench-batch [-n iterations] [-t threads] [-j copies] [-l] [image.rgba width height ...]\n"
+		"      Processes copies copies of each image (or of the synthetic drawings) with processImageBatch(),\n"
+		"      using 1 and threads threads, and checks the results against processImage()\n"
+		"  bench-region [-n passes] [-s seed] [image.rgba width height ...]\n"
+		"      Applies random brush and eraser strokes to each image (or to the synthetic drawings), with and\n"
+		"      without centerlines, and checks the results of processImageRegion() against processImage()\n"
+		"  bench-physics [-f frames] [-dt milliseconds] [-g down|sweep|zigzag|shake] [-s seed] [-p | -r] <levels.json|levels.js> ...\n"
+		"      Replays levels at a fixed dt with scripted gravity and reports step() latency percentiles\n"
+		"      (or, with -p, the mean time spent in each phase of step(), in us, or, with -r, records\n"
+		"      each game and checks whether replayRecording() reproduces its outcome)\n"
+		"  bench-chipmunk [-s seed]\n"
+		"      Microbenchmarks cpCollide(), the BBTree queries, cpHashSetFilter() and cpArbiterApplyImpulse()\n"
+		"  bench-render [-f frames] [-s seed]\n"
+		"      Measures vertex emission of renderBackground(), renderCompactBackground() and render() in worst-case states\n"
+		"  trace <trace.json> <command> [arguments]\n"
+		"      Runs any of the commands above, saving the events as Chrome trace_event JSON (chrome://tracing)\n"
+	);
+	return 1;
+}
@@ -67,11 +67,35 @@ CP_EXPORT void cpMessage(const char *condition, const char *file, int line, int
 	#define CP_BUFFER_BYTES (32*1024)
 #endif
 
+/// Allocation categories, used to tell apart the main Chipmunk buffers
+/// when allocations are being accounted (refer to CP_ACCOUNT_ALLOCATIONS).
+#define CP_ALLOC_GENERAL 0
+#define CP_ALLOC_ARBITERS 1
+#define CP_ALLOC_CONTACTS 2
+#define CP_ALLOC_BBTREE 3
+
+#ifdef CP_ACCOUNT_ALLOCATIONS
+	/// Allocation functions that must be provided by the application when CP_ACCOUNT_ALLOCATIONS is defined.
+	void *cpAccountedCalloc(size_t count, size_t size, int category);
+	void *cpAccountedRealloc(void *ptr, size_t size);
+	void cpAccountedFree(void *ptr);
+	
+	#define cpcalloc(count, size) cpAccountedCalloc(count, size, CP_ALLOC_GENERAL)
+	#define cprealloc cpAccountedRealloc
+	#define cpfree cpAccountedFree
+	#define cpcallocCategory cpAccountedCalloc
+#endif
+
 #ifndef cpcalloc
 	/// Chipmunk calloc() alias.
 	#define cpcalloc calloc
 #endif
 
+#ifndef cpcallocCategory
+	/// Chipmunk calloc() alias, for allocations belonging to one of the CP_ALLOC_* categories.
+	#define cpcallocCategory(count, size, category) cpcalloc(count, size)
+#endif
+
 #ifndef cprealloc
 	/// Chipmunk realloc() alias.
 	#define cprealloc realloc
@@ -437,6 +437,11 @@ struct cpSpace {
 	cpBool skipPostStep;
 	cpArray *postStepCallbacks;
 	
+	cpSpaceStepStats *stepStats;
+	cpSpaceStepClockFunc stepClock;
+	cpSpaceStepPhaseFunc stepPhaseFunc;
+	void *stepPhaseData;
+	
 	cpBody *staticBody;
 	cpBody _staticBody;
 };
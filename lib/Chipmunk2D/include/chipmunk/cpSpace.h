@@ -254,6 +254,27 @@ CP_EXPORT void cpSpaceUseSpatialHash(cpSpace *space, cpFloat dim, int count);
 /// Step the space forward in time by @c dt.
 CP_EXPORT void cpSpaceStep(cpSpace *space, cpFloat dt);
 
+/// Per-phase statistics gathered by cpSpaceStep().
+/// Times are expressed in the same unit returned by the clock function passed to cpSpaceSetStepStats().
+typedef struct cpSpaceStepStats {
+	double integrate, shapeUpdate, broadphase, narrowphase, components, arbiterFilter, preStep, solver, postStep;
+	int arbiterCount, contactCount, pairCount, dynamicTreeDepth, staticTreeDepth, staticShapeCount;
+} cpSpaceStepStats;
+
+/// Clock function used to time the phases of cpSpaceStep().
+typedef double (*cpSpaceStepClockFunc)(void);
+
+/// Make cpSpaceStep() fill @c stats every step, using @c clock to measure time.
+/// Pass NULL as @c stats to stop gathering statistics (the default).
+CP_EXPORT void cpSpaceSetStepStats(cpSpace *space, cpSpaceStepStats *stats, cpSpaceStepClockFunc clock);
+
+/// Callback invoked by cpSpaceStep() at the end of each phase, while gathering statistics.
+/// @c phase is the name of the matching cpSpaceStepStats field, and @c start/@c end come from the clock function.
+typedef void (*cpSpaceStepPhaseFunc)(const char *phase, double start, double end, void *data);
+
+/// Set the callback invoked at the end of each phase (only used when gathering statistics).
+CP_EXPORT void cpSpaceSetStepPhaseFunc(cpSpace *space, cpSpaceStepPhaseFunc func, void *data);
+
 
 //MARK: Debug API
 
@@ -95,6 +95,10 @@ CP_EXPORT cpSpatialIndex* cpBBTreeNew(cpSpatialIndexBBFunc bbfunc, cpSpatialInde
 /// Perform a static top down optimization of the tree.
 CP_EXPORT void cpBBTreeOptimize(cpSpatialIndex *index);
 
+/// Depth of the tree (0 when empty, or when @c index is not a tree).
+/// It walks the entire tree, so avoid calling it too often.
+CP_EXPORT int cpBBTreeGetDepth(cpSpatialIndex *index);
+
 /// Bounding box tree velocity callback function.
 /// This function should return an estimate for the object's velocity.
 typedef cpVect (*cpBBTreeVelocityFunc)(void *obj);
@@ -156,7 +156,7 @@ PairFromPool(cpBBTree *tree)
 		int count = CP_BUFFER_BYTES/sizeof(Pair);
 		cpAssertHard(count, "Internal Error: Buffer size is too small.");
 		
-		Pair *buffer = (Pair *)cpcalloc(1, CP_BUFFER_BYTES);
+		Pair *buffer = (Pair *)cpcallocCategory(1, CP_BUFFER_BYTES, CP_ALLOC_BBTREE);
 		cpArrayPush(tree->allocatedBuffers, buffer);
 		
 		// push all but the first one, return the first instead
@@ -245,7 +245,7 @@ NodeFromPool(cpBBTree *tree)
 		int count = CP_BUFFER_BYTES/sizeof(Node);
 		cpAssertHard(count, "Internal Error: Buffer size is too small.");
 		
-		Node *buffer = (Node *)cpcalloc(1, CP_BUFFER_BYTES);
+		Node *buffer = (Node *)cpcallocCategory(1, CP_BUFFER_BYTES, CP_ALLOC_BBTREE);
 		cpArrayPush(tree->allocatedBuffers, buffer);
 		
 		// push all but the first one, return the first instead
@@ -847,6 +847,23 @@ cpBBTreeOptimize(cpSpatialIndex *index)
 	cpfree(nodes);
 }
 
+static int
+SubtreeDepth(Node *node)
+{
+	if(NodeIsLeaf(node)) return 1;
+	
+	int a = SubtreeDepth(node->A);
+	int b = SubtreeDepth(node->B);
+	return 1 + (a > b ? a : b);
+}
+
+int
+cpBBTreeGetDepth(cpSpatialIndex *index)
+{
+	Node *root = GetRootIfTree(index);
+	return (root ? SubtreeDepth(root) : 0);
+}
+
 //MARK: Debug Draw
 
 //#define CP_BBTREE_DEBUG_DRAW
@@ -19,6 +19,8 @@
  * SOFTWARE.
  */
 
+#include <string.h>
+
 #include "chipmunk/chipmunk_private.h"
 
 //MARK: Post Step Callback Functions
@@ -121,7 +123,7 @@ typedef struct cpContactBuffer {
 static cpContactBufferHeader *
 cpSpaceAllocContactBuffer(cpSpace *space)
 {
-	cpContactBuffer *buffer = (cpContactBuffer *)cpcalloc(1, sizeof(cpContactBuffer));
+	cpContactBuffer *buffer = (cpContactBuffer *)cpcallocCategory(1, sizeof(cpContactBuffer), CP_ALLOC_CONTACTS);
 	cpArrayPush(space->allocatedBuffers, buffer);
 	return (cpContactBufferHeader *)buffer;
 }
@@ -192,7 +194,7 @@ cpSpaceArbiterSetTrans(cpShape **shapes, cpSpace *space)
 		int count = CP_BUFFER_BYTES/sizeof(cpArbiter);
 		cpAssertHard(count, "Internal Error: Buffer size too small.");
 		
-		cpArbiter *buffer = (cpArbiter *)cpcalloc(1, CP_BUFFER_BYTES);
+		cpArbiter *buffer = (cpArbiter *)cpcallocCategory(1, CP_BUFFER_BYTES, CP_ALLOC_ARBITERS);
 		cpArrayPush(space->allocatedBuffers, buffer);
 		
 		for(int i=0; i<count; i++) cpArrayPush(space->pooledArbiters, buffer + i);
@@ -332,6 +334,48 @@ cpShapeUpdateFunc(cpShape *shape, void *unused)
 	cpShapeCacheBB(shape);
 }
 
+void
+cpSpaceSetStepStats(cpSpace *space, cpSpaceStepStats *stats, cpSpaceStepClockFunc clock)
+{
+	cpAssertHard(!stats || clock, "A clock function is required to gather step statistics.");
+	
+	space->stepStats = stats;
+	space->stepClock = clock;
+	
+	if(stats) memset(stats, 0, sizeof(cpSpaceStepStats));
+}
+
+void
+cpSpaceSetStepPhaseFunc(cpSpace *space, cpSpaceStepPhaseFunc func, void *data)
+{
+	space->stepPhaseFunc = func;
+	space->stepPhaseData = data;
+}
+
+// Used instead of cpSpaceCollideShapes() when gathering statistics,
+// so the narrow-phase time can be told apart from the broad-phase time.
+static cpCollisionID
+cpSpaceCollideShapesStats(cpShape *a, cpShape *b, cpCollisionID id, cpSpace *space)
+{
+	cpSpaceStepStats *stats = space->stepStats;
+	double start = space->stepClock();
+	
+	id = cpSpaceCollideShapes(a, b, id, space);
+	
+	stats->narrowphase += space->stepClock() - start;
+	stats->pairCount++;
+	return id;
+}
+
+// Accumulates the time elapsed since the last call into the given field,
+// and reports the phase to the phase callback, if any.
+#define STEP_STATS_LAP(field) if(stats){ \
+	double now = clock(); \
+	stats->field += now - lap; \
+	if(space->stepPhaseFunc) space->stepPhaseFunc(#field, lap, now, space->stepPhaseData); \
+	lap = now; \
+}
+
 void
 cpSpaceStep(cpSpace *space, cpFloat dt)
 {
@@ -347,6 +391,18 @@ cpSpaceStep(cpSpace *space, cpFloat dt)
 	cpArray *constraints = space->constraints;
 	cpArray *arbiters = space->arbiters;
 	
+	cpSpaceStepStats *stats = space->stepStats;
+	cpSpaceStepClockFunc clock = space->stepClock;
+	double lap = 0.0;
+	if(stats){
+		// The static tree depth is only recomputed when static shapes are added/removed
+		int staticTreeDepth = stats->staticTreeDepth, staticShapeCount = stats->staticShapeCount;
+		memset(stats, 0, sizeof(cpSpaceStepStats));
+		stats->staticTreeDepth = staticTreeDepth;
+		stats->staticShapeCount = staticShapeCount;
+		lap = clock();
+	}
+	
 	// Reset and empty the arbiter lists.
 	for(int i=0; i<arbiters->num; i++){
 		cpArbiter *arb = (cpArbiter *)arbiters->arr[i];
@@ -365,19 +421,27 @@ cpSpaceStep(cpSpace *space, cpFloat dt)
 			cpBody *body = (cpBody *)bodies->arr[i];
 			body->position_func(body, dt);
 		}
+		STEP_STATS_LAP(integrate);
 		
 		// Find colliding pairs.
 		cpSpacePushFreshContactBuffer(space);
 		cpSpatialIndexEach(space->dynamicShapes, (cpSpatialIndexIteratorFunc)cpShapeUpdateFunc, NULL);
-		cpSpatialIndexReindexQuery(space->dynamicShapes, (cpSpatialIndexQueryFunc)cpSpaceCollideShapes, space);
+		STEP_STATS_LAP(shapeUpdate);
+		
+		cpSpatialIndexReindexQuery(space->dynamicShapes, (cpSpatialIndexQueryFunc)(stats ? cpSpaceCollideShapesStats : cpSpaceCollideShapes), space);
 	} cpSpaceUnlock(space, cpFalse);
+	STEP_STATS_LAP(broadphase);
+	// The narrow-phase ran inside the broad-phase query
+	if(stats) stats->broadphase -= stats->narrowphase;
 	
 	// Rebuild the contact graph (and detect sleeping components if sleeping is enabled)
 	cpSpaceProcessComponents(space, dt);
+	STEP_STATS_LAP(components);
 	
 	cpSpaceLock(space); {
 		// Clear out old cached arbiters and call separate callbacks
 		cpHashSetFilter(space->cachedArbiters, (cpHashSetFilterFunc)cpSpaceArbiterSetFilter, space);
+		STEP_STATS_LAP(arbiterFilter);
 
 		// Prestep the arbiters and constraints.
 		cpFloat slop = space->collisionSlop;
@@ -394,6 +458,7 @@ cpSpaceStep(cpSpace *space, cpFloat dt)
 			
 			constraint->klass->preStep(constraint, dt);
 		}
+		STEP_STATS_LAP(preStep);
 	
 		// Integrate velocities.
 		cpFloat damping = cpfpow(space->damping, dt);
@@ -402,6 +467,7 @@ cpSpaceStep(cpSpace *space, cpFloat dt)
 			cpBody *body = (cpBody *)bodies->arr[i];
 			body->velocity_func(body, gravity, damping, dt);
 		}
+		STEP_STATS_LAP(integrate);
 		
 		// Apply cached impulses
 		cpFloat dt_coef = (prev_dt == 0.0f ? 0.0f : dt/prev_dt);
@@ -413,6 +479,7 @@ cpSpaceStep(cpSpace *space, cpFloat dt)
 			cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
 			constraint->klass->applyCachedImpulse(constraint, dt_coef);
 		}
+		STEP_STATS_LAP(preStep);
 		
 		// Run the impulse solver.
 		for(int i=0; i<space->iterations; i++){
@@ -425,6 +492,7 @@ cpSpaceStep(cpSpace *space, cpFloat dt)
 				constraint->klass->applyImpulse(constraint, dt);
 			}
 		}
+		STEP_STATS_LAP(solver);
 		
 		// Run the constraint post-solve callbacks
 		for(int i=0; i<constraints->num; i++){
@@ -442,4 +510,24 @@ cpSpaceStep(cpSpace *space, cpFloat dt)
 			handler->postSolveFunc(arb, space, handler->userData);
 		}
 	} cpSpaceUnlock(space, cpTrue);
+	STEP_STATS_LAP(postStep);
+	
+	if(stats){
+		int contactCount = 0;
+		for(int i=0; i<arbiters->num; i++){
+			contactCount += ((cpArbiter *)arbiters->arr[i])->count;
+		}
+		
+		stats->arbiterCount = arbiters->num;
+		stats->contactCount = contactCount;
+		stats->dynamicTreeDepth = cpBBTreeGetDepth(space->dynamicShapes);
+		
+		int staticShapeCount = cpSpatialIndexCount(space->staticShapes);
+		if(stats->staticShapeCount != staticShapeCount){
+			stats->staticShapeCount = staticShapeCount;
+			stats->staticTreeDepth = cpBBTreeGetDepth(space->staticShapes);
+		}
+	}
 }
+
+#undef STEP_STATS_LAP
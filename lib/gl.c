@@ -24,7 +24,6 @@
 // https://github.com/carlosrafaelgn/pixel
 //
 
-#include <emscripten.h>
 #include <stdlib.h>
 #include "math_fix_sincos.h"
 #include <memory.h>
@@ -400,17 +399,38 @@ void drawScaleRotate(float* vertices, const GLModelCoordinates* modelCoordinates
 #endif
 }
 
+#ifdef __EMSCRIPTEN__
 // IntelliSense does not like this... :(
 EM_JS(void, call_drawNative, (int rectangleCount), { drawNative(rectangleCount) });
+#else
+static DrawNativeCallback drawNativeCallback;
+
+void setDrawNativeCallback(DrawNativeCallback callback) {
+	drawNativeCallback = callback;
+}
+
+static void call_drawNative(int rectangleCount) {
+	if (drawNativeCallback)
+		drawNativeCallback(rectangleCount);
+}
+#endif
+
+static void flushNative(int rectangleCount) {
+	profilerBegin(flush);
+	traceBegin(drawNative);
+	call_drawNative(rectangleCount);
+	traceEnd(drawNative, "render");
+	profilerEnd(flush, ProfilerMarkerFlush);
+}
 
 #define incrementSmallRectangleCount() rectangleCount++; vertices += FloatsPerRectangle
 
-#define flushRectangleCount() call_drawNative(rectangleCount); rectangleCount = 0; vertices = verticesOriginal
+#define flushRectangleCount() flushNative(rectangleCount); rectangleCount = 0; vertices = verticesOriginal
 
 #define incrementRectangleCount() if (rectangleCount >= RectangleCapacity) { flushRectangleCount(); } incrementSmallRectangleCount()
 
 LevelSpriteSheet* initLevelSpriteSheet() {
-	LevelSpriteSheet* levelSpriteSheet = (LevelSpriteSheet*)malloc(sizeof(LevelSpriteSheet));
+	LevelSpriteSheet* levelSpriteSheet = (LevelSpriteSheet*)allocateMemory(sizeof(LevelSpriteSheet), MemoryOther);
 	memset(levelSpriteSheet, 0, sizeof(LevelSpriteSheet));
 
 	levelSpriteSheet->backgroundSpeed[0] = -0.323448710595f;
@@ -449,6 +469,11 @@ LevelSpriteSheet* initLevelSpriteSheet() {
 }
 
 void renderBackground(float* vertices, Level* level, LevelSpriteSheet* levelSpriteSheet, float baseHeight, float time, int animate) {
+	// This is the first function called every frame
+	profilerFrame();
+	profilerBegin(background);
+	traceBegin(renderBackground);
+
 	float deltaMilliseconds = (animate ? (time - levelSpriteSheet->backgroundLastTime) : 0);
 	if (deltaMilliseconds > 20.0f)
 		deltaMilliseconds = 20.0f;
@@ -505,10 +530,18 @@ void renderBackground(float* vertices, Level* level, LevelSpriteSheet* levelSpri
 		}
 	}
 
-	call_drawNative(rectangleCount);
+	flushNative(rectangleCount);
+
+	traceEnd(renderBackground, "render");
+	profilerEnd(background, ProfilerMarkerBackground);
 }
 
 void renderCompactBackground(float* vertices, Level* level, LevelSpriteSheet* levelSpriteSheet, float time) {
+	// This is the first function called every frame
+	profilerFrame();
+	profilerBegin(background);
+	traceBegin(renderCompactBackground);
+
 	float deltaMilliseconds = time - levelSpriteSheet->backgroundLastTime;
 	if (deltaMilliseconds >= 33.0f)
 		deltaMilliseconds = 33.0f;
@@ -529,10 +562,16 @@ void renderCompactBackground(float* vertices, Level* level, LevelSpriteSheet* le
 		draw(vertices, &(levelSpriteSheet->fullViewModelCoordinates), level->explosionBgAlpha, &(levelSpriteSheet->explosionBgTextureCoordinates), 0, 0);
 	}
 
-	call_drawNative(rectangleCount);
+	flushNative(rectangleCount);
+
+	traceEnd(renderCompactBackground, "render");
+	profilerEnd(background, ProfilerMarkerBackground);
 }
 
 int render(float* vertices, Level* level, const LevelSpriteSheet* levelSpriteSheet, float scaleFactor) {
+	profilerBegin(render);
+	traceBegin(render);
+
 	const GLModelCoordinates* const levelObjectModelCoordinates = &(levelSpriteSheet->levelObjectModelCoordinates);
 	const GLTextureCoordinates* const levelObjectTextureCoordinatesByType = levelSpriteSheet->levelObjectTextureCoordinatesByType;
 	const int* const objectType = level->objectType;
@@ -676,7 +715,10 @@ int render(float* vertices, Level* level, const LevelSpriteSheet* levelSpriteShe
 		}
 	}
 
-	call_drawNative(rectangleCount);
+	flushNative(rectangleCount);
+
+	traceEnd(render, "render");
+	profilerEnd(render, ProfilerMarkerRender);
 
 	return finishedThisFrame;
 }
@@ -0,0 +1,245 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Carlos Rafael Gimenes das Neves
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// https://github.com/carlosrafaelgn/pixel
+//
+
+#include <stdlib.h>
+#include <memory.h>
+
+#include "shared.h"
+
+// Everything processImage() produces depends only on the binarized image, so
+// its results can be reused whenever the same drawing is processed again
+// (e.g., when a level is prepared right after being previewed). Each entry
+// keeps the polygon table and the final buffer, which is enough to repaint
+// the image and to find maxY again (the repainted pixels themselves are not
+// kept, as they would take 4 bytes per pixel of a heap with only a few MB).
+//
+// All entries live in a single block, allocated by setImageCacheCapacity(),
+// preferably before anything else, so that the cache never fragments the
+// heap (ImageInfo takes most of it). The entries are kept contiguous, and
+// evicting the least recently used one just moves the entries after it.
+
+#define alignImageCacheSize(SIZE) (((SIZE) + 15) & ~15)
+
+typedef struct ImageCacheEntryStruct {
+	uint64_t hash;
+	int size; // bytes taken by the entry, including this header
+	int width, height;
+	unsigned int lastUse;
+	int polygonCount, pointCount;
+	// Followed by firstPoint, points, startPixel, parent, hole, radius and the runs of
+	// the final buffer (refer to imageCacheStore())
+} ImageCacheEntry;
+
+typedef struct ImageCacheStruct {
+	unsigned char* memory;
+	int capacity, usedBytes;
+	unsigned int useCounter;
+} ImageCache;
+
+static ImageCache imageCache;
+
+void setImageCacheCapacity(int capacity) {
+	if (imageCache.memory)
+		freeMemory(imageCache.memory);
+
+	memset(&imageCache, 0, sizeof(ImageCache));
+
+	if (capacity <= 0)
+		return;
+
+	imageCache.memory = (unsigned char*)allocateMemory(capacity, MemoryImage);
+	if (imageCache.memory)
+		imageCache.capacity = capacity;
+}
+
+int imageCacheIsEnabled() {
+	return (imageCache.capacity > 0);
+}
+
+uint64_t hashImageBuffer(const unsigned char* buffer, int length) {
+	// Inspired by xxHash32: 4 independent 32-bit lanes consume 16 bytes per
+	// iteration (so the compiler can keep them all in one SIMD register), and
+	// they are combined and mixed into a 64-bit hash at the end.
+	#define hashPrime1 0x9E3779B1U
+	#define hashPrime2 0x85EBCA77U
+	#define hashPrime3 0xC2B2AE3DU
+	#define hashRotate(X, R) (((X) << (R)) | ((X) >> (32 - (R))))
+	uint32_t lanes[4] = { hashPrime1 + hashPrime2, hashPrime2, 0, 0U - hashPrime1 };
+	int i = 0;
+
+	for (; i <= length - 16; i += 16) {
+		uint32_t words[4];
+		memcpy(words, buffer + i, 16);
+		for (int l = 0; l < 4; l++) {
+			const uint32_t lane = lanes[l] + (words[l] * hashPrime2);
+			lanes[l] = hashRotate(lane, 13) * hashPrime1;
+		}
+	}
+
+	uint64_t hash = ((uint64_t)(hashRotate(lanes[0], 1) + hashRotate(lanes[1], 7)) << 32) |
+		(uint64_t)(hashRotate(lanes[2], 12) + hashRotate(lanes[3], 18));
+	hash ^= (uint64_t)length * hashPrime3;
+	for (; i < length; i++)
+		hash = (hash ^ buffer[i]) * 0x100000001B3ULL;
+
+	// Final avalanche (from SplitMix64)
+	hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+	return hash ^ (hash >> 31);
+	#undef hashPrime1
+	#undef hashPrime2
+	#undef hashPrime3
+	#undef hashRotate
+}
+
+// The final buffer is stored as runs of equal bytes: each run is its value,
+// followed by its length, 7 bits per byte (the highest bit is set in all
+// bytes but the last one)
+static int encodeBufferRuns(const unsigned char* buffer, int length, unsigned char* runs) {
+	int runBytes = 0;
+	for (int i = 0; i < length; ) {
+		const unsigned char value = buffer[i];
+		int runLength = 1;
+		while (i + runLength < length && buffer[i + runLength] == value)
+			runLength++;
+		i += runLength;
+
+		if (runs)
+			runs[runBytes] = value;
+		runBytes++;
+		while (runLength > 127) {
+			if (runs)
+				runs[runBytes] = (unsigned char)(0x80 | (runLength & 127));
+			runBytes++;
+			runLength >>= 7;
+		}
+		if (runs)
+			runs[runBytes] = (unsigned char)runLength;
+		runBytes++;
+	}
+	return runBytes;
+}
+
+static void decodeBufferRuns(const unsigned char* runs, unsigned char* buffer, int length) {
+	for (int i = 0; i < length; ) {
+		const unsigned char value = *(runs++);
+		int runLength = 0, shift = 0;
+		for (;;) {
+			const unsigned char b = *(runs++);
+			runLength |= (b & 127) << shift;
+			if (!(b & 0x80))
+				break;
+			shift += 7;
+		}
+		memset(buffer + i, value, runLength);
+		i += runLength;
+	}
+}
+
+#define entryAt(OFFSET) ((ImageCacheEntry*)(imageCache.memory + (OFFSET)))
+#define entryFirstPoint(ENTRY) ((int*)((unsigned char*)(ENTRY) + alignImageCacheSize((int)sizeof(ImageCacheEntry))))
+#define entryPoints(ENTRY) ((short*)(entryFirstPoint(ENTRY) + (ENTRY)->polygonCount + 1))
+#define entryStartPixel(ENTRY) ((int*)(entryPoints(ENTRY) + ((ENTRY)->pointCount << 1)))
+#define entryParent(ENTRY) (entryStartPixel(ENTRY) + (ENTRY)->polygonCount)
+#define entryHole(ENTRY) ((unsigned char*)(entryParent(ENTRY) + (ENTRY)->polygonCount))
+#define entryRadius(ENTRY) (entryHole(ENTRY) + (ENTRY)->polygonCount)
+#define entryRuns(ENTRY) (entryRadius(ENTRY) + (ENTRY)->pointCount)
+
+int imageCacheLoad(uint64_t hash, int width, int height, PolygonTable* polygonTable, unsigned char* buffer, int bufferLength) {
+	// Returns 1 and fills polygonTable and buffer when the image is found
+	for (int offset = 0; offset < imageCache.usedBytes; offset += entryAt(offset)->size) {
+		ImageCacheEntry* const entry = entryAt(offset);
+		if (entry->hash != hash || entry->width != width || entry->height != height)
+			continue;
+
+		const int polygonCount = entry->polygonCount, pointCount = entry->pointCount;
+		if (polygonCount > polygonTable->polygonCapacity || pointCount > polygonTable->pointCapacity)
+			return 0;
+
+		polygonTable->polygonCount = polygonCount;
+		polygonTable->pointCount = pointCount;
+		polygonTable->overflowed = 0;
+		polygonTable->keptPolygonCount = 0;
+		memcpy(polygonTable->firstPoint, entryFirstPoint(entry), (polygonCount + 1) * sizeof(int));
+		memcpy(polygonTable->points, entryPoints(entry), pointCount * 2 * sizeof(short));
+		memcpy(polygonTable->startPixel, entryStartPixel(entry), polygonCount * sizeof(int));
+		memcpy(polygonTable->parent, entryParent(entry), polygonCount * sizeof(int));
+		memcpy(polygonTable->hole, entryHole(entry), polygonCount);
+		memcpy(polygonTable->radius, entryRadius(entry), pointCount);
+		decodeBufferRuns(entryRuns(entry), buffer, bufferLength);
+
+		entry->lastUse = ++imageCache.useCounter;
+		return 1;
+	}
+
+	return 0;
+}
+
+void imageCacheStore(uint64_t hash, int width, int height, const PolygonTable* polygonTable, const unsigned char* buffer, int bufferLength) {
+	if (!imageCache.capacity || polygonTable->overflowed)
+		return;
+
+	const int polygonCount = polygonTable->polygonCount, pointCount = polygonTable->pointCount,
+		size = alignImageCacheSize(alignImageCacheSize((int)sizeof(ImageCacheEntry)) +
+			((polygonCount + 1) * (int)sizeof(int)) +
+			(pointCount * 2 * (int)sizeof(short)) +
+			(polygonCount * 2 * (int)sizeof(int)) +
+			polygonCount +
+			pointCount +
+			encodeBufferRuns(buffer, bufferLength, 0));
+
+	if (size > imageCache.capacity)
+		return;
+
+	// Evict the least recently used entries until the new one fits
+	while (imageCache.usedBytes + size > imageCache.capacity) {
+		int lruOffset = 0;
+		for (int offset = 0; offset < imageCache.usedBytes; offset += entryAt(offset)->size) {
+			if (entryAt(offset)->lastUse < entryAt(lruOffset)->lastUse)
+				lruOffset = offset;
+		}
+		const int lruSize = entryAt(lruOffset)->size;
+		memmove(imageCache.memory + lruOffset, imageCache.memory + lruOffset + lruSize, imageCache.usedBytes - lruOffset - lruSize);
+		imageCache.usedBytes -= lruSize;
+	}
+
+	ImageCacheEntry* const entry = entryAt(imageCache.usedBytes);
+	entry->hash = hash;
+	entry->size = size;
+	entry->width = width;
+	entry->height = height;
+	entry->lastUse = ++imageCache.useCounter;
+	entry->polygonCount = polygonCount;
+	entry->pointCount = pointCount;
+	memcpy(entryFirstPoint(entry), polygonTable->firstPoint, (polygonCount + 1) * sizeof(int));
+	memcpy(entryPoints(entry), polygonTable->points, pointCount * 2 * sizeof(short));
+	memcpy(entryStartPixel(entry), polygonTable->startPixel, polygonCount * sizeof(int));
+	memcpy(entryParent(entry), polygonTable->parent, polygonCount * sizeof(int));
+	memcpy(entryHole(entry), polygonTable->hole, polygonCount);
+	memcpy(entryRadius(entry), polygonTable->radius, pointCount);
+	encodeBufferRuns(buffer, bufferLength, entryRuns(entry));
+	imageCache.usedBytes += size;
+}
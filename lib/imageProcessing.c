@@ -24,406 +24,669 @@
 // https://github.com/carlosrafaelgn/pixel
 //
 
-#include <emscripten.h>
 #include <stdlib.h>
 #include "math_fix_sincos.h"
 #include <memory.h>
 
 #include "shared.h"
-
-// Must be in sync with scripts/image/imageProcessing.ts
-#define maxPixelCount ((baseWidth + 2) * (maxHeight + 2)) // + 2 because we are creating a 1-pixel border around the original image
-#define maxPointCount (maxPixelCount >> 1)
-
-#define maxInputPixelCount (baseWidth * maxHeight)
-#define maxRevisited (baseWidth + maxHeight)
-#define maxStackSize maxPixelCount
-
+#include <chipmunk/cpMarch.h>
+#include <chipmunk/cpPolyline.h>
+
+// binarizeRow() and repaintRow() process 16 pixels per iteration when SIMD is
+// available (emcc only defines __wasm_simd128__ when -msimd128 is given)
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define simdEnabled 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define simdEnabled 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define simdEnabled 1
+#else
+#define simdEnabled 0
+#endif
+
+// Each array inside ImageInfo starts at a multiple of 16 bytes
+#define alignImageInfoSize(SIZE) (((SIZE) + 15) & ~((size_t)15))
+#define largerImageInfoSize(A, B) (((A) > (B)) ? (A) : (B))
+
+// Values written to buffer by labelComponents(), at the topmost/leftmost
+// pixel of each component (refer to processImage())
+#define ComponentStart 4
+#define SmallComponentStart 5
+
+// Border labels (refer to followBorder()): the lower 15 bits hold the border
+// number, and the highest bit is set when the pixel to the right of the
+// border pixel is a 0-pixel that has been examined while following the border
+#define BorderRightExamined 0x8000
+#define BorderNumberMask 0x7FFF
+// Border 0 is the frame around the image, which is treated as a hole
+#define maxBorderCount(PIXEL_COUNT) ((((PIXEL_COUNT) >> 3) + 2) < (BorderNumberMask + 1) ? (((PIXEL_COUNT) >> 3) + 2) : (BorderNumberMask + 1))
+// Holes whose borders have this many pixels or fewer (such as a 1-pixel hole)
+// cannot contain anything, so they are ignored, and only the pixels of borders
+// this short are ever needed once the border has been followed
+#define SmallHoleBorderLength 8
+// Processing a larger region would not be any faster than processing the
+// entire image again (refer to processImageRegion())
+#define maxImageRegionArea(WIDTH, HEIGHT) (((WIDTH) * (HEIGHT)) >> 2)
+
+// Must be in sync with headless/headless.h
 typedef struct PointStructure {
-	int x, y;
+	short x, y;
 } Point;
 
+// All arrays are carved from the same allocation, right after the structure,
+// and they are sized according to the actual image (refer to allocateImageInfo())
 typedef struct ImageInfoStructure {
+	size_t size; // bytes taken by the entire allocation (refer to resizeImageInfo())
 	int width;
 	int height;
-	Point points[maxPointCount];
-	int stack[maxStackSize];
-	unsigned char data[maxInputPixelCount << 2]; // r g b a r g b a r g b a...
-	unsigned char buffer[maxPixelCount];
+	int pixelCount;
+	int threadCount; // refer to setImageInfoThreadCount()
+	int centerlines; // refer to setImageInfoCenterlines()
+	ImageProcessingStats stats;
+	// labels holds pixelCount ints, used as parent and area by labelComponents(),
+	// and later reused as points and borderLabels, while tracing the components
+	// (before that, erase1() and processImageRegion() use it as mask)
+	int* labels;
+	Point* points; // pixelCount >> 1 points
+	unsigned short* borderLabels; // pixelCount labels (refer to followBorder())
+	// stack holds at least pixelCount ints, but trace4() only needs the first
+	// SmallHoleBorderLength + (pixelCount >> 1) of them, so borders takes the
+	// end of stack while the components are traced (rebuildHierarchy(), which
+	// needs the entire stack, keeps its borders in points, instead)
+	int* stack;
+	int* borders; // maxBorderCount(pixelCount) * 2 ints (refer to newBorder())
+	unsigned char* data; // r g b a r g b a r g b a...
+	unsigned char* buffer; // pixelCount bytes
+	// Large enough for the bounding box of a region of maxImageRegionArea()
+	// pixels, with a 1-pixel border around it (used only by processImageRegion())
+	unsigned char* regionBuffer;
+	// buffer packed as 1 bit per pixel (used only by erase1() and by
+	// processImageRegion(), before labels is needed)
+	uint64_t* mask;
+	unsigned char* maskRowDirty;
 } ImageInfo;
 
-// IntelliSense does not like this... :(
-EM_JS(void, call_createPolygon, (int pointCount), { createPolygon(pointCount) });
+#if profileImageProcessing
+#define profileStart(NAME) const double NAME = getTimeMilliseconds()
+#define profileEnd(NAME, STATS, FIELD) (STATS)->FIELD += getTimeMilliseconds() - NAME
+#define profileCount(STATS, FIELD, COUNT) (STATS)->FIELD += (COUNT)
+#else
+#define profileStart(NAME)
+#define profileEnd(NAME, STATS, FIELD)
+#define profileCount(STATS, FIELD, COUNT)
+#endif
+
+static size_t layoutImageInfo(ImageInfo* imageInfo, int width, int height) {
+	// Returns how many bytes an ImageInfo for a width x height image takes,
+	// and, when imageInfo is not null, carves all arrays from the memory
+	// right after it (which must be at least that large)
+	// + 2 because we are creating a 1-pixel border around the original image
+	const int pixelCount = (width + 2) * (height + 2),
+		bordersCount = maxBorderCount(pixelCount) << 1,
+		stackCount = largerImageInfoSize(pixelCount, SmallHoleBorderLength + (pixelCount >> 1) + bordersCount);
+	const size_t headerSize = alignImageInfoSize(sizeof(ImageInfo)),
+		maskSize = alignImageInfoSize((size_t)(((width + 2 + 63) >> 6) * (height + 2)) * sizeof(uint64_t)),
+		maskRowDirtySize = alignImageInfoSize((size_t)(height + 2)),
+		pointsSize = alignImageInfoSize(largerImageInfoSize((size_t)(pixelCount >> 1) * sizeof(Point), (size_t)(SmallHoleBorderLength + bordersCount) * sizeof(int))),
+		borderLabelsSize = alignImageInfoSize((size_t)pixelCount * sizeof(unsigned short)),
+		labelsSize = largerImageInfoSize(largerImageInfoSize(pointsSize + borderLabelsSize, alignImageInfoSize((size_t)pixelCount * sizeof(int))), maskSize + maskRowDirtySize),
+		stackSize = alignImageInfoSize((size_t)stackCount * sizeof(int)),
+		dataSize = alignImageInfoSize(((size_t)width * (size_t)height) << 2),
+		bufferSize = alignImageInfoSize((size_t)pixelCount),
+		regionBufferSize = alignImageInfoSize((size_t)(maxImageRegionArea(width, height) + ((width + height) << 1) + 4));
+
+	if (imageInfo) {
+		unsigned char* const memory = (unsigned char*)imageInfo;
+		imageInfo->width = width;
+		imageInfo->height = height;
+		imageInfo->pixelCount = pixelCount;
+		imageInfo->labels = (int*)(memory + headerSize);
+		imageInfo->points = (Point*)imageInfo->labels;
+		imageInfo->borderLabels = (unsigned short*)((unsigned char*)imageInfo->labels + pointsSize);
+		imageInfo->mask = (uint64_t*)imageInfo->labels;
+		imageInfo->maskRowDirty = (unsigned char*)imageInfo->mask + maskSize;
+		imageInfo->stack = (int*)((unsigned char*)imageInfo->labels + labelsSize);
+		imageInfo->borders = imageInfo->stack + stackCount - bordersCount;
+		imageInfo->data = (unsigned char*)imageInfo->stack + stackSize;
+		imageInfo->buffer = imageInfo->data + dataSize;
+		imageInfo->regionBuffer = imageInfo->buffer + bufferSize;
+	}
+
+	return headerSize + labelsSize + stackSize + dataSize + bufferSize + regionBufferSize;
+}
 
 ImageInfo* allocateImageInfo(int width, int height) {
-	ImageInfo* const imageInfo = (ImageInfo*)malloc(sizeof(ImageInfo));
-	imageInfo->width = width;
-	imageInfo->height = height;
+	const size_t size = layoutImageInfo(0, width, height);
+	unsigned char* const memory = (unsigned char*)allocateMemory(size, MemoryImage);
+	if (!memory)
+		return 0;
+
+	ImageInfo* const imageInfo = (ImageInfo*)memory;
+	imageInfo->size = size;
+	imageInfo->threadCount = 1;
+	imageInfo->centerlines = 0;
+	layoutImageInfo(imageInfo, width, height);
 	return imageInfo;
 }
 
+static int resizeImageInfo(ImageInfo* imageInfo, int width, int height) {
+	// Reuses the memory of imageInfo for an image with a different size, as
+	// long as it fits (the results of the previous call to processImage() are
+	// lost). Returns 0, leaving imageInfo untouched, when it does not fit.
+	if (layoutImageInfo(0, width, height) > imageInfo->size)
+		return 0;
+
+	layoutImageInfo(imageInfo, width, height);
+	return 1;
+}
+
 unsigned char* getImageInfoData(ImageInfo* imageInfo) {
 	return imageInfo->data;
 }
 
-Point* getImageInfoPoints(ImageInfo* imageInfo) {
-	return imageInfo->points;
+unsigned char* getImageInfoBuffer(ImageInfo* imageInfo) {
+	// Used by the editor to keep the results of processImage() between calls
+	// to processImageRegion(), without having to keep the entire ImageInfo
+	return imageInfo->buffer;
+}
+
+void setImageInfoThreadCount(ImageInfo* imageInfo, int threadCount) {
+	// When threadCount > 1, the image is split into horizontal bands, which are
+	// binarized, eroded (erase1()) and labelled concurrently, before the seams
+	// between them are stitched together. The components are still traced by
+	// the calling thread, in raster order, so the polygons are exactly the same.
+	imageInfo->threadCount = ((threadCount < 1) ? 1 : ((threadCount > maxThreadPoolThreadCount) ? maxThreadPoolThreadCount : threadCount));
+}
+
+void setImageInfoCenterlines(ImageInfo* imageInfo, int centerlines) {
+	// When enabled, components that look like brush strokes are turned into
+	// centerlines (open polylines with a radius, refer to extractCenterlines()),
+	// instead of closed polygons that go around both sides of each stroke.
+	// Holes inside those components are dropped, as the strokes around them
+	// already become walls as thick as themselves.
+	imageInfo->centerlines = (centerlines ? 1 : 0);
+}
+
+ImageProcessingStats* getImageInfoStats(ImageInfo* imageInfo) {
+	return &(imageInfo->stats);
 }
 
 void freeImageInfo(ImageInfo* imageInfo) {
 	if (imageInfo)
-		free(imageInfo);
+		freeMemory(imageInfo);
+}
+
+PolygonTable* allocatePolygonTable(int polygonCapacity, int pointCapacity) {
+	// Just like ImageInfo, all arrays are carved from the same allocation
+	const size_t headerSize = alignImageInfoSize(sizeof(PolygonTable)),
+		firstPointSize = alignImageInfoSize((size_t)(polygonCapacity + 1) * sizeof(int)),
+		pointsSize = alignImageInfoSize((size_t)pointCapacity * 2 * sizeof(short)),
+		startPixelSize = alignImageInfoSize((size_t)polygonCapacity * sizeof(int)),
+		parentSize = alignImageInfoSize((size_t)polygonCapacity * sizeof(int)),
+		holeSize = alignImageInfoSize((size_t)polygonCapacity * sizeof(unsigned char)),
+		radiusSize = alignImageInfoSize((size_t)pointCapacity * sizeof(unsigned char));
+
+	unsigned char* const memory = (unsigned char*)allocateMemory(headerSize + firstPointSize + pointsSize + startPixelSize + parentSize + holeSize + radiusSize, MemoryImage);
+	if (!memory)
+		return 0;
+
+	PolygonTable* const polygonTable = (PolygonTable*)memory;
+	polygonTable->polygonCapacity = polygonCapacity;
+	polygonTable->pointCapacity = pointCapacity;
+	polygonTable->firstPoint = (int*)(memory + headerSize);
+	polygonTable->points = (short*)((unsigned char*)polygonTable->firstPoint + firstPointSize);
+	polygonTable->startPixel = (int*)((unsigned char*)polygonTable->points + pointsSize);
+	polygonTable->parent = (int*)((unsigned char*)polygonTable->startPixel + startPixelSize);
+	polygonTable->hole = (unsigned char*)polygonTable->parent + parentSize;
+	polygonTable->radius = polygonTable->hole + holeSize;
+	clearPolygonTable(polygonTable);
+	return polygonTable;
+}
+
+void clearPolygonTable(PolygonTable* polygonTable) {
+	polygonTable->polygonCount = 0;
+	polygonTable->pointCount = 0;
+	polygonTable->overflowed = 0;
+	polygonTable->keptPolygonCount = 0;
+	polygonTable->firstPoint[0] = 0;
+}
+
+void freePolygonTable(PolygonTable* polygonTable) {
+	if (polygonTable)
+		freeMemory(polygonTable);
 }
 
-int floodFill(int w, int h, unsigned char* buffer, int bufferStride, unsigned char from, unsigned char to, int* stack) {
+int floodFill(int w, unsigned char* buffer, int bufferStride, unsigned char from, unsigned char to, int* stack) {
+	// Instead of pushing every pixel, we push only one pixel per run of
+	// from-pixels (the seed of the run). A seed is painted as soon as it is
+	// pushed, which means it will not be pushed again, and which also stops
+	// the expansion of any other seed that might have been pushed for the
+	// same run (each pixel is counted only once). The caller must have
+	// already painted stack[0]. The 1-pixel border around the image is never
+	// a from-pixel, so it is what stops the runs from going above the first
+	// row, or below the last one.
 	int stackSize = 1, area = 1;
 
 	while (stackSize) {
 		const int stackI = stack[--stackSize];
 
-		// Check above
-		int i = stackI - bufferStride;
-		if (buffer[i] == from) {
-			buffer[i] = to;
+		// Go all the way to the left and to the right, to find the run
+		int left = stackI, right = stackI;
+		const int x = stackI % bufferStride;
+		for (int lx = x - 1; lx >= 1 && buffer[left - 1] == from; lx--) {
+			left--;
+			buffer[left] = to;
 			area++;
-			stack[stackSize++] = i;
 		}
-
-		// Check below
-		i = stackI + bufferStride;
-		if (buffer[i] == from) {
-			buffer[i] = to;
+		for (int rx = x + 1; rx <= w && buffer[right + 1] == from; rx++) {
+			right++;
+			buffer[right] = to;
 			area++;
-			stack[stackSize++] = i;
 		}
 
-		// Go all the way to the left, checking above and below the current pixel
-		i = stackI - 1;
-		int x = i % bufferStride;
-		while (x >= 1 && buffer[i] == from) {
-			buffer[i] = to;
-			area++;
-
-			const int oldI = i;
-
-			// Check above
-			i = oldI - bufferStride;
-			if (buffer[i] == from) {
-				buffer[i] = to;
-				area++;
-				stack[stackSize++] = i;
-			}
-
-			// Check below
-			i = oldI + bufferStride;
-			if (buffer[i] == from) {
-				buffer[i] = to;
-				area++;
-				stack[stackSize++] = i;
-			}
-
-			i = oldI - 1;
-			x--;
-		}
-
-		// We should check the diagonals if trace considered all 8 neighbors
-		//if (x > 1) {
-		//	const int oldI = i;
-		//
-		//	// Check above
-		//	i = oldI - bufferStride;
-		//	if (buffer[i] == from) {
-		//		buffer[i] = to;
-		//		area++;
-		//		stack[stackSize++] = i;
-		//	}
-		//
-		//	// Check below
-		//	i = oldI + bufferStride;
-		//	if (buffer[i] == from) {
-		//		buffer[i] = to;
-		//		area++;
-		//		stack[stackSize++] = i;
-		//	}
-		//}
-
-		// Go all the way to the right, checking above and below the current pixel
-		i = stackI + 1;
-		x = i % bufferStride;
-		while (x <= w && buffer[i] == from) {
-			buffer[i] = to;
-			area++;
-
-			const int oldI = i;
-
-			// Check above
-			i = oldI - bufferStride;
-			if (buffer[i] == from) {
-				buffer[i] = to;
-				area++;
-				stack[stackSize++] = i;
-			}
-
-			// Check below
-			i = oldI + bufferStride;
-			if (buffer[i] == from) {
-				buffer[i] = to;
-				area++;
-				stack[stackSize++] = i;
+		// Push one seed for each run found above and below [left, right]
+		for (int n = -bufferStride; n <= bufferStride; n += (bufferStride << 1)) {
+			int inRun = 0;
+			for (int i = left + n; i <= right + n; i++) {
+				if (buffer[i] == from) {
+					if (!inRun) {
+						inRun = 1;
+						buffer[i] = to;
+						area++;
+						stack[stackSize++] = i;
+					}
+				} else {
+					inRun = 0;
+				}
 			}
+		}
 
-			i = oldI + 1;
-			x++;
-		}
-
-		// We should check the diagonals if trace considered all 8 neighbors
-		//if (x < w) {
-		//	const int oldI = i;
-		//
-		//	// Check above
-		//	i = oldI - bufferStride;
-		//	if (buffer[i] == from) {
-		//		buffer[i] = to;
-		//		area++;
-		//		stack[stackSize++] = i;
-		//	}
-		//
-		//	// Check below
-		//	i = oldI + bufferStride;
-		//	if (buffer[i] == from) {
-		//		buffer[i] = to;
-		//		area++;
-		//		stack[stackSize++] = i;
-		//	}
-		//}
+		// We should also check (left - 1) and (right + 1) above and
+		// below if trace considered all 8 neighbors
 	}
 
 	return area;
 }
 
-double perpendicularDistance(int x, int y, int x1, int y1, int x2, int y2) {
-	// https://stackoverflow.com/a/6853926/3569421
-	const int A = x - x1;
-	const int B = y - y1;
-	const int C = x2 - x1;
-	const int D = y2 - y1;
-
-	const double dot = (double)(A * C + B * D);
-	const double len_sq = (double)(C * C + D * D);
-	double param = -1;
-	if (len_sq)
-		param = dot / len_sq;
-
-	double xx, yy;
-
-	if (param < 0) {
-		xx = x1;
-		yy = y1;
-	} else if (param > 1) {
-		xx = x2;
-		yy = y2;
-	} else {
-		xx = x1 + (param * C);
-		yy = y1 + (param * D);
+int findComponentRoot(int* parent, int run) {
+	while (parent[run] != run) {
+		parent[run] = parent[parent[run]];
+		run = parent[run];
 	}
+	return run;
+}
 
-	const double dx = x - xx;
-	const double dy = y - yy;
+static int skipZeroPixels(const unsigned char* buffer, int i, int end) {
+	// Skip 8 0-pixels at a time (most of buffer is usually empty)
+	uint64_t pixels;
+	for (; i + 8 <= end; i += 8) {
+		memcpy(&pixels, buffer + i, sizeof(pixels));
+		if (pixels)
+			break;
+	}
+	while (i < end && !buffer[i])
+		i++;
+	return i;
+}
 
-	return sqrt(dx * dx + dy * dy);
+static void unionComponents(int* parent, int* area, int a, int b) {
+	// The smallest run, which is also the first one in raster order, is always the root
+	const int rootA = findComponentRoot(parent, a), rootB = findComponentRoot(parent, b);
+	if (rootA < rootB) {
+		parent[rootB] = rootA;
+		area[rootA] += area[rootB];
+	} else if (rootA > rootB) {
+		parent[rootA] = rootB;
+		area[rootB] += area[rootA];
+	}
 }
 
-int douglasPeucker(Point* pointList, int start, int end, double epsilon) {
-	if ((end - start) <= 1)
-		return (end - start) + 1;
+static int unionRunWithRunsAbove(const int* runs, int* parent, int* area, int bufferStride, int run, int previousRun, int previousRowEndRun) {
+	const int runStart = runs[run << 1], runEnd = runs[(run << 1) + 1];
+
+	// Skip the runs above that end before this one starts (they cannot
+	// touch any run after this one either)
+	while (previousRun < previousRowEndRun && runs[(previousRun << 1) + 1] <= runStart - bufferStride)
+		previousRun++;
 
-	const int pStartX = pointList[start].x,
-		pStartY = pointList[start].y,
-		pEndX = pointList[end].x,
-		pEndY = pointList[end].y;
+	for (int above = previousRun; above < previousRowEndRun && runs[above << 1] < runEnd - bufferStride; above++)
+		unionComponents(parent, area, above, run);
 
-	double maxD = 0;
-	int maxDIndex = start;
+	return previousRun;
+}
 
-	for (int i = start + 1; i < end; i++) {
-		const Point p = pointList[i];
-		const double d = perpendicularDistance(p.x, p.y, pStartX, pStartY, pEndX, pEndY);
-		if (d > maxD) {
-			maxDIndex = i;
-			maxD = d;
+static int labelRows(int w, int y0, int y1, const unsigned char* buffer, int bufferStride, int* runs, int* parent, int* area, int firstRun, int* lastRowFirstRun) {
+	// First pass of labelComponents(), over rows y0 through y1 only, numbering
+	// the runs from firstRun onwards (returns the number after the last run)
+	int runCount = firstRun, previousRowFirstRun = firstRun, previousRowEndRun = firstRun;
+
+	for (int y = y0; y <= y1; y++) {
+		const int rowEnd = (y * bufferStride) + w + 1;
+		int previousRun = previousRowFirstRun;
+		previousRowFirstRun = runCount;
+		for (int i = skipZeroPixels(buffer, rowEnd - w, rowEnd); i < rowEnd; i = skipZeroPixels(buffer, i, rowEnd)) {
+			const int run = runCount++, runStart = i;
+			// There is always a 0-pixel at the right border
+			i = (int)((const unsigned char*)memchr(buffer + i, 0, rowEnd + 1 - i) - buffer);
+			runs[run << 1] = runStart;
+			runs[(run << 1) + 1] = i;
+			parent[run] = run;
+			area[run] = i - runStart;
+
+			previousRun = unionRunWithRunsAbove(runs, parent, area, bufferStride, run, previousRun, previousRowEndRun);
 		}
+		previousRowEndRun = runCount;
 	}
 
-	if (maxD > epsilon) {
-		const Point tmp = pointList[maxDIndex];
-		// -1 to ignore the last point returned (pointList[maxDIndex]),
-		// which is also returned by the second call
-		const int size1 = douglasPeucker(pointList, start, maxDIndex, epsilon) - 1;
-		pointList[maxDIndex] = tmp;
-		const int size2 = douglasPeucker(pointList, maxDIndex, end, epsilon);
-
-		memcpy(pointList + (start + size1), pointList + maxDIndex, sizeof(Point) * size2);
+	*lastRowFirstRun = previousRowFirstRun;
+	return runCount;
+}
 
-		return size1 + size2;
+static void paintComponents(unsigned char* buffer, const int* runs, int* parent, int* area, int firstRun, int endRun) {
+	// Second pass of labelComponents(), which must visit all runs in raster order
+	for (int run = firstRun; run < endRun; run++) {
+		const int runStart = runs[run << 1], runEnd = runs[(run << 1) + 1],
+			root = findComponentRoot(parent, run), rootArea = area[root];
+		if (rootArea > 0) {
+			area[root] = -rootArea;
+			// We are only considering polygons with more than 10 pixels
+			if (rootArea > 10) {
+				buffer[runStart] = ComponentStart;
+				memset(buffer + runStart + 1, 2, runEnd - runStart - 1);
+			} else {
+				buffer[runStart] = SmallComponentStart;
+			}
+		} else if (rootArea < -10) {
+			memset(buffer + runStart, 2, runEnd - runStart);
+		}
 	}
+}
 
-	pointList[start + 1] = pointList[end];
+void labelComponents(int w, int h, unsigned char* buffer, int bufferStride, int* runs, int* parent) {
+	// Two-pass union-find labelling of the 4-connected components of 1-pixels,
+	// where the elements of the sets are the runs of 1-pixels of each row,
+	// rather than the pixels themselves.
+	//
+	// A run always ends before a 0-pixel, so there are at most ((w + 1) >> 1) * h
+	// runs, which means runs (start and end of each run) and parent + area fit
+	// in the (w + 2) * (h + 2) ints provided by the caller.
+	//
+	// First pass: find all runs, merging the sets of the runs that touch each
+	// other in two consecutive rows.
+	//
+	// Second pass: the first run of each set contains its topmost/leftmost pixel
+	// (the area of the root is negated to mark the set as found). The components
+	// that will be traced are turned into 2-pixels, while the small ones are
+	// kept as 1-pixels, so that all neighbors look exactly the same to trace4()
+	// as they did when each component was flood filled only after being found.
+	int* const area = parent + ((bufferStride * (h + 2)) >> 1);
+	int lastRowFirstRun;
+
+	paintComponents(buffer, runs, parent, area, 0, labelRows(w, 1, h, buffer, bufferStride, runs, parent, area, 0, &lastRowFirstRun));
+}
 
-	return 2;
+static double scaledSquaredDistance(Point p, double x1, double y1, double x2, double y2, double C, double D, double lenSq, double scale) {
+	// Squared distance from p to the segment (x1, y1) - (x2, y2), multiplied
+	// by the squared length of the segment, so that no division or sqrt() is
+	// needed (all the values involved are integers below 2^53, so they are
+	// exact, and all points of a segment can be compared among themselves).
+	// https://stackoverflow.com/a/6853926/3569421
+	// All three candidates are computed beforehand, so that the selection can
+	// be performed without branches.
+	const double A = p.x - x1, B = p.y - y1, E = p.x - x2, F = p.y - y2,
+		dot = (A * C) + (B * D), cross = (A * D) - (B * C),
+		startSq = ((A * A) + (B * B)) * scale,
+		endSq = ((E * E) + (F * F)) * scale,
+		crossSq = cross * cross;
+	return ((dot <= 0) ? startSq : ((dot >= lenSq) ? endSq : crossSq));
 }
 
-int isNewEdgePixel4(int i, unsigned char* buffer, const int* cwNeighborOffsets8) {
-	if (buffer[i] == 2) {
-		for (int j = 7; j >= 0; j--) {
-			if (!buffer[i + cwNeighborOffsets8[j]])
-				return 1;
+int douglasPeucker(Point* points, int pointCount, double epsilon, int* segmentEnds) {
+	// Instead of recursing and compacting points after each split, the
+	// segments still to be checked are kept in an explicit stack (only their
+	// ends are stored, as a segment always starts where the previous one
+	// ended). Segments are finished from left to right, so their ends are
+	// exactly the points to be kept, in order, and each one of them is moved
+	// to its final position only once. The first and the last points are
+	// always kept.
+	//
+	// segmentEnds must have room for pointCount ints.
+	if (pointCount <= 2)
+		return pointCount;
+
+	const double epsilonSq = epsilon * epsilon;
+	int stackSize = 1, start = 0, keptCount = 1;
+
+	segmentEnds[0] = pointCount - 1;
+
+	while (stackSize) {
+		const int end = segmentEnds[stackSize - 1];
+		if (end - start > 1) {
+			const double x1 = points[start].x, y1 = points[start].y,
+				x2 = points[end].x, y2 = points[end].y,
+				C = x2 - x1, D = y2 - y1,
+				lenSq = (C * C) + (D * D),
+				scale = (lenSq ? lenSq : 1);
+
+			// Find the maximum distance first (this loop is branch-free, and
+			// carries nothing but max from one iteration to the next, so it can
+			// be vectorized when NaNs are ruled out, e.g., -ffast-math), and
+			// then, only if that point must be kept, find its index (the first
+			// one, if there are many points at the same distance).
+			double maxD = 0;
+			for (int i = start + 1; i < end; i++) {
+				const double d = scaledSquaredDistance(points[i], x1, y1, x2, y2, C, D, lenSq, scale);
+				maxD = ((d > maxD) ? d : maxD);
+			}
+
+			if (maxD > epsilonSq * scale) {
+				int maxDIndex = start + 1;
+				while (scaledSquaredDistance(points[maxDIndex], x1, y1, x2, y2, C, D, lenSq, scale) != maxD)
+					maxDIndex++;
+				segmentEnds[stackSize++] = maxDIndex;
+				continue;
+			}
 		}
+
+		// [start, end] cannot be simplified any further (no points after end
+		// have been moved, and keptCount <= end)
+		points[keptCount++] = points[end];
+		start = end;
+		stackSize--;
 	}
-	return 0;
+
+	return keptCount;
 }
 
-void trace4(int initialI, int cwDir, const int* cwNeighborOffsets4, const int* cwNeighborOffsets8, unsigned char* buffer, int bufferStride, int* stack, Point* points, int* outPointCount, int* outStackSize) {
-	// cwNeighborOffsets4 contains the offsets from i to each one of its 4 neighbors,
-	// in clockwise direction, starting from the top.
+int followBorder(int initialI, int hole, const int* cwNeighborOffsets4, unsigned char* buffer, int bufferStride, unsigned short* borderLabels, int border, int* path, int pathCapacity, Point* corners, int cornerCapacity, int* outCornerCount) {
+	// Border following from Suzuki and Abe, "Topological Structural Analysis of
+	// Digitized Binary Images by Border Following" (1985), using 4-connectivity
+	// for 1-pixels and 8-connectivity for 0-pixels (in other words, every pixel
+	// with a 0-pixel among its 8 neighbors is a border pixel, but the border
+	// only moves between 4-neighbors). cwNeighborOffsets4 contains the offsets
+	// from i to each one of its 4 neighbors, in clockwise direction, starting
+	// from the top.
 	//   0
 	// 3 i 1
 	//   2
 	//
-	// As the tracer moves along the line, the concept of front/rear/left/right will
-	// vary according to the direction used to enter the pixel.
+	// Since 0-pixels are 8-connected, two holes that touch each other only
+	// diagonally are a single hole, with a single border. Also, the pixels of a
+	// hole's border (which trace4() marks as 3, and which repaintImage() uses)
+	// are not always the ones a tracer that treats 0-pixels as 4-connected
+	// would find, so some hole outlines, and some repainted pixels, are one
+	// pixel away from where such a tracer would put them.
 	//
-	// For example, when going from A to B, front is 1, left is 0, right is 2 and so on.
-	// But, when going from Y to X, front is 3, left is 2, right is 0 and so on.
+	// An outer border starts at the topmost/leftmost pixel of its component,
+	// whose left neighbor is a 0-pixel, and a hole border starts at the pixel
+	// to the left of the topmost/leftmost 0-pixel of the hole.
 	//
-	// 0 0 0 0 ...
-	// 0 A B C ...
-	// 0 X Y Z ...
-	// 0 0 0 0 ...
+	// Every pixel of the border is labelled, and the border never gets lost,
+	// as it always takes the first 1-pixel found in counterclockwise direction,
+	// starting from where it came from. Each pixel can be entered at most once
+	// from each one of its 4 neighbors, so the time spent is O(length of the
+	// border).
 	//
-	// Given that the initial scan that brought us here started from the topmost/leftmost
-	// pixel (0, 0), and it goes all the way to end of the line (right) before going down
-	// to the next line, when cwDir is 1 (we are tracing the outer boundary of a polygon),
-	// we assume an initial direction of 1, and we scan the neighbors in CW direction.
-	// When cwDir is -1 (we are tracing the inner boundary of a polygon), we also assume
-	// an initial direction of 1, but we scan the neighbors in CCW direction.
+	// The pixels of the border are stored in path, in order, until pathCapacity
+	// is reached (the border is always followed until the end, so that all of its
+	// pixels are labelled). Returns the length of the border (which can be larger
+	// than pathCapacity, and which can contain the same pixel more than once).
 	//
-	// Several optimizations/assumptions could be made here, because we do not need to
-	// handle 1-pixel areas, just the X's below, because they were erased on beforehand.
-	// 
-	// 0 0 0 0 0 0 ...
-	// 0 A A 0 0 A ...
-	// 0 A A X X A ...
-	// 0 A A 0 0 A ...
-	// 0 0 0 0 0 0 ...
+	// When corners is not null, the border is being traced (refer to trace4()):
+	// all of its pixels are marked as 3, and the pixels where it turns are
+	// stored in corners (in buffer coordinates), in order, until cornerCapacity
+	// is reached (*outCornerCount, on the other hand, is the actual count).
+	const int initialDir = (hole ? 1 : 3);
+	int firstDir = -1, pathLength = 0, cornerCount = 0;
+
+	// Find the first 1-pixel in clockwise direction, starting from the 0-pixel
+	// next to initialI (that 1-pixel will be the last one of the border)
+	for (int k = 1; k <= 3; k++) {
+		const int dir = (initialDir + k) & 3;
+		if (buffer[initialI + cwNeighborOffsets4[dir]]) {
+			firstDir = dir;
+			break;
+		}
+	}
 
-	int stackSize = 1, prevI = initialI, dir = 1, visitingAlreadyVisited = 0;
+	if (firstDir < 0) {
+		// A lonely pixel
+		borderLabels[initialI] = (unsigned short)(border | (buffer[initialI + 1] ? 0 : BorderRightExamined));
+		if (path && pathCapacity > 0)
+			path[0] = initialI;
+		if (corners) {
+			buffer[initialI] = 3;
+			*outCornerCount = 0;
+		}
+		return 1;
+	}
 
-	buffer[initialI] = 3;
-	stack[0] = initialI;
+	const int lastI = initialI + cwNeighborOffsets4[firstDir];
+	// i is the current pixel, and previousDir is the direction from i to the
+	// previous pixel
+	int i = initialI, previousDir = firstDir;
 
 	for (;;) {
-		// When performing the search in CW direction (cwDir === 1), we must start the search
-		// from the left side of the pixel, which is (direction - 1) & 3. When performing
-		// the search in CCW direction (cwDir === -1), we must start the search from the right
-		// side of the pixel, which is (direction + 1) & 3.
-		const int initialOffsetIndex = (dir - cwDir) & 3;
-		int offsetIndex = initialOffsetIndex, nextI = -1;
+		// Look for the next 1-pixel in counterclockwise direction, starting
+		// right after the previous pixel (which will be found if there is no
+		// other 1-pixel around i)
+		int dir = previousDir, rightExamined = 0;
 		do {
-			const int i = prevI + cwNeighborOffsets4[offsetIndex];
-			if (isNewEdgePixel4(i, buffer, cwNeighborOffsets8)) {
-				visitingAlreadyVisited = 0;
-				nextI = i;
-				dir = offsetIndex;
+			dir = (dir - 1) & 3;
+			if (buffer[i + cwNeighborOffsets4[dir]])
 				break;
+			if (dir == 1)
+				rightExamined = 1;
+		} while (dir != previousDir);
+
+		if (rightExamined)
+			borderLabels[i] = (unsigned short)(border | BorderRightExamined);
+		else if (!borderLabels[i])
+			borderLabels[i] = (unsigned short)border;
+
+		if (path && pathLength < pathCapacity)
+			path[pathLength] = i;
+		pathLength++;
+
+		if (corners) {
+			// Only the 4 neighbors have been examined, so marking i does not
+			// change the way the rest of the border is followed. i is a corner
+			// when it is entered and left along different axes (the previous
+			// pixel of initialI is lastI, which is where firstDir points to).
+			buffer[i] = 3;
+			if ((previousDir ^ dir) & 1) {
+				if (cornerCount < cornerCapacity) {
+					corners[cornerCount].x = (short)(i % bufferStride);
+					corners[cornerCount].y = (short)((i / bufferStride) | 0);
+				}
+				cornerCount++;
 			}
-			offsetIndex = (offsetIndex + cwDir) & 3;
-		} while (offsetIndex != initialOffsetIndex);
-		
-		if (nextI < 0) {
-			if (visitingAlreadyVisited >= maxRevisited || stackSize >= maxStackSize) {
-				*outPointCount = 0;
-				*outStackSize = stackSize - visitingAlreadyVisited;
-				return;
-			}
+		}
 
-			// We could not find a new pixel to go to. Therefore, we should try navigating
-			// throught, at most 2, visited pixels until we can (hopefully) find our way back
-			// to track. In this process, if we come across initialI, we can safely end the
-			// search as we have reached the initial position.
-			//
-			// Thanks to the previous removal of all 1-pixels, we came here probably due to one
-			// of the four cases below (or any analogous ones):
-			//
-			// 0 0 0 0 0 0 - 0 0 0 0 0 0 - 0 0 0 0 0 0 - 0 0 0 0 0 0
-			// 0 1 1 0 0 0 - 0 0 0 1 1 0 - 0 1 1 0 0 0 - 0 0 1 1 0 0
-			// 0 1 1 1 1 0 - 0 1 1 1 1 0 - 0 1 1 0 0 0 - 0 0 1 1 0 0
-			// 0 0 0 1 1 0 - 0 1 1 0 0 0 - 0 0 1 1 0 0 - 0 1 1 0 0 0
-			// 0 0 0 0 0 0 - 0 0 0 0 0 0 - 0 0 1 1 0 0 - 0 1 1 0 0 0
-			// 0 0 0 0 0 0 - 0 0 0 0 0 0 - 0 0 0 0 0 0 - 0 0 0 0 0 0
-
-			do {
-				const int i = prevI + cwNeighborOffsets4[offsetIndex];
-				if (buffer[i] == 3) {
-					visitingAlreadyVisited++;
-					nextI = i;
-					dir = offsetIndex;
-					break;
-				}
-				offsetIndex = (offsetIndex + cwDir) & 3;
-			} while (offsetIndex != initialOffsetIndex);
+		const int nextI = i + cwNeighborOffsets4[dir];
+		if (nextI == initialI && i == lastI)
+			break;
 
-			if (nextI < 0) {
-				*outPointCount = 0;
-				*outStackSize = stackSize - visitingAlreadyVisited;
-				return;
-			}
+		i = nextI;
+		previousDir = (dir + 2) & 3;
+	}
 
-			if (nextI == initialI)
-				break;
-		}
+	if (corners)
+		*outCornerCount = cornerCount;
+
+	return pathLength;
+}
 
-		buffer[nextI] = 3;
-		stack[stackSize++] = nextI;
-		prevI = nextI;
+int newBorder(int* borders, int* borderCount, int maxBorders, int hole, int lastBorder) {
+	// borders[border << 1] = (parent border << 1) | hole
+	// borders[(border << 1) + 1] = index of the polygon created from the border,
+	// or from its nearest ancestor, when the border did not become a polygon
+	//
+	// The parent of a new border depends on the type of the last border found
+	// in the same row (table 1 in Suzuki and Abe): it is the last border itself,
+	// when their types differ, or the last border's parent, otherwise.
+	const int lastBorderInfo = borders[lastBorder << 1],
+		parent = (((lastBorderInfo & 1) == hole) ? (lastBorderInfo >> 1) : lastBorder);
+
+	int border = *borderCount;
+	if (border >= maxBorders - 1) {
+		// Out of border numbers: the last one is shared by all borders found from
+		// now on, which will be treated as top-level ones (this requires a really
+		// pathological image)
+		border = maxBorders - 1;
+		borders[border << 1] = 1;
+		borders[(border << 1) + 1] = -1;
+		return border;
 	}
 
-	// stackSize >= maxPointCount not stackSize > maxPointCount,
-	// because we may need space for 1 extra point at the end.
-	if (stackSize < 3 || stackSize >= maxPointCount) {
-		*outPointCount = 0;
-		*outStackSize = stackSize;
+	(*borderCount)++;
+	borders[border << 1] = (parent << 1) | hole;
+	borders[(border << 1) + 1] = borders[(parent << 1) + 1];
+	return border;
+}
+
+void releaseBorder(int* borders, int* borderCount, unsigned short* borderLabels, const int* path, int pathLength, int border) {
+	// A border that did not become a polygon, and that has just been followed,
+	// can give its number back, as long as its pixels are labelled with its
+	// parent's number instead (for the purposes of newBorder(), a hole that
+	// does not enclose anything behaves just like its parent, which is an
+	// outer border)
+	if (border != *borderCount - 1)
 		return;
+	const int parent = borders[border << 1] >> 1;
+	for (int p = pathLength - 1; p >= 0; p--) {
+		const int i = path[p];
+		if ((borderLabels[i] & BorderNumberMask) == border)
+			borderLabels[i] = (unsigned short)((borderLabels[i] & BorderRightExamined) | parent);
 	}
+	(*borderCount)--;
+}
+
+int trace4(int initialI, int hole, const int* cwNeighborOffsets4, unsigned char* buffer, int bufferStride, unsigned short* borderLabels, int border, int* stack, Point* points, int pointCapacity, int* outPointCount, int* outBorderLength, ImageProcessingStats* stats) {
+	// Follows the border (refer to followBorder()), marking all of its pixels
+	// as 3, and creates a simplified polygon from its corners.
+	//
+	// Only the first SmallHoleBorderLength pixels of the border are kept, in
+	// stack, and the rest of stack is used by douglasPeucker(), which needs
+	// room for as many ints as there are points. So, what limits the border is
+	// the number of corners, which must leave 1 point free at the end of
+	// points. Returns 0 when they do not fit (and 1 otherwise, even if the
+	// border is too short to become a polygon).
+	int pointCount = 0;
+	const int borderLength = followBorder(initialI, hole, cwNeighborOffsets4, buffer, bufferStride, borderLabels, border, stack, SmallHoleBorderLength, points, pointCapacity - 1, &pointCount);
+
+	*outBorderLength = borderLength;
+	*outPointCount = 0;
+
+	if (pointCount >= pointCapacity)
+		return 0;
+
+	if (borderLength < 3)
+		return 1;
 
-	// Create the points and simplify the polygon
-	int pointCount = 0, x = 0, y = 0,
-		nextX = (stack[0] % bufferStride),
-		nextY = (stack[0] / bufferStride) | 0,
-		prevX = (stack[stackSize - 1] % bufferStride),
-		prevY = (stack[stackSize - 1] / bufferStride) | 0;
-	for (int nextI = 1; nextI < stackSize; nextI++) {
-		x = nextX;
-		y = nextY;
-		const int i = stack[nextI];
-		nextX = (i % bufferStride);
-		nextY = (i / bufferStride) | 0;
-		if ((x != prevX || x != nextX) &&
-			(y != prevY || y != nextY)) {
-			points[pointCount].x = x;
-			points[pointCount++].y = y;
-		}
-		prevX = x;
-		prevY = y;
-	}
-	x = nextX;
-	y = nextY;
-	nextX = (stack[0] % bufferStride);
-	nextY = (stack[0] / bufferStride) | 0;
-	if ((x != prevX || x != nextX) &&
-		(y != prevY || y != nextY)) {
-		points[pointCount].x = x;
-		points[pointCount++].y = y;
-	}
 	// Since douglasPeucker() never removes the last point, we are adding the
 	// first point again, making it also the last point, so it can be safely removed
 	// using pointCount = douglasPeucker(...) - 1 below.
@@ -431,67 +694,459 @@ void trace4(int initialI, int cwDir, const int* cwNeighborOffsets4, const int* c
 
 	// The value 1.5 used as epsilon was empirically chosen, as it works well
 	// on drawings created with brushes with thicknesses between 10 and 25.
-	*outPointCount = douglasPeucker(points, 0, pointCount - 1, 1.5) - 1;
-	*outStackSize = stackSize;
+	profileStart(douglasPeuckerStart);
+	*outPointCount = douglasPeucker(points, pointCount, 1.5, stack + SmallHoleBorderLength) - 1;
+	profileEnd(douglasPeuckerStart, stats, douglasPeuckerMilliseconds);
+	return 1;
 }
 
-void traceUndo(unsigned char* buffer, int* stack, int stackSize) {
-	while (stackSize > 0)
-		buffer[stack[--stackSize]] = 2;
+void packMaskRows(const unsigned char* buffer, int bufferStride, int y0, int y1, uint64_t* mask, int maskWordsPerRow) {
+	// Pixel x of row y becomes bit (x & 63) of mask[(y * maskWordsPerRow) + (x >> 6)]
+	// (the bits after the right border are always 0).
+	memset(mask + (y0 * maskWordsPerRow), 0, maskWordsPerRow * (y1 - y0 + 1) * sizeof(uint64_t));
+	for (int y = y0; y <= y1; y++) {
+		const unsigned char* const row = buffer + (y * bufferStride);
+		uint64_t* const maskRow = mask + (y * maskWordsPerRow);
+		int x = 0;
+		for (; x <= bufferStride - 8; x += 8) {
+			uint64_t pixels;
+			memcpy(&pixels, row + x, sizeof(pixels));
+			// Each byte is either 0 or 1, so this multiplication gathers
+			// all 8 bytes into the 8 highest bits, without any carry
+			maskRow[x >> 6] |= ((pixels * 0x0102040810204080ULL) >> 56) << (x & 63);
+		}
+		for (; x < bufferStride; x++)
+			maskRow[x >> 6] |= (uint64_t)row[x] << (x & 63);
+	}
 }
 
-void erase1(int initialI, const int* cwNeighborOffsets4, unsigned char* buffer, int bufferStride, int* stack) {
-	int stackSize = 1;
-	stack[0] = initialI;
-	
-	while (stackSize > 0) {
-		const int i = stack[--stackSize];
-		buffer[i] = 0;
-		
-		// Check the four neighbors
-		for (int n = 0; n < 4; n++) {
-			const int j = i + cwNeighborOffsets4[n];
-			if (buffer[j] &&
-				((!buffer[j - 1] && !buffer[j + 1]) ||
-				(!buffer[j - bufferStride] && !buffer[j + bufferStride])))
-				stack[stackSize++] = j;
+int erase1Row(uint64_t* maskRow, const uint64_t* maskRowAbove, const uint64_t* maskRowBelow, int maskWordsPerRow, unsigned char* bufferRow) {
+	// The same rule used in processImage(), 64 pixels at a time: a pixel is
+	// erased when both its left and right neighbors, or both its top and bottom
+	// neighbors, are 0-pixels. Since erasing a pixel can only make its neighbors
+	// eligible for removal, the order in which pixels are erased does not
+	// affect the final result.
+	int changed = 0;
+	for (int k = 0; k < maskWordsPerRow; k++) {
+		const uint64_t pixels = maskRow[k];
+		if (!pixels)
+			continue;
+		const uint64_t left = (pixels << 1) | (k ? (maskRow[k - 1] >> 63) : 0),
+			right = (pixels >> 1) | ((k < maskWordsPerRow - 1) ? (maskRow[k + 1] << 63) : 0);
+		uint64_t erased = pixels & ((~left & ~right) | (~maskRowAbove[k] & ~maskRowBelow[k]));
+		if (!erased)
+			continue;
+		maskRow[k] = pixels & ~erased;
+		changed = 1;
+		do {
+			bufferRow[(k << 6) + __builtin_ctzll(erased)] = 0;
+			erased &= erased - 1;
+		} while (erased);
+	}
+	return changed;
+}
+
+void erase1Rows(int y0, int y1, unsigned char* buffer, int bufferStride, uint64_t* mask, int maskWordsPerRow, unsigned char* maskRowDirty) {
+	// Only the rows next to a row that has just changed need to be checked
+	// again. Changes propagate downwards within the same sweep, and upwards
+	// in the next one. Rows outside [y0, y1] are neither changed nor marked,
+	// so that different bands of the image can be processed concurrently.
+	int dirty = 1;
+	while (dirty) {
+		dirty = 0;
+		for (int y = y0; y <= y1; y++) {
+			if (!maskRowDirty[y])
+				continue;
+			maskRowDirty[y] = 0;
+			uint64_t* const maskRow = mask + (y * maskWordsPerRow);
+			int changed = 0;
+			while (erase1Row(maskRow, maskRow - maskWordsPerRow, maskRow + maskWordsPerRow, maskWordsPerRow, buffer + (y * bufferStride)))
+				changed = 1;
+			if (changed) {
+				dirty = 1;
+				if (y > y0)
+					maskRowDirty[y - 1] = 1;
+				if (y < y1)
+					maskRowDirty[y + 1] = 1;
+			}
 		}
 	}
 }
 
-void polygonFound(Point* points, int pointCount) {
-	// Remove the 1-pixel border from the polygon
+void erase1(int h, unsigned char* buffer, int bufferStride, uint64_t* mask, unsigned char* maskRowDirty) {
+	const int maskWordsPerRow = (bufferStride + 63) >> 6;
+
+	memset(mask, 0, maskWordsPerRow * sizeof(uint64_t));
+	memset(mask + ((h + 1) * maskWordsPerRow), 0, maskWordsPerRow * sizeof(uint64_t));
+	packMaskRows(buffer, bufferStride, 1, h, mask, maskWordsPerRow);
+
+	memset(maskRowDirty, 0, h + 2);
+	memset(maskRowDirty + 1, 1, h);
+	erase1Rows(1, h, buffer, bufferStride, mask, maskWordsPerRow, maskRowDirty);
+}
+
+int polygonFound(PolygonTable* polygonTable, const Point* points, int pointCount, int offsetX, int offsetY, int startPixel, int parent, int hole) {
+	// Returns the index of the new polygon, or -1 if it did not fit
+	if (polygonTable->overflowed || polygonTable->polygonCount >= polygonTable->polygonCapacity || (polygonTable->pointCount + pointCount) > polygonTable->pointCapacity) {
+		// A partial table is useless, so there is no need to keep filling it
+		polygonTable->overflowed = 1;
+		return -1;
+	}
+
+	short* const tablePoints = polygonTable->points + (polygonTable->pointCount << 1);
+
+	// Remove the 1-pixel border from the polygon, and move it to where
+	// the buffer actually is (refer to processImageRegion())
+	offsetX--;
+	offsetY--;
 	for (int p = pointCount - 1; p >= 0; p--) {
-		points[p].x--;
-		points[p].y--;
+		tablePoints[p << 1] = (short)(points[p].x + offsetX);
+		tablePoints[(p << 1) + 1] = (short)(points[p].y + offsetY);
+	}
+
+	memset(polygonTable->radius + polygonTable->pointCount, 0, pointCount);
+
+	const int polygon = polygonTable->polygonCount;
+	polygonTable->startPixel[polygon] = startPixel;
+	polygonTable->parent[polygon] = parent;
+	polygonTable->hole[polygon] = (unsigned char)hole;
+	polygonTable->polygonCount++;
+	polygonTable->pointCount += pointCount;
+	polygonTable->firstPoint[polygonTable->polygonCount] = polygonTable->pointCount;
+	return polygon;
+}
+
+#if defined(__wasm_simd128__)
+typedef v128_t Simd8;
+#define simdLoad(PTR) wasm_v128_load(PTR)
+#define simdStore(PTR, V) wasm_v128_store(PTR, V)
+#define simdSet(VALUE) wasm_i8x16_splat(VALUE)
+#define simdEq(A, B) wasm_i8x16_eq(A, B)
+#define simdAnd(A, B) wasm_v128_and(A, B)
+#define simdOr(A, B) wasm_v128_or(A, B)
+#define simdAny(A) wasm_v128_any_true(A)
+
+static void binarize16(const unsigned char* data, unsigned char* buffer) {
+	// Gather the 16 alpha bytes (the highest byte of each pixel)
+	const v128_t a0 = wasm_u32x4_shr(wasm_v128_load(data), 24),
+		a1 = wasm_u32x4_shr(wasm_v128_load(data + 16), 24),
+		a2 = wasm_u32x4_shr(wasm_v128_load(data + 32), 24),
+		a3 = wasm_u32x4_shr(wasm_v128_load(data + 48), 24),
+		alpha = wasm_u8x16_narrow_i16x8(wasm_u16x8_narrow_i32x4(a0, a1), wasm_u16x8_narrow_i32x4(a2, a3));
+	wasm_v128_store(buffer, wasm_v128_and(wasm_i8x16_eq(alpha, wasm_i8x16_splat(-1)), wasm_i8x16_splat(1)));
+}
+
+static void repaint4(unsigned char* data, v128_t zero, v128_t paint) {
+	const v128_t pixels = wasm_v128_load(data),
+		painted = wasm_v128_or(wasm_u8x16_shr(pixels, 1), wasm_i32x4_splat(0xFF000000));
+	wasm_v128_store(data, wasm_v128_or(wasm_v128_and(painted, paint), wasm_v128_andnot(pixels, wasm_v128_or(paint, zero))));
+}
+
+static void repaint16(unsigned char* data, v128_t zero, v128_t paint) {
+	// Expand each byte of the masks to the 4 bytes of its pixel
+	repaint4(data,
+		wasm_i8x16_shuffle(zero, zero, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3),
+		wasm_i8x16_shuffle(paint, paint, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3));
+	repaint4(data + 16,
+		wasm_i8x16_shuffle(zero, zero, 4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7),
+		wasm_i8x16_shuffle(paint, paint, 4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7));
+	repaint4(data + 32,
+		wasm_i8x16_shuffle(zero, zero, 8, 8, 8, 8, 9, 9, 9, 9, 10, 10, 10, 10, 11, 11, 11, 11),
+		wasm_i8x16_shuffle(paint, paint, 8, 8, 8, 8, 9, 9, 9, 9, 10, 10, 10, 10, 11, 11, 11, 11));
+	repaint4(data + 48,
+		wasm_i8x16_shuffle(zero, zero, 12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15),
+		wasm_i8x16_shuffle(paint, paint, 12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15));
+}
+#elif defined(__SSE2__) || defined(_M_X64)
+typedef __m128i Simd8;
+#define simdLoad(PTR) _mm_loadu_si128((const __m128i*)(PTR))
+#define simdStore(PTR, V) _mm_storeu_si128((__m128i*)(PTR), V)
+#define simdSet(VALUE) _mm_set1_epi8(VALUE)
+#define simdEq(A, B) _mm_cmpeq_epi8(A, B)
+#define simdAnd(A, B) _mm_and_si128(A, B)
+#define simdOr(A, B) _mm_or_si128(A, B)
+#define simdAny(A) _mm_movemask_epi8(A)
+
+static void binarize16(const unsigned char* data, unsigned char* buffer) {
+	// Gather the 16 alpha bytes (the highest byte of each pixel)
+	const __m128i a0 = _mm_srli_epi32(simdLoad(data), 24),
+		a1 = _mm_srli_epi32(simdLoad(data + 16), 24),
+		a2 = _mm_srli_epi32(simdLoad(data + 32), 24),
+		a3 = _mm_srli_epi32(simdLoad(data + 48), 24),
+		alpha = _mm_packus_epi16(_mm_packs_epi32(a0, a1), _mm_packs_epi32(a2, a3));
+	simdStore(buffer, _mm_and_si128(_mm_cmpeq_epi8(alpha, _mm_set1_epi8(-1)), _mm_set1_epi8(1)));
+}
+
+static void repaint4(unsigned char* data, __m128i zero, __m128i paint) {
+	const __m128i pixels = simdLoad(data),
+		painted = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(pixels, 1), _mm_set1_epi8(0x7F)), _mm_set1_epi32((int)0xFF000000));
+	simdStore(data, _mm_or_si128(_mm_and_si128(painted, paint), _mm_andnot_si128(_mm_or_si128(paint, zero), pixels)));
+}
+
+static void repaint16(unsigned char* data, __m128i zero, __m128i paint) {
+	// Expand each byte of the masks to the 4 bytes of its pixel
+	const __m128i zeroLo = _mm_unpacklo_epi8(zero, zero), zeroHi = _mm_unpackhi_epi8(zero, zero),
+		paintLo = _mm_unpacklo_epi8(paint, paint), paintHi = _mm_unpackhi_epi8(paint, paint);
+	repaint4(data, _mm_unpacklo_epi16(zeroLo, zeroLo), _mm_unpacklo_epi16(paintLo, paintLo));
+	repaint4(data + 16, _mm_unpackhi_epi16(zeroLo, zeroLo), _mm_unpackhi_epi16(paintLo, paintLo));
+	repaint4(data + 32, _mm_unpacklo_epi16(zeroHi, zeroHi), _mm_unpacklo_epi16(paintHi, paintHi));
+	repaint4(data + 48, _mm_unpackhi_epi16(zeroHi, zeroHi), _mm_unpackhi_epi16(paintHi, paintHi));
+}
+#elif defined(__ARM_NEON)
+typedef uint8x16_t Simd8;
+#define simdLoad(PTR) vld1q_u8(PTR)
+#define simdStore(PTR, V) vst1q_u8(PTR, V)
+#define simdSet(VALUE) vdupq_n_u8(VALUE)
+#define simdEq(A, B) vceqq_u8(A, B)
+#define simdAnd(A, B) vandq_u8(A, B)
+#define simdOr(A, B) vorrq_u8(A, B)
+#define simdAny(A) vget_lane_u64(vreinterpret_u64_u8(vorr_u8(vget_low_u8(A), vget_high_u8(A))), 0)
+
+static void binarize16(const unsigned char* data, unsigned char* buffer) {
+	// vld4q_u8() splits the pixels into r, g, b and a
+	const uint8x16x4_t pixels = vld4q_u8(data);
+	vst1q_u8(buffer, vandq_u8(vceqq_u8(pixels.val[3], vdupq_n_u8(255)), vdupq_n_u8(1)));
+}
+
+static void repaint16(unsigned char* data, uint8x16_t zero, uint8x16_t paint) {
+	uint8x16x4_t pixels = vld4q_u8(data);
+	pixels.val[0] = vbslq_u8(paint, vshrq_n_u8(pixels.val[0], 1), vbicq_u8(pixels.val[0], zero));
+	pixels.val[1] = vbslq_u8(paint, vshrq_n_u8(pixels.val[1], 1), vbicq_u8(pixels.val[1], zero));
+	pixels.val[2] = vbslq_u8(paint, vshrq_n_u8(pixels.val[2], 1), vbicq_u8(pixels.val[2], zero));
+	pixels.val[3] = vbslq_u8(paint, vdupq_n_u8(255), vbicq_u8(pixels.val[3], zero));
+	vst4q_u8(data, pixels);
+}
+#endif
+
+void binarizeRow(const unsigned char* data, unsigned char* buffer, int w) {
+	int x = 0;
+#if simdEnabled
+	for (; x <= w - 16; x += 16, data += 64, buffer += 16)
+		binarize16(data, buffer);
+#endif
+	for (; x < w; x++, data += 4, buffer++)
+		*buffer = ((data[3] == 255) ? 1 : 0);
+}
+
+void repaintPixels(unsigned char* data, const unsigned char* buffer, int j, int x, int xEnd, int y, int w, int h, int bufferStride) {
+	const int wMinus1 = w - 1, hMinus1 = h - 1, bufferStride2 = bufferStride << 1;
+	for (; x < xEnd; x++, data += 4, j++) {
+		if (!buffer[j]) {
+			data[0] = 0;
+			data[1] = 0;
+			data[2] = 0;
+			data[3] = 0;
+		} else if (buffer[j] == 3 && (
+			// Always paint outer pixels
+			!buffer[j - 1] || !buffer[j + 1] || !buffer[j - bufferStride] || !buffer[j + bufferStride] ||
+			// Paint the inner pixels only if they are a part of what appears to be
+			// the intersection of two longer lines
+			(
+				(
+					// Does the pixel have at least two traced pixels to the left or to the right?
+					(x > 1 && buffer[j - 1] == 3 && buffer[j - 2] == 3) ||
+					(x < wMinus1 && buffer[j + 1] == 3 && buffer[j + 2] == 3)
+				)
+				&&
+				(
+					// If so, does it have at least two traced pixels above or below it?
+					(y > 1 && buffer[j - bufferStride] == 3 && buffer[j - bufferStride2] == 3) ||
+					(y < hMinus1 && buffer[j + bufferStride] == 3 && buffer[j + bufferStride2] == 3)
+				)
+			)
+			)) {
+			data[0] = data[0] >> 1;
+			data[1] = data[1] >> 1;
+			data[2] = data[2] >> 1;
+			data[3] = 255;
+		}
 	}
-	call_createPolygon(pointCount);
 }
 
-int processImage(ImageInfo* imageInfo) {
+void repaintRow(unsigned char* data, const unsigned char* buffer, int y, int w, int h, int bufferStride) {
+	const int j = ((y + 1) * bufferStride) + 1;
+	int x = 0;
+#if simdEnabled
+	// The first and the last rows are left to repaintPixels(), because
+	// buffer[j - bufferStride2] and buffer[j + bufferStride2] could be out of
+	// bounds. In all other rows, the x > 1, x < wMinus1, y > 1 and y < hMinus1
+	// checks are not necessary, as the 1-pixel border is always 0.
+	if (y > 0 && y < h - 1) {
+		const Simd8 zeroValue = simdSet(0), threeValue = simdSet(3);
+		const unsigned char* p = buffer + j;
+		for (; x <= w - 16; x += 16, p += 16) {
+			const Simd8 center = simdLoad(p),
+				left = simdLoad(p - 1),
+				right = simdLoad(p + 1),
+				above = simdLoad(p - bufferStride),
+				below = simdLoad(p + bufferStride),
+				zero = simdEq(center, zeroValue),
+				three = simdEq(center, threeValue);
+			if (!simdAny(simdOr(zero, three)))
+				continue;
+			const Simd8 outer = simdOr(simdOr(simdEq(left, zeroValue), simdEq(right, zeroValue)), simdOr(simdEq(above, zeroValue), simdEq(below, zeroValue))),
+				horizontal = simdOr(
+					simdAnd(simdEq(left, threeValue), simdEq(simdLoad(p - 2), threeValue)),
+					simdAnd(simdEq(right, threeValue), simdEq(simdLoad(p + 2), threeValue))),
+				vertical = simdOr(
+					simdAnd(simdEq(above, threeValue), simdEq(simdLoad(p - (bufferStride << 1)), threeValue)),
+					simdAnd(simdEq(below, threeValue), simdEq(simdLoad(p + (bufferStride << 1)), threeValue))),
+				paint = simdAnd(three, simdOr(outer, simdAnd(horizontal, vertical)));
+			repaint16(data + (x << 2), zero, paint);
+		}
+	}
+#endif
+	repaintPixels(data + (x << 2), buffer, j + x, x, w, y, w, h, bufferStride);
+}
+
+// Bands smaller than this are not worth the synchronization
+#define minBandRowCount 64
+
+typedef struct ImageBandsStructure {
+	int w, h, bufferStride, maskWordsPerRow, bandCount;
+	const unsigned char* data;
+	unsigned char* buffer;
+	uint64_t* mask;
+	unsigned char* maskRowDirty;
+	int* runs;
+	int* parent;
+	int* area;
+	// Runs found in each band (refer to labelRows())
+	int firstRun[maxThreadPoolThreadCount], endRun[maxThreadPoolThreadCount], lastRowFirstRun[maxThreadPoolThreadCount];
+} ImageBands;
+
+// Rows of band B (the first row of every band, but the first one, is a seam)
+#define bandFirstRow(BANDS, B) (1 + (((BANDS)->h * (B)) / (BANDS)->bandCount))
+#define bandLastRow(BANDS, B) ((((BANDS)->h * ((B) + 1)) / (BANDS)->bandCount))
+
+static int initImageBands(ImageBands* bands, const ImageInfo* imageInfo, int w, int h, unsigned char* buffer) {
+	int bandCount = h / minBandRowCount;
+	if (bandCount > imageInfo->threadCount)
+		bandCount = imageInfo->threadCount;
+	if (bandCount < 1)
+		bandCount = 1;
+
+	bands->w = w;
+	bands->h = h;
+	bands->bufferStride = w + 2;
+	bands->maskWordsPerRow = (w + 2 + 63) >> 6;
+	bands->bandCount = bandCount;
+	bands->data = imageInfo->data;
+	bands->buffer = buffer;
+	bands->mask = imageInfo->mask;
+	bands->maskRowDirty = imageInfo->maskRowDirty;
+	bands->runs = imageInfo->stack;
+	bands->parent = imageInfo->labels;
+	bands->area = bands->parent + (((w + 2) * (h + 2)) >> 1);
+
+	return bandCount;
+}
+
+static void binarizeBand(void* argument, int band) {
+	const ImageBands* const bands = (const ImageBands*)argument;
+	const int y0 = bandFirstRow(bands, band), y1 = bandLastRow(bands, band), w = bands->w, bufferStride = bands->bufferStride;
+
+	// Rows 0 and h + 1 are cleared by the caller
+	memset(bands->buffer + (y0 * bufferStride), 0, (y1 - y0 + 1) * bufferStride);
+	for (int y = y0; y <= y1; y++)
+		binarizeRow(bands->data + (((y - 1) * w) << 2), bands->buffer + (y * bufferStride) + 1, w);
+}
+
+static void packMaskBand(void* argument, int band) {
+	const ImageBands* const bands = (const ImageBands*)argument;
+	packMaskRows(bands->buffer, bands->bufferStride, bandFirstRow(bands, band), bandLastRow(bands, band), bands->mask, bands->maskWordsPerRow);
+}
+
+static void erase1Band(void* argument, int band) {
+	const ImageBands* const bands = (const ImageBands*)argument;
+	// The seam (the first row of the band) is left untouched, because it is
+	// read by the band above it as well (it is handled later by erase1Bands())
+	const int y0 = bandFirstRow(bands, band) + (band ? 1 : 0), y1 = bandLastRow(bands, band);
+
+	memset(bands->maskRowDirty + y0, 1, y1 - y0 + 1);
+	erase1Rows(y0, y1, bands->buffer, bands->bufferStride, bands->mask, bands->maskWordsPerRow, bands->maskRowDirty);
+}
+
+static void erase1Bands(ImageBands* bands) {
+	const int h = bands->h, maskWordsPerRow = bands->maskWordsPerRow;
+
+	memset(bands->mask, 0, maskWordsPerRow * sizeof(uint64_t));
+	memset(bands->mask + ((h + 1) * maskWordsPerRow), 0, maskWordsPerRow * sizeof(uint64_t));
+	threadPoolRun(packMaskBand, bands, bands->bandCount, bands->bandCount);
+
+	memset(bands->maskRowDirty, 0, h + 2);
+	threadPoolRun(erase1Band, bands, bands->bandCount, bands->bandCount);
+
+	// Since the order in which pixels are erased does not affect the final
+	// result (refer to erase1Row()), all that is left is to process the seams,
+	// and whatever their changes propagate to, until nothing else changes
+	for (int band = 1; band < bands->bandCount; band++)
+		bands->maskRowDirty[bandFirstRow(bands, band)] = 1;
+	erase1Rows(1, h, bands->buffer, bands->bufferStride, bands->mask, maskWordsPerRow, bands->maskRowDirty);
+}
+
+static void labelBand(void* argument, int band) {
+	ImageBands* const bands = (ImageBands*)argument;
+	const int y0 = bandFirstRow(bands, band);
+
+	// There are at most ((w + 1) >> 1) runs per row (refer to labelComponents()),
+	// so the runs of each band are numbered from where they would be if the
+	// previous bands were completely filled with runs
+	bands->firstRun[band] = ((bands->w + 1) >> 1) * (y0 - 1);
+	bands->endRun[band] = labelRows(bands->w, y0, bandLastRow(bands, band), bands->buffer, bands->bufferStride, bands->runs, bands->parent, bands->area, bands->firstRun[band], &(bands->lastRowFirstRun[band]));
+}
+
+static void labelBands(ImageBands* bands) {
+	threadPoolRun(labelBand, bands, bands->bandCount, bands->bandCount);
+
+	int* const runs = bands->runs;
+	int* const parent = bands->parent;
+	int* const area = bands->area;
+
+	// Stitch the runs of the first row of each band to the runs of the last
+	// row of the band above it
+	for (int band = 1; band < bands->bandCount; band++) {
+		const int seamEndRun = bands->endRun[band],
+			seamRowEnd = ((bandFirstRow(bands, band) + 1) * bands->bufferStride);
+		int previousRun = bands->lastRowFirstRun[band - 1];
+		for (int run = bands->firstRun[band]; run < seamEndRun && runs[run << 1] < seamRowEnd; run++)
+			previousRun = unionRunWithRunsAbove(runs, parent, area, bands->bufferStride, run, previousRun, bands->endRun[band - 1]);
+	}
+
+	for (int band = 0; band < bands->bandCount; band++)
+		paintComponents(bands->buffer, runs, parent, area, bands->firstRun[band], bands->endRun[band]);
+}
+
+static void binarizeImage(ImageInfo* imageInfo) {
 	const int w = imageInfo->width,
 		h = imageInfo->height,
-		bufferStride = w + 2, // We are creating a 1-pixel border around the original image
-		dataLength = (w * h) << 2;
-	unsigned char* const data = imageInfo->data;
+		bufferStride = w + 2; // We are creating a 1-pixel border around the original image
+	const unsigned char* const data = imageInfo->data;
 	unsigned char* const buffer = imageInfo->buffer;
-	int* const stack = imageInfo->stack;
-	// Refer to traceX() for the meaning of cwNeighborOffsetsX
-	const int cwNeighborOffsets4[4] = { -bufferStride, 1, bufferStride, -1 };
-	const int cwNeighborOffsets8[8] = { -bufferStride, -bufferStride + 1, 1, bufferStride + 1, bufferStride, bufferStride - 1, -1, -bufferStride - 1 };
-	Point* const points = imageInfo->points;
 
-	int i, j, x, y;
-
-	memset(buffer, 0, maxPixelCount);
+	ImageBands bands;
+	if (initImageBands(&bands, imageInfo, w, h, buffer) > 1) {
+		memset(buffer, 0, bufferStride);
+		memset(buffer + ((h + 1) * bufferStride), 0, bufferStride);
+		threadPoolRun(binarizeBand, &bands, bands.bandCount, bands.bandCount);
+	} else {
+		memset(buffer, 0, imageInfo->pixelCount);
 
-	for (i = dataLength - 4, y = h - 1; y >= 0; y--) {
-		j = ((y + 1) * bufferStride) + w;
-		for (x = w - 1; x >= 0; x--, i -= 4, j--)
-			buffer[j] = ((data[i + 3] == 255) ? 1 : 0);
+		for (int y = 0; y < h; y++)
+			binarizeRow(data + ((y * w) << 2), buffer + ((y + 1) * bufferStride) + 1, w);
 	}
+}
 
-	// Erase all 1-pixels (refer to traceX() for the reason why).
+static void erase1Image(ImageInfo* imageInfo, int w, int h, unsigned char* buffer) {
+	const int bufferStride = w + 2;
+	ImageProcessingStats* const stats = &(imageInfo->stats);
+
+	profileStart(erase1Start);
+	traceBegin(erase1);
+
+	// Erase all 1-pixels (pixels that are only 1 pixel thick, either horizontally
+	// or vertically), which would make borders go back and forth through the
+	// same pixels, producing degenerate polygons (refer to followBorder()).
 	// It has to be an iterative process as the removal of one
 	// pixel could make another pixel eligible for removal, as
 	// the example below, where pixel A becomes eligible for
@@ -505,53 +1160,591 @@ int processImage(ImageInfo* imageInfo) {
 	// 0 C 0 1 1 ...
 	// 0 0 0 0 0 ...
 	//
-	for (y = h - 1; y >= 0; y--) {
-		j = ((y + 1) * bufferStride) + w;
-		for (x = w - 1; x >= 0; x--, j--) {
-			if (buffer[j] &&
-				((!buffer[j - 1] && !buffer[j + 1]) ||
-				(!buffer[j - bufferStride] && !buffer[j + bufferStride])))
-				erase1(j, cwNeighborOffsets4, buffer, bufferStride, stack);
-		}
-	}
+	ImageBands bands;
+	if (initImageBands(&bands, imageInfo, w, h, buffer) > 1)
+		erase1Bands(&bands);
+	else
+		erase1(h, buffer, bufferStride, imageInfo->mask, imageInfo->maskRowDirty);
+
+	profileEnd(erase1Start, stats, erase1Milliseconds);
+	traceEnd(erase1, "image");
+}
+
+static void processComponents(ImageInfo* imageInfo, PolygonTable* polygonTable, int w, int h, unsigned char* buffer, int offsetX, int offsetY) {
+	// buffer is a binarized image (with a 1-pixel border around it), already
+	// processed by erase1Image(), which is either the entire image, or just a
+	// region of it, whose topmost/leftmost pixel is (offsetX, offsetY) in the
+	// original image
+	const int bufferStride = w + 2;
+	int* const stack = imageInfo->stack;
+	// Refer to followBorder() for the meaning of cwNeighborOffsets4
+	const int cwNeighborOffsets4[4] = { -bufferStride, 1, bufferStride, -1 };
+	const int maxBorders = maxBorderCount(imageInfo->pixelCount),
+		pointCapacity = imageInfo->pixelCount >> 1;
+	Point* const points = imageInfo->points;
+	unsigned short* const borderLabels = imageInfo->borderLabels;
+	int* const borders = imageInfo->borders;
+	ImageProcessingStats* const stats = &(imageInfo->stats);
+
+	int i, x, y;
+
+	profileStart(labelStart);
+	traceBegin(label);
+
+	// points and stack are not used until the first component is traced
+	ImageBands bands;
+	if (initImageBands(&bands, imageInfo, w, h, buffer) > 1)
+		labelBands(&bands);
+	else
+		labelComponents(w, h, buffer, bufferStride, stack, imageInfo->labels);
+
+	profileEnd(labelStart, stats, labelMilliseconds);
+	traceEnd(label, "image");
+	traceBegin(components);
+
+	// labelComponents() no longer needs parent and area, so points and
+	// borderLabels can take their place (border 0 is the frame around the
+	// image, which behaves as a hole, refer to newBorder())
+	memset(borderLabels, 0, bufferStride * (h + 2) * sizeof(unsigned short));
+	int borderCount = 1;
+	borders[0] = 1;
+	borders[1] = -1;
 
 	for (y = 1; y <= h; y++) {
 		i = (y * bufferStride) + 1;
+		// The last border found in this row (LNBD in Suzuki and Abe)
+		int lastBorder = 0;
 		for (x = 1; x <= w; x++, i++) {
-			if (buffer[i] == 1) {
+			if (buffer[i] == ComponentStart) {
 				buffer[i] = 2;
-				stack[0] = i;
-				// We are only considering polygons with more than 10 pixels
-				if (floodFill(w, h, buffer, bufferStride, 1, 2, stack) > 10) {
-					int polygonPointCount = 0, stackSize = 0;
-					trace4(i, 1, cwNeighborOffsets4, cwNeighborOffsets8, buffer, bufferStride, stack, points, &polygonPointCount, &stackSize);
-					if (polygonPointCount > 1) {
-						polygonFound(points, polygonPointCount);
-					} else {
-						traceUndo(buffer, stack, stackSize);
-						buffer[i] = 2;
-						stack[0] = i;
-						floodFill(w, h, buffer, bufferStride, 2, 0, stack);
-					}
+				profileCount(stats, componentCount, 1);
+				const int border = newBorder(borders, &borderCount, maxBorders, 0, lastBorder);
+				int polygonPointCount = 0, borderLength = 0;
+				profileStart(trace4Start);
+				const int traced = trace4(i, 0, cwNeighborOffsets4, buffer, bufferStride, borderLabels, border, stack, points, pointCapacity, &polygonPointCount, &borderLength, stats);
+				profileEnd(trace4Start, stats, trace4Milliseconds);
+				if (!traced) {
+					// Just like when polygonTable is full (refer to polygonFound()),
+					// the component is kept, but the results are incomplete
+					profileCount(stats, traceFailureCount, 1);
+					polygonTable->overflowed = 1;
+				} else if (polygonPointCount > 1) {
+					const int polygon = polygonFound(polygonTable, points, polygonPointCount, offsetX, offsetY, ((y - 1 + offsetY) * imageInfo->width) + x - 1 + offsetX, borders[((borders[border << 1] >> 1) << 1) + 1], 0);
+					if (polygon >= 0)
+						borders[(border << 1) + 1] = polygon;
+					profileCount(stats, polygonCount, 1);
+					profileCount(stats, pointCount, polygonPointCount);
 				} else {
-					// Erase small polygons
+					profileCount(stats, traceFailureCount, 1);
+					profileStart(floodFillUndoStart);
+					// The entire component is about to be erased, so its labels
+					// do not need to be fixed (pixels are only labelled with
+					// border numbers while they are not 0-pixels). The border
+					// is 4-connected, so its 3-pixels are turned back into
+					// 2-pixels before the component is erased.
+					releaseBorder(borders, &borderCount, borderLabels, stack, 0, border);
+					buffer[i] = 2;
+					stack[0] = i;
+					floodFill(w, buffer, bufferStride, 3, 2, stack);
 					buffer[i] = 0;
 					stack[0] = i;
-					floodFill(w, h, buffer, bufferStride, 2, 0, stack);
+					floodFill(w, buffer, bufferStride, 2, 0, stack);
+					profileEnd(floodFillUndoStart, stats, floodFillMilliseconds);
+				}
+			} else if (buffer[i] == SmallComponentStart) {
+				// Erase small polygons
+				profileCount(stats, componentCount, 1);
+				profileCount(stats, smallComponentCount, 1);
+				profileStart(floodFillEraseStart);
+				buffer[i] = 0;
+				stack[0] = i;
+				floodFill(w, buffer, bufferStride, 1, 0, stack);
+				profileEnd(floodFillEraseStart, stats, floodFillMilliseconds);
+			} else if (buffer[i] && !buffer[i + 1] && !(borderLabels[i] & BorderRightExamined)) {
+				// We are on the left edge of a hole, right before its
+				// topmost/leftmost 0-pixel
+				if (borderLabels[i])
+					lastBorder = (borderLabels[i] & BorderNumberMask);
+				const int border = newBorder(borders, &borderCount, maxBorders, 1, lastBorder);
+				int polygonPointCount = 0, borderLength = 0;
+				profileStart(trace4Start);
+				const int traced = trace4(i, 1, cwNeighborOffsets4, buffer, bufferStride, borderLabels, border, stack, points, pointCapacity, &polygonPointCount, &borderLength, stats);
+				profileEnd(trace4Start, stats, trace4Milliseconds);
+				// Ignore very small holes (refer to SmallHoleBorderLength)
+				if (!traced) {
+					profileCount(stats, traceFailureCount, 1);
+					polygonTable->overflowed = 1;
+				} else if (polygonPointCount > 1 && borderLength > SmallHoleBorderLength) {
+					const int polygon = polygonFound(polygonTable, points, polygonPointCount, offsetX, offsetY, ((y - 1 + offsetY) * imageInfo->width) + x - 1 + offsetX, borders[((borders[border << 1] >> 1) << 1) + 1], 1);
+					if (polygon >= 0)
+						borders[(border << 1) + 1] = polygon;
+					profileCount(stats, holeCount, 1);
+					profileCount(stats, polygonCount, 1);
+					profileCount(stats, pointCount, polygonPointCount);
+				} else if (borderLength <= SmallHoleBorderLength) {
+					releaseBorder(borders, &borderCount, borderLabels, stack, borderLength, border);
+				}
+			}
+
+			if (buffer[i] && borderLabels[i])
+				lastBorder = (borderLabels[i] & BorderNumberMask);
+		}
+	}
+
+	// trace4Milliseconds also accounted for the time spent inside douglasPeucker()
+	profileCount(stats, trace4Milliseconds, -stats->douglasPeuckerMilliseconds);
+	traceEnd(components, "image");
+}
+
+// Centerlines (refer to extractCenterlines()). Distances are measured with a
+// 3-4 chamfer, so 3 units are 1 pixel.
+#define CenterlineUnit 3
+// Brushes are between 10 and 25 pixels thick, and two of the thickest strokes
+// crossing each other are about 2 x 18 pixels thick where they cross: anything
+// thicker than that is a filled area, rather than a few strokes
+#define MaxCenterlineDistance (18 * CenterlineUnit)
+// Values of marks, which reuses borderLabels (refer to extractCenterlines())
+#define CenterlineForeground 1 // Pixel of the component being processed
+#define CenterlineRemoving 2 // Pixel about to be removed by thinComponent()
+#define CenterlineVisited 3 // Skeleton pixel already walked by walkSkeleton()
+#define CenterlineDone 4 // Any other pixel of a component already processed
+#define CenterlineValueMask 0xFF
+// Used only by thinComponent(), along with CenterlineForeground
+#define CenterlineRetest0 0x100 // Must be tested again during subiteration 0
+#define CenterlineRetest1 0x200 // Must be tested again during subiteration 1
+
+void centerlineDistances(int w, int h, const unsigned char* buffer, unsigned char* distance) {
+	// Two-pass 3-4 chamfer distance transform: the distance from each pixel to
+	// the closest 0-pixel (the 1-pixel border is always 0), clamped to 255.
+	// Each row is done in two steps: first the neighbors in the row above (or
+	// below), which do not depend on each other, and then the neighbor to the
+	// left (or to the right), which depends on the pixel that has just been
+	// computed.
+	const int bufferStride = w + 2;
+
+	memset(distance, 0, bufferStride * (h + 2));
+
+	for (int y = 1; y <= h; y++) {
+		const int row = y * bufferStride;
+		const unsigned char* const above = distance + row - bufferStride;
+		unsigned char* const current = distance + row;
+		for (int x = 1; x <= w; x++) {
+			int d = above[x] + 3;
+			if (d > above[x - 1] + 4)
+				d = above[x - 1] + 4;
+			if (d > above[x + 1] + 4)
+				d = above[x + 1] + 4;
+			current[x] = (unsigned char)(buffer[row + x] ? ((d > 255) ? 255 : d) : 0);
+		}
+		for (int x = 1, left = 0; x <= w; x++) {
+			const int d = left + 3;
+			if (current[x] > d)
+				current[x] = (unsigned char)d;
+			left = current[x];
+		}
+	}
+
+	for (int y = h; y >= 1; y--) {
+		const int row = y * bufferStride;
+		const unsigned char* const below = distance + row + bufferStride;
+		unsigned char* const current = distance + row;
+		for (int x = 1; x <= w; x++) {
+			int d = below[x] + 3;
+			if (d > below[x - 1] + 4)
+				d = below[x - 1] + 4;
+			if (d > below[x + 1] + 4)
+				d = below[x + 1] + 4;
+			if (current[x] > d)
+				current[x] = (unsigned char)d;
+		}
+		for (int x = w, right = 0; x >= 1; x--) {
+			const int d = right + 3;
+			if (current[x] > d)
+				current[x] = (unsigned char)d;
+			right = current[x];
+		}
+	}
+}
+
+int thinComponent(const int* neighborOffsets, const unsigned char* distance, int maxDistance, unsigned short* marks, int* pixels, int pixelCount) {
+	// Thins the component down to a skeleton 1 pixel thick, using the
+	// algorithm from Zhang and Suen, "A Fast Parallel Algorithm for Thinning
+	// Digital Patterns" (1984). pixels lists all pixels of the component, which
+	// must be marked as CenterlineForeground. Removed pixels are marked as
+	// CenterlineDone, and the pixels of the skeleton are moved to the beginning
+	// of pixels. Returns the number of pixels in the skeleton.
+	//
+	// neighborOffsets lists the 8 neighbors clockwise, starting at the one
+	// above the pixel (P2, P3, ... P9 in the paper). Pixels are only removed
+	// at the end of each subiteration, so CenterlineRemoving still counts as
+	// foreground until then.
+	//
+	// Each subiteration removes at most one layer of pixels, so a pixel that
+	// is n pixels away from the background (which is at least distance / 4,
+	// as a diagonal step costs 4) cannot be removed during the first n - 1
+	// subiterations: all of its neighbors are still there. Those pixels are
+	// skipped without even looking at their neighbors.
+	//
+	// Likewise, the outcome of the test only changes when a neighbor is
+	// removed, so a pixel that has been kept is not tested again (during the
+	// same kind of subiteration) until one of its neighbors is removed. Most
+	// of the skeleton is already there after a few iterations, while thin
+	// corners keep being removed, one pixel at a time, for a lot longer.
+	for (int k = 0; k < pixelCount; k++)
+		marks[pixels[k]] = CenterlineForeground | CenterlineRetest0 | CenterlineRetest1;
+
+	int removedCount, reach = 0;
+	do {
+		removedCount = 0;
+		for (int subiteration = 0; subiteration < 2; subiteration++) {
+			const unsigned short retest = (subiteration ? CenterlineRetest1 : CenterlineRetest0);
+			int removingCount = 0;
+			reach += 4;
+			for (int k = 0; k < pixelCount; k++) {
+				const int i = pixels[k];
+				if (!(marks[i] & retest) || distance[i] > reach)
+					continue;
+				marks[i] &= ~retest;
+				int p[8], count = 0, transitions = 0;
+				for (int n = 0; n < 8; n++) {
+					const unsigned short m = (marks[i + neighborOffsets[n]] & CenterlineValueMask);
+					p[n] = (m == CenterlineForeground || m == CenterlineRemoving);
+					count += p[n];
+				}
+				if (count < 2 || count > 6)
+					continue;
+				for (int n = 0; n < 8; n++)
+					transitions += (!p[n] && p[(n + 1) & 7]);
+				if (transitions != 1)
+					continue;
+				// p[0], p[2], p[4] and p[6] are N, E, S and W
+				if (subiteration ?
+					((p[0] && p[2] && p[6]) || (p[0] && p[4] && p[6])) :
+					((p[0] && p[2] && p[4]) || (p[2] && p[4] && p[6])))
+					continue;
+				marks[i] = CenterlineRemoving;
+				removingCount++;
+			}
+
+			if (!removingCount)
+				continue;
+
+			removedCount += removingCount;
+			int keptCount = 0;
+			for (int k = 0; k < pixelCount; k++) {
+				const int i = pixels[k];
+				if (marks[i] != CenterlineRemoving) {
+					pixels[keptCount++] = i;
+					continue;
+				}
+				marks[i] = CenterlineDone;
+				for (int n = 0; n < 8; n++) {
+					const int j = i + neighborOffsets[n];
+					if ((marks[j] & CenterlineValueMask) == CenterlineForeground)
+						marks[j] |= CenterlineRetest0 | CenterlineRetest1;
 				}
-			} else if (buffer[i] == 2 && !buffer[i + bufferStride]) {
-				// We are on the top-inner edge of a hole
-				int polygonPointCount = 0, stackSize = 0;
-				trace4(i, -1, cwNeighborOffsets4, cwNeighborOffsets8, buffer, bufferStride, stack, points, &polygonPointCount, &stackSize);
-				// Ignore very small holes
-				if (polygonPointCount > 1 && stackSize > 8)
-					polygonFound(points, polygonPointCount);
 			}
+			pixelCount = keptCount;
 		}
+	} while (removedCount || reach < maxDistance);
+
+	for (int k = 0; k < pixelCount; k++)
+		marks[pixels[k]] = CenterlineForeground;
+
+	return pixelCount;
+}
+
+// 4-neighbors first, so that walkSkeleton() does not cut corners
+static const int skeletonWalkOrder[8] = { 0, 2, 4, 6, 1, 3, 5, 7 };
+
+static int skeletonNeighborCount(int i, const int* neighborOffsets, const unsigned short* marks) {
+	int count = 0;
+	for (int n = 0; n < 8; n++) {
+		const unsigned short m = marks[i + neighborOffsets[n]];
+		count += (m == CenterlineForeground || m == CenterlineVisited);
 	}
+	return count;
+}
+
+static int visitedSkeletonNeighbor(int i, const int* neighborOffsets, const unsigned short* marks, const int* recentPath, int recentLength) {
+	// Returns a neighbor that has already been walked, other than the ones in
+	// recentPath, or -1
+	for (int n = 0; n < 8; n++) {
+		const int j = i + neighborOffsets[skeletonWalkOrder[n]];
+		if (marks[j] != CenterlineVisited)
+			continue;
+		int recent = 0;
+		for (int r = 0; r < recentLength && !recent; r++)
+			recent = (recentPath[r] == j);
+		if (!recent)
+			return j;
+	}
+	return -1;
+}
+
+int walkSkeleton(int i, const int* neighborOffsets, const unsigned char* distance, unsigned short* marks, int* path, int pathCapacity, int* outFirst, int* outLast) {
+	// Walks along the skeleton, starting at i, until there are no unvisited
+	// pixels ahead, marking all pixels as CenterlineVisited. When the walk
+	// starts or ends next to a part of the skeleton that has already been
+	// walked (a junction, or the beginning of a loop), that pixel is also
+	// added to path, so that there are no gaps between the polylines.
+	// Returns the length of path, and the pixels worth keeping, in
+	// [*outFirst, *outLast]: the tails at the free ends of the skeleton, where
+	// the distance keeps decreasing, are left out, as they just reach for the
+	// border of the stroke (the radius at the new end covers them).
+	const int tip = (skeletonNeighborCount(i, neighborOffsets, marks) <= 1);
+	int length = 0, freeStart = 1, freeEnd = 1;
+
+	const int junction = visitedSkeletonNeighbor(i, neighborOffsets, marks, path, 0);
+	if (junction >= 0) {
+		path[length++] = junction;
+		freeStart = 0;
+	}
+
+	for (;;) {
+		marks[i] = CenterlineVisited;
+		path[length++] = i;
+		// Leave room for the last pixel
+		if (length >= pathCapacity - 1)
+			break;
+		int next = -1;
+		for (int n = 0; n < 8 && next < 0; n++) {
+			const int j = i + neighborOffsets[skeletonWalkOrder[n]];
+			if (marks[j] == CenterlineForeground)
+				next = j;
+		}
+		if (next < 0)
+			break;
+		i = next;
+	}
+
+	const int recentLength = ((length < 3) ? length : 3),
+		end = visitedSkeletonNeighbor(i, neighborOffsets, marks, path + length - recentLength, recentLength);
+	if (end >= 0) {
+		path[length++] = end;
+		freeEnd = 0;
+	}
+
+	int first = 0, last = length - 1;
+	if (freeStart && tip) {
+		while ((last - first) >= 2 && distance[path[first + 1]] > distance[path[first]])
+			first++;
+	}
+	if (freeEnd) {
+		while ((last - first) >= 2 && distance[path[last - 1]] > distance[path[last]])
+			last--;
+	}
+
+	*outFirst = first;
+	*outLast = last;
+	return length;
+}
+
+static int addCenterline(PolygonTable* polygonTable, int w, int bufferStride, const unsigned char* distance, const int* path, int first, int last, Point* points, int* segmentEnds) {
+	// Creates a simplified polyline from path[first...last], just like trace4()
+	// does with borders, and adds it to polygonTable. Each segment is as thick
+	// as the thinnest part of the stroke it covers. Returns 1 if the polyline
+	// has been added.
+	int pointCount = 0;
+	for (int k = first; k <= last; k++) {
+		points[pointCount].x = (short)(path[k] % bufferStride);
+		points[pointCount++].y = (short)(path[k] / bufferStride);
+	}
+
+	pointCount = douglasPeucker(points, pointCount, 1.5, segmentEnds);
+
+	// Find where each of the points left is in path (they are in the same order)
+	for (int p = 0, k = first; p < pointCount; p++) {
+		const int i = (points[p].y * bufferStride) + points[p].x;
+		while (path[k] != i)
+			k++;
+		segmentEnds[p] = k;
+	}
+
+	const int startPixel = (((path[first] / bufferStride) - 1) * w) + (path[first] % bufferStride) - 1,
+		polygon = polygonFound(polygonTable, points, pointCount, 0, 0, startPixel, -1, 0);
+	if (polygon < 0)
+		return 0;
+
+	unsigned char* const radius = polygonTable->radius + polygonTable->firstPoint[polygon];
+	for (int p = 0; p < pointCount - 1; p++) {
+		int d = 255;
+		for (int k = segmentEnds[p]; k <= segmentEnds[p + 1]; k++) {
+			if (d > distance[path[k]])
+				d = distance[path[k]];
+		}
+		// The walls must go from the center of the skeleton pixels to the outer
+		// edge of the last pixels of the stroke (distance counts from the center
+		// of the closest 0-pixel): radius = (d / 3) - 0.5, in quarters of a pixel
+		const int r = ((4 * d) - 6 + 1) / 3;
+		radius[p] = (unsigned char)((r < 2) ? 2 : r);
+	}
+	radius[pointCount - 1] = radius[pointCount - 2];
+
+	return 1;
+}
+
+static int extractCenterlines(ImageInfo* imageInfo, PolygonTable* polygonTable, int firstPolygon) {
+	// Turns the components whose outer borders are polygons from firstPolygon
+	// onwards into centerlines, provided they are thin enough to be brush
+	// strokes. Each component is thinned down to its skeleton, which is walked
+	// into polylines (refer to thinComponent() and walkSkeleton()), and the
+	// component's polygons (its outer border and its holes) are removed.
+	// buffer must contain the final results of processComponents(), and it is
+	// not changed. Returns the number of components turned into centerlines
+	// (the hierarchy must be rebuilt when it is not 0, refer to
+	// rebuildHierarchy()).
+	//
+	// Nothing else uses borderLabels, points and stack by now: the last
+	// pixelCount bytes of points hold the distances (the rest of points holds
+	// the points of each polyline), borderLabels holds the marks, and stack
+	// holds the pixels of the component, followed by the current path and by
+	// the segment ends used by douglasPeucker().
+	const int w = imageInfo->width,
+		h = imageInfo->height,
+		bufferStride = w + 2,
+		stackCapacity = imageInfo->pixelCount,
+		polygonCount = polygonTable->polygonCount,
+		neighborOffsets[8] = { -bufferStride, -bufferStride + 1, 1, bufferStride + 1, bufferStride, bufferStride - 1, -1, -bufferStride - 1 };
+	const unsigned char* const buffer = imageInfo->buffer;
+	unsigned char* const distance = (unsigned char*)imageInfo->borderLabels - imageInfo->pixelCount;
+	unsigned short* const marks = imageInfo->borderLabels;
+	int* const stack = imageInfo->stack;
+	Point* const points = imageInfo->points;
+	const int pointCapacity = (int)((distance - (unsigned char*)points) / sizeof(Point));
+	int* const startPixel = polygonTable->startPixel;
+	ImageProcessingStats* const stats = &(imageInfo->stats);
+	int componentCount = 0;
+
+	centerlineDistances(w, h, buffer, distance);
+	memset(marks, 0, bufferStride * (h + 2) * sizeof(unsigned short));
+
+	for (int polygon = firstPolygon; polygon < polygonCount; polygon++) {
+		if (polygonTable->hole[polygon] || polygonTable->radius[polygonTable->firstPoint[polygon]])
+			continue;
+
+		// Gather all pixels of the component (4-connected, just like in
+		// labelComponents()), and find how thick it is
+		const int start = startPixel[polygon];
+		int pixelCount = 1, maxDistance = 0, firstIndex, lastIndex;
+		stack[0] = (((start / w) + 1) * bufferStride) + (start % w) + 1;
+		marks[stack[0]] = CenterlineForeground;
+		firstIndex = stack[0];
+		lastIndex = stack[0];
+		for (int k = 0; k < pixelCount; k++) {
+			const int i = stack[k];
+			if (maxDistance < distance[i])
+				maxDistance = distance[i];
+			if (firstIndex > i)
+				firstIndex = i;
+			if (lastIndex < i)
+				lastIndex = i;
+			for (int n = 0; n < 8; n += 2) {
+				const int j = i + neighborOffsets[n];
+				if (buffer[j] && !marks[j]) {
+					marks[j] = CenterlineForeground;
+					stack[pixelCount++] = j;
+				}
+			}
+		}
+
+		if (maxDistance > MaxCenterlineDistance) {
+			for (int k = 0; k < pixelCount; k++)
+				marks[stack[k]] = CenterlineDone;
+			continue;
+		}
+
+		// thinComponent() goes through all pixels several times, looking at
+		// their neighbors, which is a lot faster with the pixels in the same
+		// order as in memory, rather than in the order they were found (small
+		// components fit in the cache either way, and are not worth it)
+		if (pixelCount >= 4096 && (lastIndex - firstIndex) <= (pixelCount << 3)) {
+			pixelCount = 0;
+			for (int i = firstIndex; i <= lastIndex; i++) {
+				if (marks[i] == CenterlineForeground)
+					stack[pixelCount++] = i;
+			}
+		}
+
+		const int skeletonCount = thinComponent(neighborOffsets, distance, maxDistance, marks, stack, pixelCount),
+			pathCapacity = (((stackCapacity - skeletonCount) >> 1) < pointCapacity ? ((stackCapacity - skeletonCount) >> 1) : pointCapacity);
+		int* const path = stack + skeletonCount;
+		int* const segmentEnds = path + pathCapacity;
+		int centerlineCount = 0;
+
+		// Start at the tips of the skeleton, so that most polylines go from one
+		// end of a stroke to the other, and only then walk whatever is left
+		// (loops, and the parts between two junctions)
+		for (int tipsOnly = 1; tipsOnly >= 0 && pathCapacity > 3; tipsOnly--) {
+			for (int k = 0; k < skeletonCount; k++) {
+				const int i = stack[k];
+				if (marks[i] != CenterlineForeground || (tipsOnly && skeletonNeighborCount(i, neighborOffsets, marks) > 1))
+					continue;
+				int first, last;
+				// Walks of 1 or 2 pixels are just small bumps along the stroke,
+				// which are already covered by the polylines around them
+				if (walkSkeleton(i, neighborOffsets, distance, marks, path, pathCapacity, &first, &last) >= 3)
+					centerlineCount += addCenterline(polygonTable, w, bufferStride, distance, path, first, last, points, segmentEnds);
+			}
+		}
+
+		for (int k = 0; k < skeletonCount; k++)
+			marks[stack[k]] = CenterlineDone;
+
+		if (!centerlineCount)
+			continue;
+
+		// Remove the outer border of the component, along with its holes
+		startPixel[polygon] = -1;
+		for (int hole = polygon + 1; hole < polygonCount; hole++) {
+			if (polygonTable->hole[hole] && polygonTable->parent[hole] == polygon)
+				startPixel[hole] = -1;
+		}
+
+		componentCount++;
+		profileCount(stats, centerlineCount, centerlineCount);
+	}
+
+	profileCount(stats, centerlineComponentCount, componentCount);
+
+	if (!componentCount)
+		return 0;
+
+	int* const firstPoint = polygonTable->firstPoint;
+	short* const tablePoints = polygonTable->points;
+	unsigned char* const radius = polygonTable->radius;
+	int keptPolygonCount = firstPolygon, keptPointCount = firstPoint[firstPolygon];
+	for (int p = firstPolygon; p < polygonTable->polygonCount; p++) {
+		if (startPixel[p] < 0)
+			continue;
+		const int first = firstPoint[p], pointCount = firstPoint[p + 1] - first;
+		if (first != keptPointCount) {
+			memmove(tablePoints + (keptPointCount << 1), tablePoints + (first << 1), pointCount * 2 * sizeof(short));
+			memmove(radius + keptPointCount, radius + first, pointCount);
+		}
+		firstPoint[keptPolygonCount] = keptPointCount;
+		startPixel[keptPolygonCount] = startPixel[p];
+		polygonTable->parent[keptPolygonCount] = polygonTable->parent[p];
+		polygonTable->hole[keptPolygonCount] = polygonTable->hole[p];
+		keptPolygonCount++;
+		keptPointCount += pointCount;
+	}
+	polygonTable->polygonCount = keptPolygonCount;
+	polygonTable->pointCount = keptPointCount;
+	firstPoint[keptPolygonCount] = keptPointCount;
+
+	return componentCount;
+}
+
+static int repaintImage(ImageInfo* imageInfo) {
+	const int w = imageInfo->width,
+		h = imageInfo->height,
+		bufferStride = w + 2;
+	unsigned char* const data = imageInfo->data;
+	const unsigned char* const buffer = imageInfo->buffer;
 
 	int maxY = 0;
-	for (i = (h * bufferStride) + w; i >= 0; i--) {
+	for (int i = (h * bufferStride) + w; i >= 0; i--) {
 		if (buffer[i]) {
 			maxY = ((i / bufferStride) | 0) - 1;
 			break;
@@ -560,41 +1753,688 @@ int processImage(ImageInfo* imageInfo) {
 
 	// Erase everything that has not been used, and paint a border
 	// around what has been used.
-	const int wMinus1 = w - 1, hMinus1 = h - 1, bufferStride2 = bufferStride << 1;
-	for (i = dataLength - 4, y = h - 1; y >= 0; y--) {
-		j = ((y + 1) * bufferStride) + w;
-		for (x = wMinus1; x >= 0; x--, i -= 4, j--) {
-			if (!buffer[j]) {
-				data[i] = 0;
-				data[i + 1] = 0;
-				data[i + 2] = 0;
-				data[i + 3] = 0;
-			} else if (buffer[j] == 3 && (
-				// Always paint outer pixels
-				!buffer[j - 1] || !buffer[j + 1] || !buffer[j - bufferStride] || !buffer[j + bufferStride] ||
-				// Paint the inner pixels only if they are a part of what appears to be
-				// the intersection of two longer lines
-				(
-					(
-						// Does the pixel have at least two traced pixels to the left or to the right?
-						(x > 1 && buffer[j - 1] == 3 && buffer[j - 2] == 3) ||
-						(x < wMinus1 && buffer[j + 1] == 3 && buffer[j + 2] == 3)
-					)
-					&&
-					(
-						// If so, does it have at least two traced pixels above or below it?
-						(y > 1 && buffer[j - bufferStride] == 3 && buffer[j - bufferStride2] == 3) ||
-						(y < hMinus1 && buffer[j + bufferStride] == 3 && buffer[j + bufferStride2] == 3)
-					)
-				)
-				)) {
-				data[i] = data[i] >> 1;
-				data[i + 1] = data[i + 1] >> 1;
-				data[i + 2] = data[i + 2] >> 1;
-				data[i + 3] = 255;
+	for (int y = 0; y < h; y++)
+		repaintRow(data + ((y * w) << 2), buffer, y, w, h, bufferStride);
+
+	return maxY;
+}
+
+static void rebuildHierarchy(ImageInfo* imageInfo, PolygonTable* polygonTable) {
+	// Follows all borders of the entire buffer once again, without changing
+	// it, just to find the parent of every polygon in polygonTable (the
+	// polygons traced inside regionBuffer cannot see the components around
+	// the region, and the indices of the polygons kept by processImageRegion()
+	// may have changed). Borders are numbered exactly like processComponents()
+	// does, and the start pixel of each border leads to its polygon.
+	const int w = imageInfo->width,
+		h = imageInfo->height,
+		bufferStride = w + 2,
+		polygonCount = polygonTable->polygonCount,
+		maxBorders = maxBorderCount(imageInfo->pixelCount),
+		cwNeighborOffsets4[4] = { -bufferStride, 1, bufferStride, -1 };
+	unsigned char* const buffer = imageInfo->buffer;
+	const int* const startPixel = polygonTable->startPixel;
+	unsigned short* const borderLabels = imageInfo->borderLabels;
+	int* const stack = imageInfo->stack;
+	// Nothing is traced here, so points can hold the path of each border (only
+	// needed for very small holes), followed by borders
+	int* const path = (int*)imageInfo->points;
+	const int pathCapacity = SmallHoleBorderLength;
+	int* const borders = path + SmallHoleBorderLength;
+
+	// stack maps the start pixel of each polygon to the polygon itself (its
+	// other entries do not need to be cleared, as all entries are validated
+	// against startPixel before being used). Centerlines do not follow any
+	// borders, so they are left out of the hierarchy.
+	for (int p = 0; p < polygonCount; p++) {
+		const int start = startPixel[p];
+		if (!polygonTable->radius[polygonTable->firstPoint[p]])
+			stack[((((start / w) | 0) + 1) * bufferStride) + (start % w) + 1] = p;
+		else
+			polygonTable->hole[p] = 0;
+		polygonTable->parent[p] = -1;
+	}
+
+	memset(borderLabels, 0, bufferStride * (h + 2) * sizeof(unsigned short));
+	int borderCount = 1;
+	borders[0] = 1;
+	borders[1] = -1;
+
+	for (int y = 1; y <= h; y++) {
+		int i = (y * bufferStride) + 1, lastBorder = 0;
+		for (int x = 1; x <= w; x++, i++) {
+			if (!buffer[i])
+				continue;
+
+			int hole = -1;
+			if (!buffer[i - 1] && !borderLabels[i]) {
+				hole = 0;
+			} else if (!buffer[i + 1] && !(borderLabels[i] & BorderRightExamined)) {
+				hole = 1;
+				if (borderLabels[i])
+					lastBorder = (borderLabels[i] & BorderNumberMask);
+			}
+
+			if (hole >= 0) {
+				const int border = newBorder(borders, &borderCount, maxBorders, hole, lastBorder),
+					pathLength = followBorder(i, hole, cwNeighborOffsets4, buffer, bufferStride, borderLabels, border, path, pathCapacity, 0, 0, 0),
+					p = stack[i];
+				if (p >= 0 && p < polygonCount && startPixel[p] == ((y - 1) * w) + x - 1 && !polygonTable->radius[polygonTable->firstPoint[p]]) {
+					polygonTable->parent[p] = borders[((borders[border << 1] >> 1) << 1) + 1];
+					polygonTable->hole[p] = (unsigned char)hole;
+					borders[(border << 1) + 1] = p;
+				} else if (hole && pathLength <= SmallHoleBorderLength) {
+					releaseBorder(borders, &borderCount, borderLabels, path, pathLength, border);
+				}
+			}
+
+			if (borderLabels[i])
+				lastBorder = (borderLabels[i] & BorderNumberMask);
+		}
+	}
+}
+
+static int processWholeImage(ImageInfo* imageInfo, PolygonTable* polygonTable, int cacheEnabled) {
+	const int w = imageInfo->width,
+		h = imageInfo->height;
+	unsigned char* const buffer = imageInfo->buffer;
+	ImageProcessingStats* const stats = &(imageInfo->stats);
+
+	memset(stats, 0, sizeof(ImageProcessingStats));
+	clearPolygonTable(polygonTable);
+	profileStart(totalStart);
+	profileStart(binarizeStart);
+	traceBegin(processImage);
+	traceBegin(binarize);
+
+	binarizeImage(imageInfo);
+
+	// The same binarized image always produces the same polygons and the same
+	// final buffer, so they can come straight from the cache, if available
+	// (centerlines produce different results from the same image)
+	const uint64_t hash = (cacheEnabled ? (hashImageBuffer(buffer, imageInfo->pixelCount) ^ (uint64_t)imageInfo->centerlines) : 0);
+
+	profileEnd(binarizeStart, stats, binarizeMilliseconds);
+	traceEnd(binarize, "image");
+
+	if (!cacheEnabled || !imageCacheLoad(hash, w, h, polygonTable, buffer, imageInfo->pixelCount)) {
+		erase1Image(imageInfo, w, h, buffer);
+		processComponents(imageInfo, polygonTable, w, h, buffer, 0, 0);
+
+		if (imageInfo->centerlines) {
+			profileStart(centerlineStart);
+			traceBegin(centerlines);
+
+			if (extractCenterlines(imageInfo, polygonTable, 0))
+				rebuildHierarchy(imageInfo, polygonTable);
+
+			profileEnd(centerlineStart, stats, centerlineMilliseconds);
+			traceEnd(centerlines, "image");
+		}
+
+		if (cacheEnabled)
+			imageCacheStore(hash, w, h, polygonTable, buffer, imageInfo->pixelCount);
+	}
+
+	profileStart(repaintStart);
+	traceBegin(repaint);
+
+	const int maxY = repaintImage(imageInfo);
+
+	profileEnd(repaintStart, stats, repaintMilliseconds);
+	profileEnd(totalStart, stats, totalMilliseconds);
+	traceEnd(repaint, "image");
+	traceEnd(processImage, "image");
+
+	return maxY;
+}
+
+int processImage(ImageInfo* imageInfo, PolygonTable* polygonTable) {
+	return processWholeImage(imageInfo, polygonTable, imageCacheIsEnabled());
+}
+
+struct ImageBatchStructure {
+	int threadCount, centerlines;
+	ImageBatchJob* jobs;
+	int jobCount, nextJob;
+	// One ImageInfo per thread, reused by all jobs that thread takes (refer to
+	// processImageBatch())
+	ImageInfo* workers[maxThreadPoolThreadCount];
+};
+
+ImageBatch* allocateImageBatch(int threadCount, int centerlines) {
+	ImageBatch* const imageBatch = (ImageBatch*)allocateMemory(sizeof(ImageBatch), MemoryImage);
+	if (!imageBatch)
+		return 0;
+
+	memset(imageBatch, 0, sizeof(ImageBatch));
+	imageBatch->threadCount = ((threadCount < 1) ? 1 : ((threadCount > maxThreadPoolThreadCount) ? maxThreadPoolThreadCount : threadCount));
+	imageBatch->centerlines = (centerlines ? 1 : 0);
+	return imageBatch;
+}
+
+void freeImageBatch(ImageBatch* imageBatch) {
+	if (!imageBatch)
+		return;
+
+	for (int i = 0; i < maxThreadPoolThreadCount; i++)
+		freeImageInfo(imageBatch->workers[i]);
+	freeMemory(imageBatch);
+}
+
+static void processImageBatchJobs(void* argument, int index) {
+	// Each task is one worker, which keeps taking the next job until there
+	// are no more of them, so the jobs are balanced among the threads even
+	// when the images have very different sizes and contents
+	ImageBatch* const imageBatch = (ImageBatch*)argument;
+	ImageInfo* const imageInfo = imageBatch->workers[index];
+
+	for (;;) {
+		const int j = __atomic_fetch_add(&(imageBatch->nextJob), 1, __ATOMIC_RELAXED);
+		if (j >= imageBatch->jobCount)
+			break;
+
+		ImageBatchJob* const job = &(imageBatch->jobs[j]);
+		const size_t dataSize = ((size_t)job->width * (size_t)job->height) << 2;
+
+		// processImageBatch() makes the workers as large as the largest job,
+		// but fail the job (maxY remains -1) should that ever not be the case
+		if (!resizeImageInfo(imageInfo, job->width, job->height))
+			continue;
+
+		memcpy(imageInfo->data, job->data, dataSize);
+		job->maxY = processWholeImage(imageInfo, job->polygonTable, 0);
+		memcpy(job->data, imageInfo->data, dataSize);
+	}
+}
+
+int processImageBatch(ImageBatch* imageBatch, ImageBatchJob* jobs, int jobCount) {
+	// Processes all images concurrently (one per thread, with up to threadCount
+	// threads), producing the same results processImage() would, for each one
+	// of them. Each thread has its own ImageInfo, which is only reallocated
+	// when a job larger than all previous ones comes along, so importing lots
+	// of drawings does not allocate an ImageInfo per drawing.
+	//
+	// Everything that is not thread-safe happens on the calling thread: all
+	// allocations are made before the jobs start (refer to lib/memory.c), the
+	// image cache is not used, and no trace events are recorded by the jobs.
+	// Returns the number of threads used, or 0 when not even one ImageInfo
+	// could be allocated (in which case maxY is -1 in all jobs).
+	traceBegin(processImageBatch);
+
+	size_t largestSize = 0;
+	int largestJob = -1;
+	for (int j = 0; j < jobCount; j++) {
+		const size_t size = layoutImageInfo(0, jobs[j].width, jobs[j].height);
+		if (largestSize < size) {
+			largestSize = size;
+			largestJob = j;
+		}
+		jobs[j].maxY = -1;
+	}
+
+	int workerCount = ((jobCount < imageBatch->threadCount) ? jobCount : imageBatch->threadCount);
+	for (int i = 0; i < workerCount; i++) {
+		ImageInfo* imageInfo = imageBatch->workers[i];
+		if (!imageInfo || imageInfo->size < largestSize) {
+			// Free the old one first, as both might not fit at the same time
+			freeImageInfo(imageInfo);
+			imageInfo = allocateImageInfo(jobs[largestJob].width, jobs[largestJob].height);
+			imageBatch->workers[i] = imageInfo;
+			if (!imageInfo) {
+				// Just use the threads that could be given an ImageInfo
+				workerCount = i;
+				break;
 			}
+			imageInfo->centerlines = imageBatch->centerlines;
 		}
 	}
 
+	if (workerCount) {
+		imageBatch->jobs = jobs;
+		imageBatch->jobCount = jobCount;
+		imageBatch->nextJob = 0;
+
+		// traceAdd() is not thread-safe
+		const int tracing = traceIsRecording();
+		if (tracing)
+			tracePause();
+
+		threadPoolRun(processImageBatchJobs, imageBatch, workerCount, workerCount);
+
+		if (tracing)
+			traceResume();
+
+		imageBatch->jobs = 0;
+	}
+
+	traceEnd(processImageBatch, "image");
+
+	return workerCount;
+}
+
+// Rows of cells marched by each call to cpMarchSoft() or cpMarchHard() (refer
+// to processImageMarch())
+#define MarchRowCount 16
+
+typedef struct MarchSamplerStructure {
+	const unsigned char* buffer;
+	int bufferStride;
+} MarchSampler;
+
+static cpFloat marchSample(cpVect point, void* data) {
+	// The samples are taken exactly at the center of each pixel of buffer
+	// (rounding only fixes the errors from cpflerp())
+	const MarchSampler* const sampler = (const MarchSampler*)data;
+	return (sampler->buffer[((int)(point.y + (cpFloat)0.5) * sampler->bufferStride) + (int)(point.x + (cpFloat)0.5)] ? (cpFloat)1 : (cpFloat)0);
+}
+
+static void marchSegment(cpVect v0, cpVect v1, void* data) {
+	cpPolylineSetCollectSegment(v0, v1, (cpPolylineSet*)data);
+}
+
+static int marchPolyline(PolygonTable* polygonTable, int w, int h, const cpPolyline* line, Point* points) {
+	// Turns a simplified loop, in buffer coordinates, into a polygon. The
+	// loops go around the edges of the pixels, while the walls created by
+	// initFromPolygonTable() are supposed to go through the centers of the
+	// pixels along the borders (refer to trace4()), so each point is moved half
+	// a pixel towards the solid side, before being rounded. Solid pixels are
+	// always to the left of the segments created by cpMarchSoft() and
+	// cpMarchHard(), so outer borders are counterclockwise (with y pointing
+	// upwards), and holes are clockwise. Returns -1 when the loop is too small
+	// to be worth a polygon, or the polygon otherwise.
+	const int count = line->count - 1; // The last vertex repeats the first one
+	const cpVect* const verts = line->verts;
+	if (count < 3)
+		return -1;
+
+	cpFloat area = 0;
+	for (int i = 0; i < count; i++)
+		area += cpvcross(verts[i], verts[i + 1]);
+	area *= (cpFloat)0.5;
+
+	// Very small holes cannot contain anything (just like in
+	// processComponents(), small components have already been erased)
+	const int hole = (area < 0);
+	if (hole && area > (cpFloat)-2)
+		return -1;
+
+	int pointCount = 0;
+	for (int i = 0; i < count; i++) {
+		const cpVect previous = verts[i ? (i - 1) : (count - 1)], current = verts[i], next = verts[i + 1],
+			normal = cpvadd(cpvnormalize(cpvperp(cpvsub(current, previous))), cpvnormalize(cpvperp(cpvsub(next, current)))),
+			v = cpvadd(current, cpvmult(cpvnormalize(normal), (cpFloat)0.5));
+		int x = (int)cpffloor(v.x + (cpFloat)0.5), y = (int)cpffloor(v.y + (cpFloat)0.5);
+		x = ((x < 1) ? 1 : ((x > w) ? w : x));
+		y = ((y < 1) ? 1 : ((y > h) ? h : y));
+		if (pointCount && points[pointCount - 1].x == x && points[pointCount - 1].y == y)
+			continue;
+		points[pointCount].x = (short)x;
+		points[pointCount++].y = (short)y;
+	}
+	while (pointCount > 1 && points[pointCount - 1].x == points[0].x && points[pointCount - 1].y == points[0].y)
+		pointCount--;
+	if (pointCount < 2)
+		return -1;
+
+	// The contour hierarchy is not available (parent is always -1)
+	return polygonFound(polygonTable, points, pointCount, 0, 0, ((points[0].y - 1) * w) + points[0].x - 1, -1, hole);
+}
+
+int processImageMarch(ImageInfo* imageInfo, PolygonTable* polygonTable, int soft) {
+	// Alternative to processImage(), which produces the same image, but finds
+	// the polygons using marching squares (cpMarchSoft(), or cpMarchHard()
+	// when soft is 0), instead of following the borders of each component.
+	// The segments are joined into loops by cpPolylineSetCollectSegment(),
+	// and simplified by cpPolylineSimplifyCurves(), with the same tolerance
+	// used by trace4(). With cpMarchSoft(), the staircases along diagonal
+	// borders become straight lines, so the same tolerance needs fewer
+	// points. Neither the image cache, nor centerlines are used, and the
+	// resulting polygons cannot be passed to processImageRegion().
+	const int w = imageInfo->width,
+		h = imageInfo->height,
+		bufferStride = w + 2;
+	unsigned char* const buffer = imageInfo->buffer;
+	Point* const points = imageInfo->points;
+	ImageProcessingStats* const stats = &(imageInfo->stats);
+
+	memset(stats, 0, sizeof(ImageProcessingStats));
+	clearPolygonTable(polygonTable);
+	profileStart(totalStart);
+	profileStart(binarizeStart);
+	traceBegin(processImageMarch);
+	traceBegin(binarize);
+
+	binarizeImage(imageInfo);
+
+	profileEnd(binarizeStart, stats, binarizeMilliseconds);
+	traceEnd(binarize, "image");
+
+	erase1Image(imageInfo, w, h, buffer);
+
+	profileStart(labelStart);
+	traceBegin(label);
+
+	labelComponents(w, h, buffer, bufferStride, imageInfo->stack, imageInfo->labels);
+
+	// Only the pixels of components with more than 10 pixels have been
+	// painted by labelComponents(), so everything else can be erased at once
+	for (int i = bufferStride * (h + 1); i >= bufferStride; i--) {
+		const unsigned char pixel = buffer[i];
+		if (pixel == ComponentStart) {
+			profileCount(stats, componentCount, 1);
+			buffer[i] = 2;
+		} else if (pixel != 2) {
+			if (pixel == SmallComponentStart) {
+				profileCount(stats, componentCount, 1);
+				profileCount(stats, smallComponentCount, 1);
+			}
+			buffer[i] = 0;
+		}
+	}
+
+	profileEnd(labelStart, stats, labelMilliseconds);
+	traceEnd(label, "image");
+	traceBegin(march);
+
+	MarchSampler sampler;
+	sampler.buffer = buffer;
+	sampler.bufferStride = bufferStride;
+
+	// cpPolylineSetCollectSegment() looks for the polylines each segment
+	// touches by going through all polylines in the set, so the image is
+	// marched a few rows at a time, and the loops closed along the way are
+	// taken out of the set, leaving only the polylines that are still open
+	// (the first and last rows of samples of each call are integers, so the
+	// vertices along the row shared by two calls come out exactly the same).
+	cpPolylineSet lines;
+	cpPolylineSetInit(&lines);
+	for (int y = 0; y <= h; y += MarchRowCount) {
+		profileStart(marchStart);
+
+		const int rowCount = (((h + 1 - y) < MarchRowCount) ? (h + 1 - y) : MarchRowCount);
+		(soft ? cpMarchSoft : cpMarchHard)(cpBBNew(0, (cpFloat)y, (cpFloat)(w + 1), (cpFloat)(y + rowCount)), (unsigned long)bufferStride, (unsigned long)(rowCount + 1), (cpFloat)0.5, marchSegment, &lines, marchSample, &sampler);
+
+		profileEnd(marchStart, stats, marchMilliseconds);
+		profileStart(douglasPeuckerStart);
+
+		for (int i = lines.count - 1; i >= 0; i--) {
+			cpPolyline* const line = lines.lines[i];
+			if (!cpPolylineIsClosed(line))
+				continue;
+			lines.lines[i] = lines.lines[--lines.count];
+
+			cpPolyline* const simplifiedLine = cpPolylineSimplifyCurves(line, (cpFloat)1.5);
+			const int polygon = marchPolyline(polygonTable, w, h, simplifiedLine, points);
+			cpPolylineFree(simplifiedLine);
+			cpPolylineFree(line);
+			if (polygon >= 0) {
+				profileCount(stats, holeCount, polygonTable->hole[polygon]);
+				profileCount(stats, polygonCount, 1);
+				profileCount(stats, pointCount, polygonTable->firstPoint[polygon + 1] - polygonTable->firstPoint[polygon]);
+			}
+		}
+
+		profileEnd(douglasPeuckerStart, stats, douglasPeuckerMilliseconds);
+	}
+
+	// The image is surrounded by 0-pixels, so all polylines have been closed
+	cpPolylineSetDestroy(&lines, cpTrue);
+
+	traceEnd(march, "image");
+	profileStart(repaintStart);
+	traceBegin(repaint);
+
+	// Mark the pixels with at least one 0-pixel among their 8 neighbors, which
+	// are exactly the ones trace4() would have marked, so that repaintImage()
+	// produces the same image processImage() does
+	for (int y = 1; y <= h; y++) {
+		for (int x = 1, i = (y * bufferStride) + 1; x <= w; x++, i++) {
+			if (buffer[i] && (!buffer[i - 1] || !buffer[i + 1] || !buffer[i - bufferStride] || !buffer[i + bufferStride] || !buffer[i - bufferStride - 1] || !buffer[i - bufferStride + 1] || !buffer[i + bufferStride - 1] || !buffer[i + bufferStride + 1]))
+				buffer[i] = 3;
+		}
+	}
+
+	const int maxY = repaintImage(imageInfo);
+
+	profileEnd(repaintStart, stats, repaintMilliseconds);
+	profileEnd(totalStart, stats, totalMilliseconds);
+	traceEnd(repaint, "image");
+	traceEnd(processImageMarch, "image");
+
+	return maxY;
+}
+
+// Helpers used by processImageRegion() (X and Y are buffer coordinates)
+#define isOpaque(X, Y) (data[(((((Y) - 1) * w) + (X) - 1) << 2) + 3] == 255)
+#define isMarked(X, Y) ((mask[((Y) * maskWordsPerRow) + ((X) >> 6)] >> ((X) & 63)) & 1)
+#define mark(X, Y) (mask[((Y) * maskWordsPerRow) + ((X) >> 6)] |= ((uint64_t)1 << ((X) & 63)))
+
+int processImageRegion(ImageInfo* imageInfo, PolygonTable* polygonTable, int regionX, int regionY, int regionWidth, int regionHeight) {
+	// imageInfo->buffer and polygonTable must contain the results of the last
+	// call to processImage()/processImageRegion() (either because the same
+	// imageInfo is being used, or because they have been restored by the
+	// caller, refer to getImageInfoBuffer()), and data must contain the entire
+	// new image, which must differ from the previous one only inside the given
+	// region.
+	//
+	// A component with no pixels 8-connected to the region produces exactly
+	// the same polygons it did before:
+	// - binarization, erase1() and labelComponents() only look at each pixel
+	// and at its 8 neighbors, which are either 0-pixels or pixels of the same
+	// component;
+	// - followBorder() only moves between the 1-pixels of the component, and
+	// only reads the 4 neighbors of each one of them (0-pixels behave as
+	// 8-connected because of the order in which those 4 neighbors are
+	// examined, not because the diagonal ones are read), so every pixel it
+	// reads is outside the region;
+	// - the only borderLabels that decide whether a hole border starts at a
+	// pixel (BorderRightExamined) are those written while following the other
+	// borders of the same component, since a border only passes through the
+	// pixels of its own component;
+	// - the rest of borderLabels (the border numbers, LNBD in Suzuki and Abe)
+	// only decide the parents of the polygons, which rebuildHierarchy() finds
+	// again for all of them anyway.
+	// So, only the components 8-connected to the region are processed again,
+	// inside regionBuffer, which is just large enough to hold all of them.
+	// Their relative raster order is also preserved inside regionBuffer, which
+	// means the new polygons are exactly the ones processImage() would produce
+	// (they are just appended to polygonTable in a different order).
+	const int w = imageInfo->width,
+		h = imageInfo->height,
+		bufferStride = w + 2,
+		maskWordsPerRow = (bufferStride + 63) >> 6;
+	const unsigned char* const data = imageInfo->data;
+	unsigned char* const buffer = imageInfo->buffer;
+	unsigned char* const regionBuffer = imageInfo->regionBuffer;
+	uint64_t* const mask = imageInfo->mask;
+	int* const stack = imageInfo->stack;
+	ImageProcessingStats* const stats = &(imageInfo->stats);
+
+	memset(stats, 0, sizeof(ImageProcessingStats));
+	profileStart(totalStart);
+	profileStart(binarizeStart);
+	traceBegin(processImageRegion);
+	traceBegin(binarize);
+
+	// The region, in buffer coordinates, expanded by 1 pixel on each side
+	// (the pixels around the region could have been connected to it)
+	const int dirtyX0 = (regionX < 1 ? 1 : regionX),
+		dirtyY0 = (regionY < 1 ? 1 : regionY),
+		dirtyX1 = ((regionX + regionWidth + 1) > w ? w : (regionX + regionWidth + 1)),
+		dirtyY1 = ((regionY + regionHeight + 1) > h ? h : (regionY + regionHeight + 1)),
+		dirty = (regionWidth > 0 && regionHeight > 0 && dirtyX0 <= dirtyX1 && dirtyY0 <= dirtyY1);
+	const int maxRegionArea = maxImageRegionArea(w, h);
+	int x0 = w + 1, y0 = h + 1, x1 = 0, y1 = 0, stackSize = 0;
+
+	// Mark (and flood fill) all opaque pixels 8-connected to the region,
+	// finding the bounding box of everything that must be processed again.
+	// Just like floodFill(), only one pixel is pushed per run of opaque
+	// pixels (the seed of the run), which is marked as soon as it is pushed.
+	memset(mask, 0, maskWordsPerRow * (h + 2) * sizeof(uint64_t));
+	if (dirty) {
+		x0 = dirtyX0;
+		y0 = dirtyY0;
+		x1 = dirtyX1;
+		y1 = dirtyY1;
+		for (int y = dirtyY0; y <= dirtyY1; y++) {
+			int inRun = 0;
+			for (int x = dirtyX0; x <= dirtyX1; x++) {
+				if (!isOpaque(x, y)) {
+					inRun = 0;
+				} else if (!inRun) {
+					inRun = 1;
+					mark(x, y);
+					stack[stackSize++] = (y * bufferStride) + x;
+				}
+			}
+		}
+	}
+
+	while (stackSize) {
+		const int i = stack[--stackSize], x = i % bufferStride, y = i / bufferStride;
+		int left = x, right = x;
+		while (left > 1 && !isMarked(left - 1, y) && isOpaque(left - 1, y)) {
+			left--;
+			mark(left, y);
+		}
+		while (right < w && !isMarked(right + 1, y) && isOpaque(right + 1, y)) {
+			right++;
+			mark(right, y);
+		}
+		if (x0 > left)
+			x0 = left;
+		if (x1 < right)
+			x1 = right;
+		if (y0 > y)
+			y0 = y;
+		if (y1 < y)
+			y1 = y;
+		if (((x1 - x0 + 1) * (y1 - y0 + 1)) > maxRegionArea)
+			break;
+		// Diagonal neighbors are also connected to the run
+		const int nx0 = (left > 1 ? (left - 1) : 1), nx1 = (right < w ? (right + 1) : w);
+		for (int ny = y - 1; ny <= y + 1; ny += 2) {
+			if (ny < 1 || ny > h)
+				continue;
+			int inRun = 0;
+			for (int nx = nx0; nx <= nx1; nx++) {
+				if (isMarked(nx, ny) || !isOpaque(nx, ny)) {
+					inRun = 0;
+				} else if (!inRun) {
+					inRun = 1;
+					mark(nx, ny);
+					stack[stackSize++] = (ny * bufferStride) + nx;
+				}
+			}
+		}
+	}
+
+	if (((x1 - x0 + 1) * (y1 - y0 + 1)) > maxRegionArea) {
+		traceEnd(binarize, "image");
+		traceEnd(processImageRegion, "image");
+		return processImage(imageInfo, polygonTable);
+	}
+
+	// Remove the polygons that will be traced again (the pixel where a polygon
+	// has been found always belongs to its component, and parent/hole are left
+	// to rebuildHierarchy())
+	int* const firstPoint = polygonTable->firstPoint;
+	short* const tablePoints = polygonTable->points;
+	int* const startPixel = polygonTable->startPixel;
+	int keptPolygonCount = 0, keptPointCount = 0;
+	for (int p = 0; p < polygonTable->polygonCount; p++) {
+		const int start = startPixel[p], x = (start % w) + 1, y = (start / w) + 1;
+		if ((dirty && x >= dirtyX0 && x <= dirtyX1 && y >= dirtyY0 && y <= dirtyY1) || isMarked(x, y))
+			continue;
+		const int first = firstPoint[p], pointCount = firstPoint[p + 1] - first;
+		if (first != keptPointCount) {
+			memmove(tablePoints + (keptPointCount << 1), tablePoints + (first << 1), pointCount * 2 * sizeof(short));
+			memmove(polygonTable->radius + keptPointCount, polygonTable->radius + first, pointCount);
+		}
+		firstPoint[keptPolygonCount] = keptPointCount;
+		startPixel[keptPolygonCount] = start;
+		keptPolygonCount++;
+		keptPointCount += pointCount;
+	}
+	polygonTable->polygonCount = keptPolygonCount;
+	polygonTable->pointCount = keptPointCount;
+	polygonTable->keptPolygonCount = keptPolygonCount;
+	firstPoint[keptPolygonCount] = keptPointCount;
+
+	const int regionBufferWidth = x1 - x0 + 1, regionBufferHeight = y1 - y0 + 1,
+		regionBufferStride = regionBufferWidth + 2;
+
+	if (dirty) {
+		// Erase the previous results, and binarize only the marked pixels into
+		// regionBuffer (any other opaque pixels inside the bounding box belong
+		// to components that are not 8-connected to the region)
+		memset(regionBuffer, 0, regionBufferStride * (regionBufferHeight + 2));
+		for (int y = y0; y <= y1; y++) {
+			unsigned char* const regionRow = regionBuffer + ((y - y0 + 1) * regionBufferStride) + 1 - x0;
+			unsigned char* const row = buffer + (y * bufferStride);
+			for (int x = x0; x <= x1; x++) {
+				if (isMarked(x, y)) {
+					regionRow[x] = 1;
+					row[x] = 0;
+				} else if (x >= dirtyX0 && x <= dirtyX1 && y >= dirtyY0 && y <= dirtyY1) {
+					row[x] = 0;
+				}
+			}
+		}
+	}
+
+	profileEnd(binarizeStart, stats, binarizeMilliseconds);
+	traceEnd(binarize, "image");
+
+	if (dirty) {
+		erase1Image(imageInfo, regionBufferWidth, regionBufferHeight, regionBuffer);
+		processComponents(imageInfo, polygonTable, regionBufferWidth, regionBufferHeight, regionBuffer, x0 - 1, y0 - 1);
+
+		for (int y = y0; y <= y1; y++) {
+			const unsigned char* const regionRow = regionBuffer + ((y - y0 + 1) * regionBufferStride) + 1 - x0;
+			unsigned char* const row = buffer + (y * bufferStride);
+			for (int x = x0; x <= x1; x++) {
+				if (regionRow[x])
+					row[x] = regionRow[x];
+			}
+		}
+
+		// Only the new polygons can become centerlines (the ones kept were
+		// already turned into centerlines, if possible, by the previous call)
+		if (imageInfo->centerlines) {
+			profileStart(centerlineStart);
+			traceBegin(centerlines);
+
+			extractCenterlines(imageInfo, polygonTable, polygonTable->keptPolygonCount);
+
+			profileEnd(centerlineStart, stats, centerlineMilliseconds);
+			traceEnd(centerlines, "image");
+		}
+	}
+
+	profileStart(hierarchyStart);
+	traceBegin(hierarchy);
+
+	rebuildHierarchy(imageInfo, polygonTable);
+
+	profileEnd(hierarchyStart, stats, trace4Milliseconds);
+	traceEnd(hierarchy, "image");
+	profileStart(repaintStart);
+	traceBegin(repaint);
+
+	// The entire image must be repainted, because data has just been
+	// overwritten with the new image by the caller
+	const int maxY = repaintImage(imageInfo);
+
+	profileEnd(repaintStart, stats, repaintMilliseconds);
+	profileEnd(totalStart, stats, totalMilliseconds);
+	traceEnd(repaint, "image");
+	traceEnd(processImageRegion, "image");
+
 	return maxY;
 }
+
+#undef isOpaque
+#undef isMarked
+#undef mark
@@ -24,24 +24,124 @@
 // https://github.com/carlosrafaelgn/pixel
 //
 
-#include <emscripten.h>
 #include <stdlib.h>
 #include <memory.h>
+#ifndef __EMSCRIPTEN__
+#include <time.h>
+#endif
 
 #include "shared.h"
 
 unsigned char* alignBuffer(unsigned char* buffer, int skipCount) {
 	buffer += skipCount;
-	if ((((int)buffer) & 15))
-		buffer += 16 - (((int)buffer) & 15);
+	if ((((uintptr_t)buffer) & 15))
+		buffer += 16 - (((uintptr_t)buffer) & 15);
 	return buffer;
 }
 
+#ifndef __EMSCRIPTEN__
+double getTimeMilliseconds() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return ((double)t.tv_sec * 1000.0) + ((double)t.tv_nsec * 0.000001);
+}
+#endif
+
+static AllocationStats allocationStats;
+
+#if trackAllocations
+// Every allocation is preceded by this header, whose size keeps the
+// alignment of the pointers returned by malloc()/realloc() intact
+typedef union AllocationHeaderUnion {
+	struct {
+		size_t size;
+		int subsystem;
+	} info;
+	unsigned char alignment[16];
+} AllocationHeader;
+
+static void accountAllocation(size_t size, int subsystem) {
+	allocationStats.allocationCount[subsystem]++;
+	allocationStats.liveCount[subsystem]++;
+	allocationStats.liveBytes[subsystem] += (int)size;
+	if (allocationStats.peakBytes[subsystem] < allocationStats.liveBytes[subsystem])
+		allocationStats.peakBytes[subsystem] = allocationStats.liveBytes[subsystem];
+	allocationStats.totalLiveBytes += (int)size;
+	if (allocationStats.totalPeakBytes < allocationStats.totalLiveBytes)
+		allocationStats.totalPeakBytes = allocationStats.totalLiveBytes;
+}
+
+static void accountFree(size_t size, int subsystem) {
+	allocationStats.liveCount[subsystem]--;
+	allocationStats.liveBytes[subsystem] -= (int)size;
+	allocationStats.totalLiveBytes -= (int)size;
+}
+
+void* allocateMemory(size_t size, int subsystem) {
+	AllocationHeader* const header = (AllocationHeader*)malloc(sizeof(AllocationHeader) + size);
+	if (!header)
+		return 0;
+	header->info.size = size;
+	header->info.subsystem = subsystem;
+	accountAllocation(size, subsystem);
+	return header + 1;
+}
+
+void freeMemory(void* ptr) {
+	if (!ptr)
+		return;
+	AllocationHeader* const header = ((AllocationHeader*)ptr) - 1;
+	accountFree(header->info.size, header->info.subsystem);
+	free(header);
+}
+
+// Must be in sync with the CP_ALLOC_* categories in chipmunk.h
+static const int subsystemByCategory[] = { MemorySpace, MemoryArbiters, MemoryContacts, MemoryBBTree };
+
+void* cpAccountedCalloc(size_t count, size_t size, int category) {
+	size *= count;
+	void* const ptr = allocateMemory(size, subsystemByCategory[category]);
+	if (ptr)
+		memset(ptr, 0, size);
+	return ptr;
+}
+
+void* cpAccountedRealloc(void* ptr, size_t size) {
+	if (!ptr)
+		return allocateMemory(size, MemorySpace);
+	AllocationHeader* header = ((AllocationHeader*)ptr) - 1;
+	const size_t oldSize = header->info.size;
+	const int subsystem = header->info.subsystem;
+	header = (AllocationHeader*)realloc(header, sizeof(AllocationHeader) + size);
+	if (!header)
+		return 0;
+	accountFree(oldSize, subsystem);
+	// realloc() does not count as a new allocation
+	allocationStats.allocationCount[subsystem]--;
+	accountAllocation(size, subsystem);
+	header->info.size = size;
+	return header + 1;
+}
+
+void cpAccountedFree(void* ptr) {
+	freeMemory(ptr);
+}
+#endif
+
+AllocationStats* getAllocationStats() {
+	return &allocationStats;
+}
+
+void resetAllocationPeaks() {
+	memcpy(allocationStats.peakBytes, allocationStats.liveBytes, sizeof(allocationStats.peakBytes));
+	allocationStats.totalPeakBytes = allocationStats.totalLiveBytes;
+}
+
 void* allocateBuffer(int size) {
-	return malloc(size);
+	return allocateMemory(size, MemoryOther);
 }
 
 void freeBuffer(void* buffer) {
 	if (buffer)
-		free(buffer);
+		freeMemory(buffer);
 }
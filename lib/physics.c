@@ -32,7 +32,6 @@
 // https://github.com/slembcke/Chipmunk2D/tree/master/demo
 //
 
-#include <emscripten.h>
 #include <stdlib.h>
 #include <memory.h>
 
@@ -53,6 +52,7 @@ float smoothStepF(float input) {
 #endif
 
 cpBool beginCollision(cpArbiter* arb, struct cpSpace* space, cpDataPointer data) {
+	(void)data;
 	// For this handler type A is CollisionBall and type B is CollisionObject
 	cpShape* ball;
 	cpShape* object;
@@ -61,8 +61,8 @@ cpBool beginCollision(cpArbiter* arb, struct cpSpace* space, cpDataPointer data)
 	Level* const level = (Level*)cpSpaceGetUserData(space);
 	int* const objectDestroyedThisFrame = level->objectDestroyedThisFrame;
 	int* const objectVisibility = level->objectVisibility;
-	const int ballIndex = (int)cpShapeGetUserData(ball);
-	const int objectIndex = (int)cpShapeGetUserData(object);
+	const int ballIndex = (int)(intptr_t)cpShapeGetUserData(ball);
+	const int objectIndex = (int)(intptr_t)cpShapeGetUserData(object);
 
 	switch (level->objectType[objectIndex]) {
 		case TypeBomb:
@@ -100,7 +100,14 @@ cpBool beginCollision(cpArbiter* arb, struct cpSpace* space, cpDataPointer data)
 	}
 }
 
-Level* init(cpFloat height, cpFloat viewWidth, cpFloat viewHeight, int wallCount, const cpFloat* wallX0, const cpFloat* wallY0, const cpFloat* wallX1, const cpFloat* wallY1, int objectCount, const int* objectType, const cpFloat* objectX, const cpFloat* objectY, const cpFloat* objectRadius, int preview) {
+#if traceEvents
+static void traceSpaceStepPhase(const char* phase, double start, double end, void* data) {
+	(void)data;
+	traceAdd(phase, "chipmunk", start, end);
+}
+#endif
+
+static Level* allocateLevel(cpFloat height, cpFloat viewWidth, cpFloat viewHeight, int wallCount, int objectCount, const int* objectType, int preview) {
 	// For most of the structures you will use, Chipmunk uses a more or less standard and straightforward set of memory management functions. Take the cpSpace struct for example:
 	//
 	// cpSpaceNew() – Allocates and initializes a cpSpace struct. It calls cpSpaceAlloc() then cpSpaceInit().
@@ -156,7 +163,7 @@ Level* init(cpFloat height, cpFloat viewWidth, cpFloat viewHeight, int wallCount
 		(15 * 16) // for the alignment
 	;
 
-	unsigned char* buffer = malloc(bufferSize);
+	unsigned char* buffer = (unsigned char*)allocateMemory(bufferSize, MemoryLevel);
 	memset(buffer, 0, bufferSize);
 
 	Level* const level = (Level*)alignBuffer(buffer, 0);
@@ -220,23 +227,30 @@ Level* init(cpFloat height, cpFloat viewWidth, cpFloat viewHeight, int wallCount
 	level->objectCount = objectCount;
 	level->preview = preview;
 	level->globalAlpha = 1.0f;
+	setLevelSeed(level, 1);
 	memcpy(level->firstIndexByType, firstIndexByType, sizeof(int) * TypeCount);
 	memcpy(level->countByType, countByType, sizeof(int) * TypeCount);
 
-	cpShape* shape;
-	cpBody* body;
-	cpBody* staticBody = cpSpaceGetStaticBody(space);
+	return level;
+}
 
-	for (int i = 0; i < wallCount; i++) {
-		shape = cpSegmentShapeNew(staticBody, cpv(wallX0[i] + (cpFloat)0.5, wallY0[i] + (cpFloat)0.5), cpv(wallX1[i] + (cpFloat)0.5, wallY1[i] + (cpFloat)0.5), (cpFloat)0.5);
+// The walls must be added before the objects (refer to addObjects())
+static void addWall(Level* level, int i, cpFloat x0, cpFloat y0, cpFloat x1, cpFloat y1, cpFloat radius) {
+	cpShape* const shape = cpSegmentShapeNew(cpSpaceGetStaticBody(level->space), cpv(x0 + (cpFloat)0.5, y0 + (cpFloat)0.5), cpv(x1 + (cpFloat)0.5, y1 + (cpFloat)0.5), radius);
 
-		cpShapeSetElasticity(shape, (cpFloat)0.5);
-		cpShapeSetFriction(shape, (cpFloat)0);
-		cpShapeSetCollisionType(shape, CollisionWall);
+	cpShapeSetElasticity(shape, (cpFloat)0.5);
+	cpShapeSetFriction(shape, (cpFloat)0);
+	cpShapeSetCollisionType(shape, CollisionWall);
 
-		cpSpaceAddShape(space, shape);
-		level->wall[i] = shape;
-	}
+	cpSpaceAddShape(level->space, shape);
+	level->wall[i] = shape;
+}
+
+static void addObjects(Level* level, int objectCount, const int* objectType, const cpFloat* objectX, const cpFloat* objectY, const cpFloat* objectRadius) {
+	cpSpace* const space = level->space;
+	cpShape* shape;
+	cpBody* body;
+	cpBody* staticBody = cpSpaceGetStaticBody(space);
 
 	memcpy(level->objectType, objectType, sizeof(int) * objectCount);
 	memcpy(level->objectX, objectX, sizeof(cpFloat) * objectCount);
@@ -274,7 +288,7 @@ Level* init(cpFloat height, cpFloat viewWidth, cpFloat viewHeight, int wallCount
 				break;
 		}
 
-		cpShapeSetUserData(shape, (cpDataPointer)i);
+		cpShapeSetUserData(shape, (cpDataPointer)(intptr_t)i);
 		cpShapeSetElasticity(shape, (cpFloat)0.5);
 		cpShapeSetFriction(shape, (cpFloat)0.5);
 
@@ -288,6 +302,80 @@ Level* init(cpFloat height, cpFloat viewWidth, cpFloat viewHeight, int wallCount
 	cpCollisionHandler* const collisionHandler = cpSpaceAddCollisionHandler(space, CollisionBall, CollisionObject);
 	collisionHandler->beginFunc = beginCollision;
 
+	setPhysicsStatsEnabled(level, 1);
+#if traceEvents
+	cpSpaceSetStepPhaseFunc(space, traceSpaceStepPhase, 0);
+#endif
+}
+
+Level* init(cpFloat height, cpFloat viewWidth, cpFloat viewHeight, int wallCount, const cpFloat* wallX0, const cpFloat* wallY0, const cpFloat* wallX1, const cpFloat* wallY1, int objectCount, const int* objectType, const cpFloat* objectX, const cpFloat* objectY, const cpFloat* objectRadius, int preview) {
+	traceBegin(init);
+
+	Level* const level = allocateLevel(height, viewWidth, viewHeight, wallCount, objectCount, objectType, preview);
+
+	for (int i = 0; i < wallCount; i++)
+		addWall(level, i, wallX0[i], wallY0[i], wallX1[i], wallY1[i], (cpFloat)0.5);
+
+	addObjects(level, objectCount, objectType, objectX, objectY, objectRadius);
+
+	traceEnd(init, "physics");
+
+	return level;
+}
+
+Level* initFromPolygonTable(cpFloat height, cpFloat viewWidth, cpFloat viewHeight, const PolygonTable* polygonTable, int objectCount, const int* objectType, const cpFloat* objectX, const cpFloat* objectY, const cpFloat* objectRadius, int preview) {
+	traceBegin(init);
+
+	// Each polygon becomes a closed sequence of walls, except for polygons
+	// with only 2 points, which become a single wall, and for centerlines,
+	// which become an open sequence of walls as thick as the strokes they
+	// came from (refer to PolygonTable in lib/shared.h). Polygons with fewer
+	// than 2 points produce no walls at all (both loops below must skip them,
+	// so that every wall allocated by allocateLevel() is initialized).
+	const int* const firstPoint = polygonTable->firstPoint;
+	const unsigned char* const radius = polygonTable->radius;
+	int wallCount = 4;
+
+	for (int i = polygonTable->polygonCount - 1; i >= 0; i--) {
+		const int l = firstPoint[i + 1] - firstPoint[i];
+		if (l < 2)
+			continue;
+		wallCount += ((l == 2 || radius[firstPoint[i]]) ? (l - 1) : l);
+	}
+
+	Level* const level = allocateLevel(height, viewWidth, viewHeight, wallCount, objectCount, objectType, preview);
+
+	// Add 4 invisible walls around the level
+	addWall(level, 0, -1, -1, baseWidth, -1, (cpFloat)0.5);
+	addWall(level, 1, baseWidth, -1, baseWidth, height, (cpFloat)0.5);
+	addWall(level, 2, baseWidth, height, -1, height, (cpFloat)0.5);
+	addWall(level, 3, -1, height, -1, -1, (cpFloat)0.5);
+
+	for (int i = 0, w = 4; i < polygonTable->polygonCount; i++) {
+		if ((firstPoint[i + 1] - firstPoint[i]) < 2)
+			continue;
+
+		const short* const points = polygonTable->points + (firstPoint[i] << 1);
+		const unsigned char* const pointRadius = radius + firstPoint[i];
+		const int lastPoint = (firstPoint[i + 1] - firstPoint[i] - 1) << 1;
+
+		if (pointRadius[0]) {
+			for (int p = 0; p < lastPoint; p += 2)
+				addWall(level, w++, points[p], points[p + 1], points[p + 2], points[p + 3], (cpFloat)pointRadius[p >> 1] * (cpFloat)0.25);
+			continue;
+		}
+
+		for (int p = 0; p < lastPoint; p += 2)
+			addWall(level, w++, points[p], points[p + 1], points[p + 2], points[p + 3], (cpFloat)0.5);
+
+		if (lastPoint > 2)
+			addWall(level, w++, points[lastPoint], points[lastPoint + 1], points[0], points[1], (cpFloat)0.5);
+	}
+
+	addObjects(level, objectCount, objectType, objectX, objectY, objectRadius);
+
+	traceEnd(init, "physics");
+
 	return level;
 }
 
@@ -299,43 +387,76 @@ void* getFirstPropertyPtr(Level* level) {
 	return &(level->pointerCursorAttached);
 }
 
+PhysicsStats* getPhysicsStatsPtr(Level* level) {
+	return &(level->physicsStats);
+}
+
+int setPhysicsStatsEnabled(Level* level, int enabled) {
+	// The statistics are enabled by default when compiled in, but timing each
+	// pair in the narrow-phase makes cpSpaceStep() a lot slower, so they must
+	// be disabled whenever step() itself is being measured
+#if profilePhysics || traceEvents
+	level->physicsStatsEnabled = enabled;
+	cpSpaceSetStepStats(level->space, (enabled ? &(level->physicsStats.space) : 0), getTimeMilliseconds);
+#endif
+	// Let JS know whether step() fills PhysicsStats in this build
+	return profilePhysics;
+}
+
 void viewResized(Level* level, cpFloat viewWidth, cpFloat viewHeight) {
 	level->viewWidth = viewWidth;
 	level->viewHeight = viewHeight;
 }
 
-void addFragments(int f, cpFloat baseX, cpFloat baseY, int saved, float* fragmentTime, float* fragmentX, float* fragmentY, float* fragmentVX, float* fragmentVY) {
+// xorshift32, used instead of rand() so that the fragments produced by a level
+// depend only on its seed (refer to setLevelSeed() and replayRecording())
+static float randomFloat(unsigned int* state) {
+	unsigned int x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	// 1 / 16777216 = 0.000000059604644775390625
+	return (float)(x >> 8) * 0.000000059604644775390625f;
+}
+
+void setLevelSeed(Level* level, unsigned int seed) {
+	// xorshift32 must never be seeded with 0
+	level->randomState = (seed ? seed : 0x9E3779B9);
+}
+
+void addFragments(unsigned int* randomState, int f, cpFloat baseX, cpFloat baseY, int saved, float* fragmentTime, float* fragmentX, float* fragmentY, float* fragmentVX, float* fragmentVY) {
 	fragmentTime[f] = (saved ? FragmentsMaxTimeSaved : FragmentsMaxTime);
 	for (int i = (f * FragmentsPerBall), c = FragmentsPerBall - 1; c >= 0; i++, c--) {
-		fragmentX[i] = (float)baseX + ((float)rand() * 5.0f / (float)RAND_MAX);
-		fragmentY[i] = (float)baseY + ((float)rand() * 5.0f / (float)RAND_MAX);
+		fragmentX[i] = (float)baseX + (randomFloat(randomState) * 5.0f);
+		fragmentY[i] = (float)baseY + (randomFloat(randomState) * 5.0f);
 		const float a = (saved ?
 			// Spread the fragments in a 45-degree cone when the ball is saved
 			// (Since we want the fragments to go up, this means vy must be < 0,
 			// therefore we make the angle vary between 270 +- (45 / 2))
-			(4.3196898987f + ((float)rand() * 0.7853981634f / (float)RAND_MAX)) :
-			((float)rand() * 6.2831853072f / (float)RAND_MAX)
+			(4.3196898987f + (randomFloat(randomState) * 0.7853981634f)) :
+			(randomFloat(randomState) * 6.2831853072f)
 		);
-		const float v = 45.0f + ((float)rand() * 125.0f / (float)RAND_MAX);
+		const float v = 45.0f + (randomFloat(randomState) * 125.0f);
 		fragmentVX[i] = cosf(a) * v;
 		fragmentVY[i] = sinf(a) * v;
 	}
 }
 
-void prepareVictoryFragments(float viewWidth, float viewHeight, int turn, int ballCount, int* fragmentSaved, float* fragmentX, float* fragmentY, float* fragmentVX, float* fragmentVY) {
+void prepareVictoryFragments(unsigned int* randomState, float viewWidth, float viewHeight, int turn, int ballCount, int* fragmentSaved, float* fragmentX, float* fragmentY, float* fragmentVX, float* fragmentVY) {
 	const int first = turn * (VictoryFragmentCount >> 2);
 	const float baseX = (float)(turn + 1) * (viewWidth / 5.0f);
 	for (int i = ballCount + first, j = (ballCount * FragmentsPerBall) + first, c = (VictoryFragmentCount >> 2) - 1; c >= 0; i++, j++, c--) {
 		fragmentSaved[i] = 1;
-		fragmentX[j] = baseX + ((float)rand() * 5.0f / (float)RAND_MAX);
-		fragmentY[j] = viewHeight + ((float)rand() * 5.0f / (float)RAND_MAX);
+		fragmentX[j] = baseX + (randomFloat(randomState) * 5.0f);
+		fragmentY[j] = viewHeight + (randomFloat(randomState) * 5.0f);
 		const float a =
 			// Spread the fragments in a 45-degree cone when the ball is saved
 			// (Since we want the fragments to go up, this means vy must be < 0,
 			// therefore we make the angle vary between 270 +- (45 / 2))
-			4.3196898987f + ((float)rand() * 0.7853981634f / (float)RAND_MAX)
+			4.3196898987f + (randomFloat(randomState) * 0.7853981634f)
 		;
-		const float v = 25.0 + ((float)rand() * 150.0f / (float)RAND_MAX);
+		const float v = 25.0 + (randomFloat(randomState) * 150.0f);
 		fragmentVX[j] = cosf(a) * v;
 		fragmentVY[j] = sinf(a) * v * 2.0f;
 	}
@@ -344,6 +465,17 @@ void prepareVictoryFragments(float viewWidth, float viewHeight, int turn, int ba
 void step(Level* level, cpFloat gravityX, cpFloat gravityY, int mode, int paused) {
 	cpSpace* const space = level->space;
 
+	profilerBegin(step);
+	traceBegin(step);
+
+	if (level->recording)
+		recordFrame(level, gravityX, gravityY, mode, paused);
+
+#if profilePhysics
+	const double stepStart = (level->physicsStatsEnabled ? getTimeMilliseconds() : 0.0);
+	level->physicsStats.spaceStepMilliseconds = 0;
+#endif
+
 	const cpFloat deltaSeconds = level->deltaSeconds;
 #if CP_USE_DOUBLES
 	const float deltaSecondsF = (float)level->deltaSeconds;
@@ -408,7 +540,17 @@ void step(Level* level, cpFloat gravityX, cpFloat gravityY, int mode, int paused
 			gravityY *= (cpFloat)72.0;
 		}
 		cpSpaceSetGravity(space, cpv(gravityX, gravityY));
+#if profilePhysics
+		if (level->physicsStatsEnabled) {
+			const double spaceStepStart = getTimeMilliseconds();
+			cpSpaceStep(space, deltaSeconds);
+			level->physicsStats.spaceStepMilliseconds = getTimeMilliseconds() - spaceStepStart;
+		} else {
+			cpSpaceStep(space, deltaSeconds);
+		}
+#else
 		cpSpaceStep(space, deltaSeconds);
+#endif
 	}
 
 	cpShape** const objectShape = level->objectShape;
@@ -446,7 +588,7 @@ void step(Level* level, cpFloat gravityX, cpFloat gravityY, int mode, int paused
 					if (fragmentTime[f] == 0.0f) {
 						level->fragmentsAlive = 1;
 						fragmentSaved[f] = saved;
-						addFragments(f, x, y, saved, fragmentTime, fragmentX, fragmentY, fragmentVX, fragmentVY);
+						addFragments(&(level->randomState), f, x, y, saved, fragmentTime, fragmentX, fragmentY, fragmentVX, fragmentVY);
 						break;
 					}
 				}
@@ -548,7 +690,7 @@ void step(Level* level, cpFloat gravityX, cpFloat gravityY, int mode, int paused
 			if (level->ballsSaved > (level->countByType[TypeBall] >> 1)) {
 				level->finished = FinishedVictory;
 				level->victory = FinishedVictory;
-				prepareVictoryFragments((float)level->viewWidth, (float)level->viewHeight, 0, level->countByType[TypeBall], fragmentSaved, fragmentX, fragmentY, fragmentVX, fragmentVY);
+				prepareVictoryFragments(&(level->randomState), (float)level->viewWidth, (float)level->viewHeight, 0, level->countByType[TypeBall], fragmentSaved, fragmentX, fragmentY, fragmentVX, fragmentVY);
 			} else {
 				level->finished = FinishedLoss;
 				level->victory = 0;
@@ -665,12 +807,20 @@ void step(Level* level, cpFloat gravityX, cpFloat gravityY, int mode, int paused
 					turn = 0;
 				level->finished = (level->finished & ~0xFF0000) | (turn << 16);
 				if (turn < 4)
-					prepareVictoryFragments((float)level->viewWidth, (float)level->viewHeight, turn, level->countByType[TypeBall], fragmentSaved, fragmentX, fragmentY, fragmentVX, fragmentVY);					
+					prepareVictoryFragments(&(level->randomState), (float)level->viewWidth, (float)level->viewHeight, turn, level->countByType[TypeBall], fragmentSaved, fragmentX, fragmentY, fragmentVX, fragmentVY);					
 			} else {
 				level->finished |= (frames << 8);
 			}
 		}
 	}
+
+#if profilePhysics
+	if (level->physicsStatsEnabled)
+		level->physicsStats.stepMilliseconds = getTimeMilliseconds() - stepStart;
+#endif
+
+	traceEnd(step, "physics");
+	profilerEnd(step, ProfilerMarkerStep);
 }
 
 void destroy(Level* level) {
@@ -711,5 +861,5 @@ void destroy(Level* level) {
 
 	cpSpaceFree(space);
 
-	free(level->actualPtr);
+	freeMemory(level->actualPtr);
 }
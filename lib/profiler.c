@@ -0,0 +1,129 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Carlos Rafael Gimenes das Neves
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// https://github.com/carlosrafaelgn/pixel
+//
+
+#include <stdlib.h>
+#include <memory.h>
+
+#include "shared.h"
+
+// Frame profiler: every frame, the time spent in each marker is accumulated,
+// and when the next frame starts, the accumulated times are stored in a ring
+// buffer holding the last ProfilerFrameCapacity frames. Percentiles are only
+// computed on demand, by profilerComputeStats().
+
+typedef struct ProfilerStruct {
+	int enabled, frameCount, nextFrame, frameHasSamples;
+	float current[ProfilerMarkerCount];
+	float frames[ProfilerMarkerCount][ProfilerFrameCapacity];
+	float sorted[ProfilerFrameCapacity];
+	ProfilerStats stats;
+} Profiler;
+
+static Profiler profiler;
+
+static int compareFloat(const void* a, const void* b) {
+	const float fa = *((const float*)a), fb = *((const float*)b);
+	return (fa < fb) ? -1 : ((fa > fb) ? 1 : 0);
+}
+
+static double sortedPercentile(const float* sorted, int count, int p) {
+	// Nearest-rank method
+	int i = ((count * p) + 99) / 100;
+	if (i < 1)
+		i = 1;
+	return (double)sorted[i - 1];
+}
+
+int profilerSetEnabled(int enabled) {
+	// Without the markers, the only samples would be those added by JS
+	profiler.enabled = (profileFrames ? enabled : 0);
+	// Let JS know whether the markers are compiled in
+	return profileFrames;
+}
+
+int profilerIsEnabled() {
+	return profiler.enabled;
+}
+
+void profilerReset() {
+	const int enabled = profiler.enabled;
+	memset(&profiler, 0, sizeof(Profiler));
+	profiler.enabled = enabled;
+}
+
+void profilerAdd(int marker, double milliseconds) {
+	profiler.current[marker] += (float)milliseconds;
+	profiler.frameHasSamples = 1;
+}
+
+void profilerNextFrame() {
+	if (!profiler.frameHasSamples)
+		return;
+
+	float* const current = profiler.current;
+	// Most flushes happen inside renderBackground() and render(), so they are
+	// not added to the frame time again (those performed by JS, between the
+	// calls, are only reported by ProfilerMarkerFlush)
+	current[ProfilerMarkerFrame] = current[ProfilerMarkerBackground] + current[ProfilerMarkerStep] + current[ProfilerMarkerRender];
+
+	const int f = profiler.nextFrame;
+	for (int m = ProfilerMarkerCount - 1; m >= 0; m--) {
+		profiler.frames[m][f] = current[m];
+		current[m] = 0.0f;
+	}
+
+	profiler.nextFrame = ((f + 1) & (ProfilerFrameCapacity - 1));
+	if (profiler.frameCount < ProfilerFrameCapacity)
+		profiler.frameCount++;
+	profiler.frameHasSamples = 0;
+}
+
+ProfilerStats* profilerComputeStats() {
+	ProfilerStats* const stats = &(profiler.stats);
+	const int count = profiler.frameCount;
+
+	memset(stats, 0, sizeof(ProfilerStats));
+	stats->frameCount = count;
+
+	if (!count)
+		return stats;
+
+	float* const sorted = profiler.sorted;
+
+	for (int m = ProfilerMarkerCount - 1; m >= 0; m--) {
+		memcpy(sorted, profiler.frames[m], sizeof(float) * count);
+		qsort(sorted, count, sizeof(float), compareFloat);
+
+		ProfilerMarkerStats* const markerStats = &(stats->markers[m]);
+		markerStats->min = (double)sorted[0];
+		markerStats->median = sortedPercentile(sorted, count, 50);
+		markerStats->p95 = sortedPercentile(sorted, count, 95);
+		markerStats->p99 = sortedPercentile(sorted, count, 99);
+		markerStats->worst = (double)sorted[count - 1];
+	}
+
+	return stats;
+}
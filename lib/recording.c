@@ -0,0 +1,129 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Carlos Rafael Gimenes das Neves
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// https://github.com/carlosrafaelgn/pixel
+//
+
+#include <stdlib.h>
+#include <memory.h>
+
+#include "shared.h"
+
+// step() depends only on the level, on its arguments, on the pointer cursor
+// (in Pointer mode), on deltaSeconds/deltaMilliseconds, on the view size
+// (which changes whenever the window is resized) and on the level seed.
+// Therefore, recording them all every frame is enough to replay an entire
+// game later, without any rendering, as fast as the CPU allows.
+
+Recording* allocateRecording(int frameCapacity) {
+	Recording* const recording = (Recording*)allocateMemory(sizeof(Recording), MemoryOther);
+	if (!recording)
+		return 0;
+
+	memset(recording, 0, sizeof(Recording));
+
+	recording->frames = (RecordingFrame*)allocateMemory(sizeof(RecordingFrame) * frameCapacity, MemoryOther);
+	if (!recording->frames) {
+		freeMemory(recording);
+		return 0;
+	}
+
+	recording->frameCapacity = frameCapacity;
+
+	return recording;
+}
+
+void freeRecording(Recording* recording) {
+	if (!recording)
+		return;
+
+	freeMemory(recording->frames);
+	freeMemory(recording);
+}
+
+void startRecording(Level* level, Recording* recording, unsigned int seed) {
+	recording->seed = seed;
+	recording->frameCount = 0;
+	recording->overflowed = 0;
+
+	setLevelSeed(level, seed);
+	level->recording = recording;
+}
+
+void stopRecording(Level* level) {
+	level->recording = 0;
+}
+
+void recordFrame(Level* level, cpFloat gravityX, cpFloat gravityY, int mode, int paused) {
+	Recording* const recording = level->recording;
+
+	if (recording->frameCount >= recording->frameCapacity) {
+		// A partial recording cannot be replayed, so stop here
+		recording->overflowed = 1;
+		level->recording = 0;
+		return;
+	}
+
+	RecordingFrame* const frame = &(recording->frames[recording->frameCount++]);
+	frame->gravityX = gravityX;
+	frame->gravityY = gravityY;
+	frame->pointerCursorCenterX = level->pointerCursorCenterX;
+	frame->pointerCursorCenterY = level->pointerCursorCenterY;
+	frame->pointerCursorX = level->pointerCursorX;
+	frame->pointerCursorY = level->pointerCursorY;
+	frame->deltaSeconds = level->deltaSeconds;
+	frame->viewWidth = level->viewWidth;
+	frame->viewHeight = level->viewHeight;
+	frame->deltaMilliseconds = level->deltaMilliseconds;
+	frame->flags = mode |
+		(paused ? RecordingFlagPaused : 0) |
+		(level->pointerCursorAttached ? RecordingFlagPointerCursorAttached : 0);
+}
+
+int replayRecording(Level* level, const Recording* recording) {
+	// level must have just been created by init(), with the same arguments
+	// used to create the level that was recorded (except for the view size,
+	// which is restored from the recording)
+	if (recording->overflowed)
+		return -1;
+
+	setLevelSeed(level, recording->seed);
+
+	const RecordingFrame* frame = recording->frames;
+	for (int i = recording->frameCount; i > 0; i--, frame++) {
+		level->pointerCursorAttached = ((frame->flags & RecordingFlagPointerCursorAttached) ? 1 : 0);
+		level->pointerCursorCenterX = frame->pointerCursorCenterX;
+		level->pointerCursorCenterY = frame->pointerCursorCenterY;
+		level->pointerCursorX = frame->pointerCursorX;
+		level->pointerCursorY = frame->pointerCursorY;
+		level->deltaSeconds = frame->deltaSeconds;
+		level->deltaMilliseconds = frame->deltaMilliseconds;
+		// The same thing viewResized() does
+		level->viewWidth = frame->viewWidth;
+		level->viewHeight = frame->viewHeight;
+
+		step(level, frame->gravityX, frame->gravityY, frame->flags & 3, frame->flags & RecordingFlagPaused);
+	}
+
+	return level->totalElapsedMilliseconds;
+}
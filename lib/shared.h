@@ -24,8 +24,64 @@
 // https://github.com/carlosrafaelgn/pixel
 //
 
+#ifdef __EMSCRIPTEN__
+#include <emscripten.h>
+#endif
+#include <stdint.h>
 #include <chipmunk/chipmunk.h>
 
+#ifndef __EMSCRIPTEN__
+// When building natively (refer to the native target in Makefile), there is no
+// JS to be called from EM_JS, so the hooks become C callbacks set by the host.
+typedef void (*DrawNativeCallback)(int rectangleCount);
+
+void setDrawNativeCallback(DrawNativeCallback callback);
+#endif
+
+// Optional instrumentation (it should remain disabled in the emcc build,
+// unless we are profiling)
+#ifndef profileImageProcessing
+#define profileImageProcessing 0
+#endif
+#ifndef profilePhysics
+#define profilePhysics 0
+#endif
+#ifndef profileFrames
+#define profileFrames 0
+#endif
+#ifndef traceEvents
+#define traceEvents 0
+#endif
+#ifndef trackAllocations
+#define trackAllocations 0
+#endif
+#if trackAllocations && !defined(CP_ACCOUNT_ALLOCATIONS)
+// Chipmunk must be compiled with -DCP_ACCOUNT_ALLOCATIONS as well
+#error "trackAllocations requires CP_ACCOUNT_ALLOCATIONS"
+#endif
+
+#ifdef __EMSCRIPTEN__
+#define getTimeMilliseconds emscripten_get_now
+#else
+double getTimeMilliseconds();
+#endif
+
+// Worker threads are only available in the native build (and in emcc builds
+// with -pthread, which the browser build does not use, as they would require
+// SharedArrayBuffer). Without them, threadPoolRun() runs all tasks serially.
+#ifndef threadPoolEnabled
+#if !defined(__EMSCRIPTEN__) || defined(__EMSCRIPTEN_PTHREADS__)
+#define threadPoolEnabled 1
+#else
+#define threadPoolEnabled 0
+#endif
+#endif
+#define maxThreadPoolThreadCount 16
+typedef void (*ThreadPoolTask)(void* argument, int index);
+// Runs task(argument, 0) ... task(argument, taskCount - 1) on up to threadCount
+// threads (including the calling one), and only returns after all of them
+void threadPoolRun(ThreadPoolTask task, void* argument, int taskCount, int threadCount);
+
 // Must be in sync with scripts/constants.ts
 #define combineAlphaAndTexture 0
 #define baseWidth 420
@@ -85,6 +141,14 @@
 #define FloatsPerRectangle (4 * FloatsPerVertex)
 #define BytesPerRectangle (4 * FloatsPerRectangle)
 
+// Filled by step() when profilePhysics is enabled, unless disabled by
+// setPhysicsStatsEnabled() (times are in milliseconds). JS reads it straight
+// from the heap, so the layout must be in sync with PhysicsStats in scripts/lib.ts
+typedef struct PhysicsStatsStruct {
+	cpSpaceStepStats space;
+	double stepMilliseconds, spaceStepMilliseconds;
+} PhysicsStats;
+
 // In order to improve the performance in passing data from here to JS,
 // let's use a structure of arrays, instead of an array of structures.
 typedef struct LevelStruct {
@@ -93,6 +157,7 @@ typedef struct LevelStruct {
 		viewYStep, viewYDirection, lastGravityYDirection, deltaSeconds;
 
 	void* actualPtr;
+	struct RecordingStruct* recording;
 	cpSpace* space;
 	cpShape** wall;
 	cpShape** objectShape;
@@ -112,15 +177,195 @@ typedef struct LevelStruct {
 	int wallCount, objectCount, goalBlinkCount, goalBlinkFrames, cucumbersCollected,
 		thisFrameAllCucumbersCollected, thisFrameDestroyedCount, ballsDestroyed,
 		ballsSaved, deltaMilliseconds, cucumbersAnimating, finished, finishedFading,
-		fragmentsAlive, firstIndexByType[TypeCount], countByType[TypeCount], preview;
+		fragmentsAlive, firstIndexByType[TypeCount], countByType[TypeCount], preview,
+		physicsStatsEnabled;
+
+	unsigned int randomState;
 
 	float fadeBgAlpha, explosionBgAlpha, victoryTime;
 
 	// Must be in sync with scripts/view/gameView.ts
 	int pointerCursorAttached, totalElapsedMilliseconds, victory;
 	float pointerCursorCenterX, pointerCursorCenterY, pointerCursorX, pointerCursorY, globalAlpha;
+
+	// Refer to getPhysicsStatsPtr()
+	PhysicsStats physicsStats;
 } Level;
 
+// Filled by processImage() when profileImageProcessing is enabled
+typedef struct ImageProcessingStatsStruct {
+	double binarizeMilliseconds, erase1Milliseconds, labelMilliseconds,
+		floodFillMilliseconds, trace4Milliseconds, marchMilliseconds, douglasPeuckerMilliseconds, centerlineMilliseconds,
+		repaintMilliseconds, totalMilliseconds;
+
+	int componentCount, smallComponentCount, traceFailureCount, holeCount,
+		polygonCount, pointCount, centerlineComponentCount, centerlineCount;
+} ImageProcessingStats;
+
+// Must be in sync with FrameProfiler in scripts/lib.ts
+#define ProfilerMarkerFrame 0
+#define ProfilerMarkerBackground 1
+#define ProfilerMarkerStep 2
+#define ProfilerMarkerRender 3
+#define ProfilerMarkerFlush 4
+#define ProfilerMarkerCount 5
+#define ProfilerFrameCapacity 1024 // Must be a power of 2
+
+typedef struct ProfilerMarkerStatsStruct {
+	double min, median, p95, p99, worst;
+} ProfilerMarkerStats;
+
+// Filled by profilerComputeStats() (times are in milliseconds, and the layout
+// must be in sync with FrameProfiler in scripts/lib.ts)
+typedef struct ProfilerStatsStruct {
+	int frameCount;
+	ProfilerMarkerStats markers[ProfilerMarkerCount];
+} ProfilerStats;
+
+// When profileFrames is enabled, the markers are compiled in, but they only
+// read the clock after profilerSetEnabled(1) has been called.
+#if profileFrames
+#define profilerBegin(NAME) const double profilerStart##NAME = (profilerIsEnabled() ? getTimeMilliseconds() : 0.0)
+#define profilerEnd(NAME, MARKER) if (profilerIsEnabled()) profilerAdd(MARKER, getTimeMilliseconds() - profilerStart##NAME)
+#define profilerFrame() profilerNextFrame()
+#else
+#define profilerBegin(NAME)
+#define profilerEnd(NAME, MARKER)
+#define profilerFrame()
+#endif
+
+int profilerSetEnabled(int enabled);
+int profilerIsEnabled();
+void profilerReset();
+void profilerAdd(int marker, double milliseconds);
+void profilerNextFrame();
+ProfilerStats* profilerComputeStats();
+
+// When traceEvents is enabled, the scopes are compiled in, but they only
+// read the clock after traceStart() has been called. NAME becomes the name
+// of the event, so it must be a valid identifier.
+#if traceEvents
+#define traceBegin(NAME) const double traceStart##NAME = (traceIsRecording() ? getTimeMilliseconds() : 0.0)
+#define traceEnd(NAME, CATEGORY) if (traceIsRecording()) traceAdd(#NAME, CATEGORY, traceStart##NAME, getTimeMilliseconds())
+#else
+#define traceBegin(NAME)
+#define traceEnd(NAME, CATEGORY)
+#endif
+
+int traceStart(int capacity);
+void traceStop();
+void tracePause();
+void traceResume();
+int traceIsRecording();
+int getTraceEventCount();
+int getTraceDroppedEventCount();
+void traceAdd(const char* name, const char* category, double start, double end);
+char* traceExportJson();
+
+// Must be in sync with scripts/lib.ts
+#define MemoryImage 0
+#define MemoryLevel 1
+#define MemorySpace 2
+#define MemoryArbiters 3
+#define MemoryContacts 4
+#define MemoryBBTree 5
+#define MemoryOther 6
+#define MemorySubsystemCount 7
+
+// Filled by the allocation functions when trackAllocations is enabled
+// (the per-allocation header used to track the sizes is not accounted)
+typedef struct AllocationStatsStruct {
+	int liveBytes[MemorySubsystemCount], peakBytes[MemorySubsystemCount],
+		liveCount[MemorySubsystemCount], allocationCount[MemorySubsystemCount];
+	int totalLiveBytes, totalPeakBytes;
+} AllocationStats;
+
+#if trackAllocations
+void* allocateMemory(size_t size, int subsystem);
+void freeMemory(void* ptr);
+#else
+#define allocateMemory(SIZE, SUBSYSTEM) malloc(SIZE)
+#define freeMemory(PTR) free(PTR)
+#endif
+AllocationStats* getAllocationStats();
+void resetAllocationPeaks();
+
+// Inputs received by step() during one frame (refer to lib/recording.c)
+#define RecordingFlagPaused 4
+#define RecordingFlagPointerCursorAttached 8
+typedef struct RecordingFrameStruct {
+	cpFloat gravityX, gravityY, deltaSeconds;
+	cpFloat viewWidth, viewHeight; // The victory fragments and the view position depend on them (refer to viewResized())
+	float pointerCursorCenterX, pointerCursorCenterY, pointerCursorX, pointerCursorY;
+	int deltaMilliseconds, flags; // flags = mode | RecordingFlag*
+} RecordingFrame;
+
+typedef struct RecordingStruct {
+	unsigned int seed;
+	int frameCount, frameCapacity, overflowed;
+	RecordingFrame* frames;
+} Recording;
+
+void setLevelSeed(Level* level, unsigned int seed);
+int setPhysicsStatsEnabled(Level* level, int enabled);
+void step(Level* level, cpFloat gravityX, cpFloat gravityY, int mode, int paused);
+
+Recording* allocateRecording(int frameCapacity);
+void freeRecording(Recording* recording);
+void startRecording(Level* level, Recording* recording, unsigned int seed);
+void stopRecording(Level* level);
+void recordFrame(Level* level, cpFloat gravityX, cpFloat gravityY, int mode, int paused);
+int replayRecording(Level* level, const Recording* recording);
+
+// Polygons produced by processImage(), stored in a single allocation, so that
+// they can be passed straight to initFromPolygonTable() (must be in sync with
+// scripts/image/imageProcessing.ts and with scripts/level/level.ts)
+typedef struct PolygonTableStruct {
+	int polygonCount, pointCount, polygonCapacity, pointCapacity, overflowed;
+	int keptPolygonCount; // polygons kept from the previous call (refer to processImageRegion())
+	int* firstPoint; // polygonCapacity + 1 ints (firstPoint[polygonCount] == pointCount)
+	short* points; // x y x y x y... (pointCapacity pairs)
+	int* startPixel; // polygonCapacity ints (y * width + x of the pixel where each polygon was found)
+	// Contour hierarchy: a hole's parent is the outer border of the component
+	// around it, and an outer border's parent is the hole it lies inside of
+	int* parent; // polygonCapacity ints (index of the parent polygon, or -1 for top-level polygons)
+	unsigned char* hole; // polygonCapacity flags (1 for holes, 0 for outer borders)
+	// Polygons are closed, unless they are centerlines (refer to
+	// setImageInfoCenterlines()), which are open polylines whose points all
+	// have a radius: the radius, in quarters of a pixel, of the segment from
+	// each point to the next one (0 in all points of closed polygons)
+	unsigned char* radius; // pointCapacity radii
+} PolygonTable;
+
+PolygonTable* allocatePolygonTable(int polygonCapacity, int pointCapacity);
+void clearPolygonTable(PolygonTable* polygonTable);
+void freePolygonTable(PolygonTable* polygonTable);
+
+// Results of processImage() for the most recently processed images, bounded
+// in bytes (refer to lib/imageCache.c)
+void setImageCacheCapacity(int capacity);
+int imageCacheIsEnabled();
+uint64_t hashImageBuffer(const unsigned char* buffer, int length);
+int imageCacheLoad(uint64_t hash, int width, int height, PolygonTable* polygonTable, unsigned char* buffer, int bufferLength);
+void imageCacheStore(uint64_t hash, int width, int height, const PolygonTable* polygonTable, const unsigned char* buffer, int bufferLength);
+
+// Several images processed at once, each one by processImage(), on the thread
+// pool (refer to processImageBatch())
+typedef struct ImageBatchJobStruct {
+	unsigned char* data; // width * height * 4 bytes (r g b a...), repainted just like processImage() does
+	int width, height;
+	PolygonTable* polygonTable;
+	int maxY; // Returned by processImage() (-1 when the job could not be processed)
+} ImageBatchJob;
+
+typedef struct ImageBatchStructure ImageBatch;
+
+ImageBatch* allocateImageBatch(int threadCount, int centerlines);
+void freeImageBatch(ImageBatch* imageBatch);
+int processImageBatch(ImageBatch* imageBatch, ImageBatchJob* jobs, int jobCount);
+
+Level* initFromPolygonTable(cpFloat height, cpFloat viewWidth, cpFloat viewHeight, const PolygonTable* polygonTable, int objectCount, const int* objectType, const cpFloat* objectX, const cpFloat* objectY, const cpFloat* objectRadius, int preview);
+
 cpFloat smoothStep(cpFloat input);
 #if CP_USE_DOUBLES
 float smoothStepF(float input);
@@ -0,0 +1,128 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Carlos Rafael Gimenes das Neves
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// https://github.com/carlosrafaelgn/pixel
+//
+
+#include <stdlib.h>
+
+#include "shared.h"
+
+#if threadPoolEnabled
+
+#include <pthread.h>
+
+// The threads are created on demand, and are never destroyed. The thread that
+// calls threadPoolRun() also runs tasks, instead of just waiting for them.
+static pthread_mutex_t threadPoolMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t threadPoolWorkCondition = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t threadPoolDoneCondition = PTHREAD_COND_INITIALIZER;
+static int threadPoolThreadCount, threadPoolBusy;
+static unsigned int threadPoolGeneration;
+static ThreadPoolTask threadPoolTask;
+static void* threadPoolArgument;
+static int threadPoolTaskCount, threadPoolNextTask, threadPoolPendingTaskCount;
+
+// Must be called with threadPoolMutex locked
+static void runThreadPoolTasks() {
+	while (threadPoolNextTask < threadPoolTaskCount) {
+		const int index = threadPoolNextTask++;
+		const ThreadPoolTask task = threadPoolTask;
+		void* const argument = threadPoolArgument;
+		pthread_mutex_unlock(&threadPoolMutex);
+		task(argument, index);
+		pthread_mutex_lock(&threadPoolMutex);
+		threadPoolPendingTaskCount--;
+		if (!threadPoolPendingTaskCount)
+			pthread_cond_broadcast(&threadPoolDoneCondition);
+	}
+}
+
+static void* threadPoolThread(void* argument) {
+	// The thread starts from the generation before the one it has been
+	// created for, so it still takes part in that call, even though it can
+	// only lock threadPoolMutex after threadPoolRun() has started waiting
+	unsigned int generation = (unsigned int)(uintptr_t)argument;
+
+	pthread_mutex_lock(&threadPoolMutex);
+	for (;;) {
+		while (generation == threadPoolGeneration)
+			pthread_cond_wait(&threadPoolWorkCondition, &threadPoolMutex);
+		generation = threadPoolGeneration;
+		runThreadPoolTasks();
+	}
+
+	return 0;
+}
+
+void threadPoolRun(ThreadPoolTask task, void* argument, int taskCount, int threadCount) {
+	if (threadCount > maxThreadPoolThreadCount)
+		threadCount = maxThreadPoolThreadCount;
+
+	pthread_mutex_lock(&threadPoolMutex);
+
+	if (taskCount <= 1 || threadCount <= 1 || threadPoolBusy) {
+		// Either there is nothing to share, or another thread is already using
+		// the pool, in which case we do not wait for it to finish
+		pthread_mutex_unlock(&threadPoolMutex);
+		for (int i = 0; i < taskCount; i++)
+			task(argument, i);
+		return;
+	}
+
+	threadPoolBusy = 1;
+	threadPoolTask = task;
+	threadPoolArgument = argument;
+	threadPoolTaskCount = taskCount;
+	threadPoolNextTask = 0;
+	threadPoolPendingTaskCount = taskCount;
+	threadPoolGeneration++;
+
+	// The calling thread is one of the threadCount threads (refer to
+	// threadPoolThread() for the generation they start from)
+	while (threadPoolThreadCount < threadCount - 1) {
+		pthread_t thread;
+		if (pthread_create(&thread, 0, threadPoolThread, (void*)(uintptr_t)(threadPoolGeneration - 1)))
+			break;
+		pthread_detach(thread);
+		threadPoolThreadCount++;
+	}
+
+	pthread_cond_broadcast(&threadPoolWorkCondition);
+
+	runThreadPoolTasks();
+	while (threadPoolPendingTaskCount)
+		pthread_cond_wait(&threadPoolDoneCondition, &threadPoolMutex);
+
+	threadPoolBusy = 0;
+	pthread_mutex_unlock(&threadPoolMutex);
+}
+
+#else
+
+void threadPoolRun(ThreadPoolTask task, void* argument, int taskCount, int threadCount) {
+	for (int i = 0; i < taskCount; i++)
+		task(argument, i);
+}
+
+#endif
@@ -0,0 +1,145 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Carlos Rafael Gimenes das Neves
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// https://github.com/carlosrafaelgn/pixel
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+
+#include "shared.h"
+
+// Records complete events (name, start and duration) into a buffer allocated
+// by traceStart(), which can later be exported as Chrome's trace_event JSON
+// (https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU)
+// and loaded in chrome://tracing or https://ui.perfetto.dev
+
+typedef struct TraceEventStruct {
+	const char* name;
+	const char* category;
+	double start;
+	float duration;
+} TraceEvent;
+
+typedef struct TraceStruct {
+	int recording, eventCount, eventCapacity, droppedEventCount;
+	double origin;
+	TraceEvent* events;
+} Trace;
+
+static Trace trace;
+
+int traceStart(int capacity) {
+	traceStop();
+
+	// Without the scopes, nothing would ever be recorded
+	if (!traceEvents || capacity <= 0)
+		return 0;
+
+	trace.events = (TraceEvent*)allocateMemory(sizeof(TraceEvent) * capacity, MemoryOther);
+	if (!trace.events)
+		return 0;
+
+	trace.eventCapacity = capacity;
+	trace.origin = getTimeMilliseconds();
+	trace.recording = 1;
+
+	return 1;
+}
+
+void traceStop() {
+	if (trace.events)
+		freeMemory(trace.events);
+	memset(&trace, 0, sizeof(Trace));
+}
+
+int traceIsRecording() {
+	return trace.recording;
+}
+
+void tracePause() {
+	trace.recording = 0;
+}
+
+void traceResume() {
+	// Only a recording that has been paused can be resumed
+	trace.recording = (trace.events ? 1 : 0);
+}
+
+int getTraceEventCount() {
+	return trace.eventCount;
+}
+
+int getTraceDroppedEventCount() {
+	return trace.droppedEventCount;
+}
+
+void traceAdd(const char* name, const char* category, double start, double end) {
+	// Events that started before traceStart() are discarded (the buffer is not
+	// a ring, so the beginning of the recording is always preserved)
+	if (!trace.recording || start < trace.origin)
+		return;
+
+	if (trace.eventCount >= trace.eventCapacity) {
+		trace.droppedEventCount++;
+		return;
+	}
+
+	TraceEvent* const event = &(trace.events[trace.eventCount++]);
+	event->name = name;
+	event->category = category;
+	event->start = start;
+	event->duration = (float)(end - start);
+}
+
+char* traceExportJson() {
+	// Names and categories are C identifiers/literals, so nothing needs to be escaped
+	// (the caller must release the returned buffer with freeBuffer())
+	const int eventCount = trace.eventCount;
+	size_t capacity = 128;
+	for (int i = 0; i < eventCount; i++)
+		capacity += strlen(trace.events[i].name) + strlen(trace.events[i].category) + 128;
+
+	char* const json = (char*)allocateMemory(capacity, MemoryOther);
+	if (!json)
+		return 0;
+
+	size_t length = (size_t)snprintf(json, capacity, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+	for (int i = 0; i < eventCount; i++) {
+		const TraceEvent* const event = &(trace.events[i]);
+		// Chrome expects timestamps and durations in microseconds
+		length += (size_t)snprintf(json + length, capacity - length, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+			(i ? "," : ""),
+			event->name,
+			event->category,
+			(event->start - trace.origin) * 1000.0,
+			(double)event->duration * 1000.0);
+	}
+
+	snprintf(json + length, capacity - length, "]}");
+
+	return json;
+}
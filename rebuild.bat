@@ -21,7 +21,8 @@ SET SRCS=^
 	%CHIP_SRC%\cpSpaceHash.c %CHIP_SRC%\cpSpaceQuery.c ^
 	%CHIP_SRC%\cpSpaceStep.c %CHIP_SRC%\cpSpatialIndex.c ^
 	%CHIP_SRC%\cpSweep1D.c ^
-	%LIB_DIR%\math_fix_sincos.c %LIB_DIR%\memory.c %LIB_DIR%\physics.c %LIB_DIR%\gl.c %LIB_DIR%\imageProcessing.c
+	%LIB_DIR%\math_fix_sincos.c %LIB_DIR%\memory.c %LIB_DIR%\physics.c %LIB_DIR%\gl.c %LIB_DIR%\imageProcessing.c %LIB_DIR%\imageCache.c ^
+	%LIB_DIR%\profiler.c %LIB_DIR%\trace.c %LIB_DIR%\recording.c %LIB_DIR%\threadPool.c
 
 REM emcc (Emscripten gcc/clang-like replacement) 2.0.11 (6e28e4fa4fa1bc50d58b9ddbbb9603a3cf21ea9e)
 REM
@@ -33,6 +34,10 @@ REM https://emscripten.org/docs/porting/Debugging.html
 REM https://emscripten.org/docs/porting/connecting_cpp_and_javascript/Interacting-with-code.html#interacting-with-code-ccall-cwrap
 REM -s EXPORTED_RUNTIME_METHODS=['cwrap']
 REM
+REM SIMD (processImage() falls back to scalar code without it, and the resulting
+REM lib.wasm only loads in browsers that support WebAssembly SIMD):
+REM -msimd128 (WASM=1 only)
+REM
 REM Debugging:
 REM https://emscripten.org/docs/porting/Debugging.html#debugging-debug-information-g
 REM https://emscripten.org/docs/tools_reference/emcc.html
@@ -45,7 +50,18 @@ REM As of August 2020, WASM=2 does not work properly, even if loading the correc
 REM manually during runtime... That's why I'm compiling it twice...
 REM
 REM 8388608 bytes (2097152 stack + 6291456 heap) is enough to hold even the largest
-REM structure, ImageInfo, which has a total of 4719244 bytes.
+REM structure, ImageInfo, which takes 4700016 bytes for a 420 x 840 image (its size
+REM depends on the actual image, e.g., 1175904 bytes for a 420 x 209 image).
+
+REM Optional instrumentation, compiled out of the browser build unless requested
+REM (refer to lib/shared.h and to scripts/lib.ts), e.g.:
+REM SET PROFILE_PHYSICS=1
+REM SET PROFILE_FRAMES=1
+REM SET TRACE_EVENTS=1
+REM rebuild
+IF "%PROFILE_PHYSICS%"=="" SET PROFILE_PHYSICS=0
+IF "%PROFILE_FRAMES%"=="" SET PROFILE_FRAMES=0
+IF "%TRACE_EVENTS%"=="" SET TRACE_EVENTS=0
 
 DEL %OUT_DIR%\lib.js
 DEL %OUT_DIR%\lib.wasm
@@ -58,7 +74,7 @@ CALL emcc ^
 	--memory-init-file 0 ^
 	-s PRECISE_F32=0 ^
 	-s DYNAMIC_EXECUTION=0 ^
-	-s EXPORTED_FUNCTIONS="['_allocateImageInfo', '_getImageInfoData', '_getImageInfoPoints', '_freeImageInfo', '_processImage', '_allocateBuffer', '_freeBuffer', '_draw', '_drawScale', '_drawRotate', '_drawScaleRotate', '_init', '_getViewYPtr', '_getFirstPropertyPtr', '_viewResized', '_step', '_destroy', '_initLevelSpriteSheet', '_renderBackground', '_renderCompactBackground', '_render']" ^
+	-s EXPORTED_FUNCTIONS="['_allocateImageInfo', '_getImageInfoData', '_getImageInfoBuffer', '_freeImageInfo', '_processImage', '_processImageRegion', '_processImageMarch', '_setImageInfoCenterlines', '_setImageCacheCapacity', '_allocatePolygonTable', '_freePolygonTable', '_allocateBuffer', '_freeBuffer', '_draw', '_drawScale', '_drawRotate', '_drawScaleRotate', '_init', '_initFromPolygonTable', '_getViewYPtr', '_getFirstPropertyPtr', '_getPhysicsStatsPtr', '_setPhysicsStatsEnabled', '_viewResized', '_step', '_destroy', '_initLevelSpriteSheet', '_renderBackground', '_renderCompactBackground', '_render', '_profilerSetEnabled', '_profilerReset', '_profilerAdd', '_profilerComputeStats', '_traceStart', '_traceStop', '_tracePause', '_traceExportJson', '_getAllocationStats', '_resetAllocationPeaks', '_setLevelSeed', '_allocateRecording', '_freeRecording', '_startRecording', '_stopRecording', '_replayRecording']" ^
 	-s EXPORTED_RUNTIME_METHODS="[stackSave, stackAlloc, stackRestore]" ^
 	-s ALLOW_MEMORY_GROWTH=0 ^
 	-s INITIAL_MEMORY=8388608 ^
@@ -77,6 +93,9 @@ CALL emcc ^
 	-O3 ^
 	-DNDEBUG ^
 	-DCP_USE_DOUBLES=0 ^
+	-DprofilePhysics=%PROFILE_PHYSICS% ^
+	-DprofileFrames=%PROFILE_FRAMES% ^
+	-DtraceEvents=%TRACE_EVENTS% ^
 	-o %OUT_DIR%\lib.js ^
 	%SRCS%
 
@@ -86,7 +105,7 @@ CALL emcc ^
 	-I%CHIP_INC% ^
 	-s WASM=1 ^
 	-s DYNAMIC_EXECUTION=0 ^
-	-s EXPORTED_FUNCTIONS="['_allocateImageInfo', '_getImageInfoData', '_getImageInfoPoints', '_freeImageInfo', '_processImage', '_allocateBuffer', '_freeBuffer', '_draw', '_drawScale', '_drawRotate', '_drawScaleRotate', '_init', '_getViewYPtr', '_getFirstPropertyPtr', '_viewResized', '_step', '_destroy', '_initLevelSpriteSheet', '_renderBackground', '_renderCompactBackground', '_render']" ^
+	-s EXPORTED_FUNCTIONS="['_allocateImageInfo', '_getImageInfoData', '_getImageInfoBuffer', '_freeImageInfo', '_processImage', '_processImageRegion', '_processImageMarch', '_setImageInfoCenterlines', '_setImageCacheCapacity', '_allocatePolygonTable', '_freePolygonTable', '_allocateBuffer', '_freeBuffer', '_draw', '_drawScale', '_drawRotate', '_drawScaleRotate', '_init', '_initFromPolygonTable', '_getViewYPtr', '_getFirstPropertyPtr', '_getPhysicsStatsPtr', '_setPhysicsStatsEnabled', '_viewResized', '_step', '_destroy', '_initLevelSpriteSheet', '_renderBackground', '_renderCompactBackground', '_render', '_profilerSetEnabled', '_profilerReset', '_profilerAdd', '_profilerComputeStats', '_traceStart', '_traceStop', '_tracePause', '_traceExportJson', '_getAllocationStats', '_resetAllocationPeaks', '_setLevelSeed', '_allocateRecording', '_freeRecording', '_startRecording', '_stopRecording', '_replayRecording']" ^
 	-s EXPORTED_RUNTIME_METHODS="['stackSave', 'stackAlloc', 'stackRestore']" ^
 	-s ALLOW_MEMORY_GROWTH=0 ^
 	-s INITIAL_MEMORY=8388608 ^
@@ -105,6 +124,9 @@ CALL emcc ^
 	-O3 ^
 	-DNDEBUG ^
 	-DCP_USE_DOUBLES=0 ^
+	-DprofilePhysics=%PROFILE_PHYSICS% ^
+	-DprofileFrames=%PROFILE_FRAMES% ^
+	-DtraceEvents=%TRACE_EVENTS% ^
 	-o %OUT_DIR%\lib.js ^
 	%SRCS%
 
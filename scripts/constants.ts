@@ -60,6 +60,12 @@ const version = "20210513",
 	blinkLastCounter = 7,
 	blinkSingleDurationMS = 75,
 	blinkTotalDurationMS = (blinkLastCounter + 1) * blinkSingleDurationMS,
+	// Turns thick strokes into centerlines (refer to setImageInfoCenterlines()
+	// in lib/imageProcessing.c)
+	centerlineWalls = false,
+	// Finds the walls using marching squares (refer to processImageMarch() in
+	// lib/imageProcessing.c), which ignores centerlineWalls
+	marchingSquaresWalls = false,
 	
 	scrollThumbWidth = 32,
 	scrollThumbHeight = 48,
@@ -193,7 +193,8 @@ void main() {
 
 	public drawNative(rectangleCount: number): void {
 		this.rectangleCount = rectangleCount;
-		this.flush();
+		// lib/gl.c already measures the time spent here
+		this.flushRectangles();
 	}
 
 	public checkRecreate(canvas: HTMLCanvasElement): boolean {
@@ -436,6 +437,19 @@ void main() {
 	}
 
 	public flush(): void {
+		if (!this.rectangleCount)
+			return;
+
+		if (FrameProfiler.enabled) {
+			const start = performance.now();
+			this.flushRectangles();
+			FrameProfiler.addFlush(performance.now() - start);
+		} else {
+			this.flushRectangles();
+		}
+	}
+
+	private flushRectangles(): void {
 		const rectangleCount = this.rectangleCount;
 
 		if (!rectangleCount)
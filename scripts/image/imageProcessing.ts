@@ -82,41 +82,90 @@ function setContextQuality(context: CanvasRenderingContext2D, highQuality: boole
 	}
 }
 
+function readPolygonTable(polygonTable: number, previousPolygons: Polygon[] | null, previousStartPixel: Int32Array | null): Polygon[] {
+	// Must be in sync with PolygonTable in lib/shared.h
+	const buffer = cLib.HEAP8.buffer as ArrayBuffer,
+		header = new Int32Array(buffer, polygonTable, 12),
+		polygonCount = header[0],
+		pointCount = header[1],
+		keptPolygonCount = header[5],
+		firstPoint = new Int32Array(buffer, header[6], polygonCount + 1),
+		points = new Int16Array(buffer, header[7], pointCount << 1),
+		startPixel = new Int32Array(buffer, header[8], polygonCount),
+		parent = new Int32Array(buffer, header[9], polygonCount),
+		hole = new Uint8Array(buffer, header[10], polygonCount),
+		radius = new Uint8Array(buffer, header[11], pointCount),
+		polygons: Polygon[] = [];
+
+	if (header[4])
+		throw new Error((polygonCount >= Level.MaxPolygonCount) ? Level.MaxPolygonCountMessage : Level.MaxPointCountMessage);
+
+	// The first keptPolygonCount polygons have been kept by processImageRegion(),
+	// in the same order they were before, so there is no need to create them again
+	// (but their parents must be updated, as the indices may have changed)
+	let i = 0;
+	if (previousPolygons && previousStartPixel) {
+		for (let j = 0; i < keptPolygonCount; i++, j++) {
+			while (previousStartPixel[j] !== startPixel[i])
+				j++;
+			polygons.push(previousPolygons[j]);
+		}
+	}
+
+	for (; i < polygonCount; i++) {
+		const polygonPointCount = firstPoint[i + 1] - firstPoint[i],
+			polygon = new Polygon(polygonPointCount);
+
+		for (let p = polygonPointCount - 1, j = (firstPoint[i + 1] - 1) << 1; p >= 0; p--, j -= 2)
+			polygon.points[p] = new Point(points[j], points[j + 1]);
+
+		if (radius[firstPoint[i]])
+			polygon.radius = Array.prototype.slice.call(radius, firstPoint[i], firstPoint[i + 1]);
+
+		polygons.push(polygon);
+	}
+
+	for (i = 0; i < polygonCount; i++) {
+		polygons[i].parent = parent[i];
+		polygons[i].hole = !!hole[i];
+	}
+
+	return polygons;
+}
+
 function processImage(canvas: HTMLCanvasElement, context: CanvasRenderingContext2D, debugPolygons: boolean): [Polygon[], number] {
 	const buffer = cLib.HEAP8.buffer as ArrayBuffer,
 		w = parseInt(canvas.width.toString()),
 		h = parseInt(canvas.height.toString()),
 		imageData = context.getImageData(0, 0, w, h),
 		data = imageData.data, // r g b a r g b a r g b a...
-		polygons: Polygon[] = [],
-		// Must be in sync with lib/imageProcessing.c
-		maxPixelCount = ((baseWidth + 2) * (maxHeight + 2)), // + 2 because we are creating a 1-pixel border around the original image
-		maxPointCount = (maxPixelCount >> 1),
-		imageInfo = cLib._allocateImageInfo(w, h);
+		imageInfo = cLib._allocateImageInfo(w, h),
+		polygonTable = cLib._allocatePolygonTable(Level.MaxPolygonCount, Level.MaxPointCount);
+
+	if (!imageInfo || !polygonTable) {
+		if (polygonTable)
+			cLib._freePolygonTable(polygonTable);
+		if (imageInfo)
+			cLib._freeImageInfo(imageInfo);
+		throw new Error(imageInfo ? "Null polygon table" : "Null image info");
+	}
 
-	let maxY = 0;
+	let polygons: Polygon[] = [], maxY = 0;
 
 	try {
 		const imageInfoData = new Uint8Array(buffer, cLib._getImageInfoData(imageInfo), data.length);
-		const points = new Int32Array(buffer, cLib._getImageInfoPoints(imageInfo), maxPointCount << 1);
-
-		(window as any)["createPolygon"] = (pointCount: number) => {
-			const polygon = new Polygon(pointCount);
 
-			for (let i = ((pointCount - 1) << 1); i >= 0; i -= 2)
-				polygon.points[i >> 1] = new Point(points[i], points[i + 1]);
-
-			polygons.push(polygon);
-		};
+		cLib._setImageInfoCenterlines(imageInfo, centerlineWalls);
 
 		imageInfoData.set(data, 0);
 
-		maxY = cLib._processImage(imageInfo);
+		maxY = (marchingSquaresWalls ? cLib._processImageMarch(imageInfo, polygonTable, true) : cLib._processImage(imageInfo, polygonTable));
 
 		data.set(imageInfoData, 0);
 
-		delete (window as any)["createPolygon"];
+		polygons = readPolygonTable(polygonTable, null, null);
 	} finally {
+		cLib._freePolygonTable(polygonTable);
 		cLib._freeImageInfo(imageInfo);
 	}
 
@@ -140,7 +189,9 @@ function processImage(canvas: HTMLCanvasElement, context: CanvasRenderingContext
 			context.moveTo(points[0].x + 0.5, points[0].y + 0.5);
 			for (let p = 1; p < points.length; p++)
 				context.lineTo(points[p].x + 0.5, points[p].y + 0.5);
-			context.lineTo(points[0].x + 0.5, points[0].y + 0.5);
+			// Centerlines are not closed
+			if (!polygons[i].radius)
+				context.lineTo(points[0].x + 0.5, points[0].y + 0.5);
 			context.stroke();
 		}
 		context.fillStyle = "rgba(255,0,0,0.5)";
@@ -0,0 +1,192 @@
+//
+// MIT License
+//
+// Copyright (c) 2020 Carlos Rafael Gimenes das Neves
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// https://github.com/carlosrafaelgn/pixel
+//
+
+class ImageProcessor {
+	// Keeps the results of the last call to process(), so that only the parts
+	// of the image marked as dirty since then need to be processed again
+	// (refer to processImageRegion() in lib/imageProcessing.c). Instead of
+	// keeping the entire ImageInfo allocated between calls, which would take
+	// most of the heap, only the binarized buffer and the polygon table are
+	// copied out of it (parent and hole are not, because processImageRegion()
+	// finds them again for all polygons, but radius is, because centerlines
+	// are only extracted from the polygons found in the dirty region).
+	private width: number;
+	private height: number;
+	private buffer: Uint8Array | null;
+	private polygonCount: number;
+	private pointCount: number;
+	private firstPoint: Int32Array | null;
+	private points: Int16Array | null;
+	private radius: Uint8Array | null;
+	private startPixel: Int32Array | null;
+	private polygons: Polygon[] | null;
+	private dirtyLeft: number;
+	private dirtyTop: number;
+	private dirtyRight: number;
+	private dirtyBottom: number;
+
+	public constructor() {
+		this.width = 0;
+		this.height = 0;
+		this.buffer = null;
+		this.polygonCount = 0;
+		this.pointCount = 0;
+		this.firstPoint = null;
+		this.points = null;
+		this.radius = null;
+		this.startPixel = null;
+		this.polygons = null;
+		this.dirtyLeft = 0;
+		this.dirtyTop = 0;
+		this.dirtyRight = 0;
+		this.dirtyBottom = 0;
+	}
+
+	public markDirty(x: number, y: number, width: number, height: number): void {
+		const left = Math.floor(x),
+			top = Math.floor(y),
+			right = Math.ceil(x + width),
+			bottom = Math.ceil(y + height);
+
+		if (right <= left || bottom <= top)
+			return;
+
+		if (this.dirtyRight <= this.dirtyLeft || this.dirtyBottom <= this.dirtyTop) {
+			this.dirtyLeft = left;
+			this.dirtyTop = top;
+			this.dirtyRight = right;
+			this.dirtyBottom = bottom;
+		} else {
+			if (this.dirtyLeft > left)
+				this.dirtyLeft = left;
+			if (this.dirtyTop > top)
+				this.dirtyTop = top;
+			if (this.dirtyRight < right)
+				this.dirtyRight = right;
+			if (this.dirtyBottom < bottom)
+				this.dirtyBottom = bottom;
+		}
+	}
+
+	public invalidate(): void {
+		// The entire image will be processed during the next call to process()
+		this.buffer = null;
+		this.firstPoint = null;
+		this.points = null;
+		this.radius = null;
+		this.startPixel = null;
+		this.polygons = null;
+		this.dirtyLeft = 0;
+		this.dirtyTop = 0;
+		this.dirtyRight = 0;
+		this.dirtyBottom = 0;
+	}
+
+	public process(canvas: HTMLCanvasElement, context: CanvasRenderingContext2D): [Polygon[], number] {
+		const buffer = cLib.HEAP8.buffer as ArrayBuffer,
+			w = parseInt(canvas.width.toString()),
+			h = parseInt(canvas.height.toString()),
+			bufferLength = (w + 2) * (h + 2),
+			imageData = context.getImageData(0, 0, w, h),
+			data = imageData.data, // r g b a r g b a r g b a...
+			imageInfo = cLib._allocateImageInfo(w, h),
+			polygonTable = cLib._allocatePolygonTable(Level.MaxPolygonCount, Level.MaxPointCount);
+
+		if (!imageInfo || !polygonTable) {
+			if (polygonTable)
+				cLib._freePolygonTable(polygonTable);
+			if (imageInfo)
+				cLib._freeImageInfo(imageInfo);
+			throw new Error(imageInfo ? "Null polygon table" : "Null image info");
+		}
+
+		let polygons: Polygon[] = [], maxY = 0;
+
+		try {
+			const imageInfoData = new Uint8Array(buffer, cLib._getImageInfoData(imageInfo), data.length),
+				imageInfoBuffer = new Uint8Array(buffer, cLib._getImageInfoBuffer(imageInfo), bufferLength),
+				// Must be in sync with PolygonTable in lib/shared.h
+				header = new Int32Array(buffer, polygonTable, 12);
+
+			cLib._setImageInfoCenterlines(imageInfo, centerlineWalls);
+
+			imageInfoData.set(data, 0);
+
+			if (this.buffer && this.firstPoint && this.points && this.radius && this.startPixel && this.width === w && this.height === h) {
+				imageInfoBuffer.set(this.buffer, 0);
+				header[0] = this.polygonCount;
+				header[1] = this.pointCount;
+				(new Int32Array(buffer, header[6], this.polygonCount + 1)).set(this.firstPoint, 0);
+				(new Int16Array(buffer, header[7], this.pointCount << 1)).set(this.points, 0);
+				(new Uint8Array(buffer, header[11], this.pointCount)).set(this.radius, 0);
+				(new Int32Array(buffer, header[8], this.polygonCount)).set(this.startPixel, 0);
+
+				maxY = cLib._processImageRegion(imageInfo, polygonTable, this.dirtyLeft, this.dirtyTop, this.dirtyRight - this.dirtyLeft, this.dirtyBottom - this.dirtyTop);
+			} else {
+				maxY = cLib._processImage(imageInfo, polygonTable);
+			}
+
+			data.set(imageInfoData, 0);
+
+			polygons = readPolygonTable(polygonTable, this.polygons, this.startPixel);
+
+			// Keep a copy of everything processImageRegion() will need next time
+			const polygonCount = header[0],
+				pointCount = header[1];
+
+			if (!this.buffer || this.buffer.length !== bufferLength)
+				this.buffer = new Uint8Array(bufferLength);
+			this.buffer.set(imageInfoBuffer, 0);
+			this.width = w;
+			this.height = h;
+			this.polygonCount = polygonCount;
+			this.pointCount = pointCount;
+			this.firstPoint = (new Int32Array(buffer, header[6], polygonCount + 1)).slice();
+			this.points = (new Int16Array(buffer, header[7], pointCount << 1)).slice();
+			this.radius = (new Uint8Array(buffer, header[11], pointCount)).slice();
+			this.startPixel = (new Int32Array(buffer, header[8], polygonCount)).slice();
+			this.polygons = polygons;
+			this.dirtyLeft = 0;
+			this.dirtyTop = 0;
+			this.dirtyRight = 0;
+			this.dirtyBottom = 0;
+		} catch (ex) {
+			this.invalidate();
+			throw ex;
+		} finally {
+			cLib._freePolygonTable(polygonTable);
+			cLib._freeImageInfo(imageInfo);
+		}
+
+		context.putImageData(imageData, 0, 0);
+
+		return [polygons, maxY];
+	}
+
+	public destroy(): void {
+		this.invalidate();
+	}
+}
@@ -26,18 +26,45 @@
 
 class Polygon {
 	public readonly points: Point[];
+	// Contour hierarchy (refer to PolygonTable in lib/shared.h): parent is the
+	// index of the polygon around this one (-1 for top-level polygons), and
+	// holes are the inner borders of the polygons they belong to
+	public parent: number;
+	public hole: boolean;
+	// Centerlines are open polylines, with one radius per point, in quarters
+	// of a pixel (null for closed polygons)
+	public radius: number[] | null;
 
 	public constructor(pointCount: number) {
 		this.points = new Array(pointCount);
+		this.parent = -1;
+		this.hole = false;
+		this.radius = null;
 	}
 
-	public static revive(polygon: any): Polygon {
+	public static revive(polygon: any, polygonCount: number): Polygon {
 		if (!polygon.points || polygon.points.length < 2)
 			throw new Error("Polygon has fewer than two points");
 
 		const newPolygon = new Polygon(polygon.points.length);
 		for (let i = polygon.points.length - 1; i >= 0; i--)
 			newPolygon.points[i] = Point.revive(polygon.points[i]);
+
+		// Levels saved before the hierarchy existed have neither parent nor hole
+		const parent = parseInt(polygon.parent);
+		if (parent >= 0 && parent < polygonCount)
+			newPolygon.parent = parent;
+		newPolygon.hole = !!polygon.hole;
+		if (polygon.radius && polygon.radius.length === polygon.points.length) {
+			const radius: number[] = new Array(polygon.radius.length);
+			for (let i = radius.length - 1; i >= 0; i--) {
+				const r = parseInt(polygon.radius[i]);
+				if (!(r > 0 && r <= 255))
+					throw new Error("Invalid centerline radius");
+				radius[i] = r;
+			}
+			newPolygon.radius = radius;
+		}
 			
 		return newPolygon;
 	}
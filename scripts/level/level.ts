@@ -47,6 +47,9 @@ class Level implements LevelFullInfo {
 	public static readonly MaxPointCount = 20000;
 	public static readonly MaxObjectCount = 256;
 	public static readonly MaxBallCount = 40;
+	// Steps that take longer than this are logged, along with their phases,
+	// when lib/ is compiled with -DprofilePhysics=1
+	public static readonly PhysicsStatsSpikeMilliseconds = 2;
 
 	public name = "";
 	public createdAt = 0;
@@ -60,6 +63,7 @@ class Level implements LevelFullInfo {
 	public objects: LevelObject[] = [];
 
 	public levelPtr = 0;
+	public physicsStats: PhysicsStats | null = null;
 
 	public toJSON(): LevelFullInfo {
 		return this.toLevelFullInfo();
@@ -105,6 +109,7 @@ class Level implements LevelFullInfo {
 			}
 		}
 		newLevel.levelPtr = 0;
+		newLevel.physicsStats = null;
 		newLevel.name = (newLevel.name || "").trim();
 		if (!newLevel.createdAt || newLevel.createdAt < 0)
 			newLevel.createdAt = 0;
@@ -130,7 +135,7 @@ class Level implements LevelFullInfo {
 				return null;
 			let totalPointCount = 0;
 			for (let i = newLevel.polygons.length - 1; i >= 0; i--) {
-				newLevel.polygons[i] = Polygon.revive(newLevel.polygons[i]);
+				newLevel.polygons[i] = Polygon.revive(newLevel.polygons[i], newLevel.polygons.length);
 				totalPointCount += newLevel.polygons[i].points.length;
 				if (totalPointCount > Level.MaxPointCount)
 					return null;
@@ -154,7 +159,7 @@ class Level implements LevelFullInfo {
 		return newLevel;
 	}
 
-	public async prepare(): Promise<void> {
+	public async prepare(imageProcessor?: ImageProcessor | null): Promise<void> {
 		if (this.image && (!this.processedImage || !this.thumbnailImage)) {
 			const image = await loadImage(this.image);
 
@@ -176,7 +181,7 @@ class Level implements LevelFullInfo {
 			context.drawImage(image, 0, 0);
 
 			this.width = baseWidth;
-			[this.polygons, this.height] = processImage(canvas, context, false);
+			[this.polygons, this.height] = (imageProcessor ? imageProcessor.process(canvas, context) : processImage(canvas, context, false));
 			if (this.height < iconSize) {
 				this.height = iconSize;
 			} else {
@@ -239,93 +244,83 @@ class Level implements LevelFullInfo {
 		const polygons = this.polygons;
 		const objects = this.objects;
 
-		let wallCount = 4;
+		let pointCount = 0;
+
+		for (let i = polygons.length - 1; i >= 0; i--)
+			pointCount += polygons[i].points.length;
+
+		// The walls are created by initFromPolygonTable(), straight from the table
+		const polygonCount = polygons.length,
+			objectCount = this.objects.length,
+			polygonTable: number = cLib._allocatePolygonTable(polygonCount, pointCount);
+
+		if (!polygonTable)
+			throw new Error("Null polygon table");
+
+		const lastStack: number = cLib.stackSave();
+
+		try {
+			const buffer = cLib.HEAP8.buffer as ArrayBuffer,
+				objectCountIntSize = objectCount << 2,
+				objectCountDoubleSize = objectCount << 3,
+				objectTypePtr: number = cLib.stackAlloc(objectCountIntSize),
+				objectXPtr: number = cLib.stackAlloc(objectCountDoubleSize),
+				objectYPtr: number = cLib.stackAlloc(objectCountDoubleSize),
+				objectRadiusPtr: number = cLib.stackAlloc(objectCountDoubleSize),
+				// Must be in sync with PolygonTable in lib/shared.h
+				header = new Int32Array(buffer, polygonTable, 12),
+				firstPoint = new Int32Array(buffer, header[6], polygonCount + 1),
+				points = new Int16Array(buffer, header[7], pointCount << 1),
+				parent = new Int32Array(buffer, header[9], polygonCount),
+				hole = new Uint8Array(buffer, header[10], polygonCount),
+				radius = new Uint8Array(buffer, header[11], pointCount),
+				objectType = new Int32Array(buffer, objectTypePtr, objectCount),
+				objectX = new Float32Array(buffer, objectXPtr, objectCount),
+				objectY = new Float32Array(buffer, objectYPtr, objectCount),
+				objectRadius = new Float32Array(buffer, objectRadiusPtr, objectCount);
+
+			header[0] = polygonCount;
+			header[1] = pointCount;
+
+			for (let i = 0, j = 0; i < polygonCount; i++) {
+				const polygonPoints = polygons[i].points,
+					polygonRadius = polygons[i].radius;
+
+				firstPoint[i] = j >> 1;
+				parent[i] = polygons[i].parent;
+				hole[i] = (polygons[i].hole ? 1 : 0);
+
+				for (let p = 0; p < polygonPoints.length; p++, j += 2) {
+					points[j] = polygonPoints[p].x;
+					points[j + 1] = polygonPoints[p].y;
+					radius[j >> 1] = (polygonRadius ? polygonRadius[p] : 0);
+				}
+			}
 
-		for (let i = polygons.length - 1; i >= 0; i--) {
-			const l = polygons[i].points.length;
-			wallCount += (l === 2 ? 1 : l);
-		}
+			firstPoint[polygonCount] = pointCount;
 
-		const objectCount = this.objects.length,
-			lastStack: number = cLib.stackSave(),
-			buffer = cLib.HEAP8.buffer as ArrayBuffer,
-			wallCountDoubleSize = wallCount << 3,
-			objectCountIntSize = objectCount << 2,
-			objectCountDoubleSize = objectCount << 3,
-			wallX0Ptr: number = cLib.stackAlloc(wallCountDoubleSize),
-			wallY0Ptr: number = cLib.stackAlloc(wallCountDoubleSize),
-			wallX1Ptr: number = cLib.stackAlloc(wallCountDoubleSize),
-			wallY1Ptr: number = cLib.stackAlloc(wallCountDoubleSize),
-			objectTypePtr: number = cLib.stackAlloc(objectCountIntSize),
-			objectXPtr: number = cLib.stackAlloc(objectCountDoubleSize),
-			objectYPtr: number = cLib.stackAlloc(objectCountDoubleSize),
-			objectRadiusPtr: number = cLib.stackAlloc(objectCountDoubleSize),
-			wallX0 = new Float32Array(buffer, wallX0Ptr, wallCount),
-			wallY0 = new Float32Array(buffer, wallY0Ptr, wallCount),
-			wallX1 = new Float32Array(buffer, wallX1Ptr, wallCount),
-			wallY1 = new Float32Array(buffer, wallY1Ptr, wallCount),
-			objectType = new Int32Array(buffer, objectTypePtr, objectCount),
-			objectX = new Float32Array(buffer, objectXPtr, objectCount),
-			objectY = new Float32Array(buffer, objectYPtr, objectCount),
-			objectRadius = new Float32Array(buffer, objectRadiusPtr, objectCount);
-
-		// Add 4 invisible walls around the level
-		wallX0[0] = -1;
-		wallY0[0] = -1;
-		wallX1[0] = this.width;
-		wallY1[0] = -1;
-		wallX0[1] = this.width;
-		wallY0[1] = -1;
-		wallX1[1] = this.width;
-		wallY1[1] = this.height;
-		wallX0[2] = this.width;
-		wallY0[2] = this.height;
-		wallX1[2] = -1;
-		wallY1[2] = this.height;
-		wallX0[3] = -1;
-		wallY0[3] = this.height;
-		wallX1[3] = -1;
-		wallY1[3] = -1;
-		
-		for (let i = 0, w = 4; i < polygons.length; i++) {
-			const points = polygons[i].points;
-			const lastPoint = points.length - 1;
-
-			for (let p = 0; p < lastPoint; p++) {
-				wallX0[w] = points[p].x;
-				wallY0[w] = points[p].y;
-				wallX1[w] = points[p + 1].x;
-				wallY1[w] = points[p + 1].y;
-				w++;
+			for (let i = 0; i < objectCount; i++) {
+				const object = objects[i];
+				objectType[i] = object.type;
+				objectX[i] = object.x;
+				objectY[i] = object.y;
+				objectRadius[i] = object.radius;
 			}
 
-			if (lastPoint > 1) {
-				wallX0[w] = points[lastPoint].x;
-				wallY0[w] = points[lastPoint].y;
-				wallX1[w] = points[0].x;
-				wallY1[w] = points[0].y;
-				w++;
-			}
+			const levelPtr = cLib._initFromPolygonTable(this.height, baseWidth, baseHeight, polygonTable, objectCount, objectTypePtr, objectXPtr, objectYPtr, objectRadiusPtr, preview);
+			this.levelPtr = levelPtr;
+			this.physicsStats = (cLib._setPhysicsStatsEnabled(levelPtr, true) ? new PhysicsStats(cLib._getPhysicsStatsPtr(levelPtr)) : null);
+		} finally {
+			cLib.stackRestore(lastStack);
+			cLib._freePolygonTable(polygonTable);
 		}
-
-		for (let i = 0; i < objectCount; i++) {
-			const object = objects[i];
-			objectType[i] = object.type;
-			objectX[i] = object.x;
-			objectY[i] = object.y;
-			objectRadius[i] = object.radius;
-		}
-
-		const levelPtr = cLib._init(this.height, baseWidth, baseHeight, wallCount, wallX0Ptr, wallY0Ptr, wallX1Ptr, wallY1Ptr, objectCount, objectTypePtr, objectXPtr, objectYPtr, objectRadiusPtr, preview);
-		this.levelPtr = levelPtr;
-
-		cLib.stackRestore(lastStack);
 	}
 
 	public destroyLevelPtr(): void {
 		if (this.levelPtr) {
 			cLib._destroy(this.levelPtr);
 			this.levelPtr = 0;
+			this.physicsStats = null;
 		}
 	}
 
@@ -351,5 +346,9 @@ class Level implements LevelFullInfo {
 			return;
 
 		cLib._step(this.levelPtr, ControlMode.accelerationX, ControlMode.accelerationY, ControlMode.mode, paused);
+
+		const physicsStats = this.physicsStats;
+		if (physicsStats && physicsStats.totalMilliseconds >= Level.PhysicsStatsSpikeMilliseconds)
+			console.log(physicsStats.toString());
 	}
 }
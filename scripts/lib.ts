@@ -34,9 +34,16 @@ interface CLib {
 
 	_allocateImageInfo(width: number, height: number): number;
 	_getImageInfoData(imageInfo: number): number;
-	_getImageInfoPoints(imageInfo: number): number;
+	_getImageInfoBuffer(imageInfo: number): number;
 	_freeImageInfo(imageInfo: number): void;
-	_processImage(imageInfo: number): number;
+	_processImage(imageInfo: number, polygonTable: number): number;
+	_processImageRegion(imageInfo: number, polygonTable: number, regionX: number, regionY: number, regionWidth: number, regionHeight: number): number;
+	_processImageMarch(imageInfo: number, polygonTable: number, soft: boolean): number;
+	_setImageInfoCenterlines(imageInfo: number, centerlines: boolean): void;
+	_setImageCacheCapacity(capacity: number): void;
+
+	_allocatePolygonTable(polygonCapacity: number, pointCapacity: number): number;
+	_freePolygonTable(polygonTable: number): void;
 
 	_allocateBuffer(size: number): number;
 	_freeBuffer(bufferPtr: number): void;
@@ -47,14 +54,139 @@ interface CLib {
 	_drawScaleRotate(verticesPtr: number, modelCoordinatesPtr: number, alpha: number, textureCoordinatesPtr: number, scale: number, radians: number, viewX: number, viewY: number): void;
 
 	_init(height: number, viewWidth: number, viewHeight: number, wallCount: number, wallX0Ptr: number, wallY0Ptr: number, wallX1Ptr: number, wallY1Ptr: number, objectCount: number, objectTypePtr: number, objectXPtr: number, objectYPtr: number, objectRadiusPtr: number, preview: boolean): number;
+	_initFromPolygonTable(height: number, viewWidth: number, viewHeight: number, polygonTable: number, objectCount: number, objectTypePtr: number, objectXPtr: number, objectYPtr: number, objectRadiusPtr: number, preview: boolean): number;
 	_getViewYPtr(levelPtr: number): number;
 	_getFirstPropertyPtr(levelPtr: number): number;
+	_getPhysicsStatsPtr(levelPtr: number): number;
+	// Returns true only when lib/ is compiled with -DprofilePhysics=1 (refer to lib/shared.h)
+	_setPhysicsStatsEnabled(levelPtr: number, enabled: boolean): boolean;
 	_viewResized(levelPtr: number, viewWidth: number, viewHeight: number): void;
 	_step(levelPtr: number, gravityX: number, gravityY: number, mode: number, paused: boolean): void;
+	_setLevelSeed(levelPtr: number, seed: number): void;
 	_destroy(levelPtr: number): void;
 
 	_initLevelSpriteSheet(): number;
 	_renderBackground(verticesPtr: number, levelPtr: number, levelSpriteSheetPtr: number, baseHeight: number, time: number, animate: boolean): void;
 	_renderCompactBackground(verticesPtr: number, levelPtr: number, levelSpriteSheetPtr: number, time: number): void;
 	_render(verticesPtr: number, levelPtr: number, levelSpriteSheetPtr: number, scaleFactor: number): number;
+
+	// Only functional when lib/ is compiled with -DprofileFrames=1 (refer to lib/shared.h and to FrameProfiler below)
+	_profilerSetEnabled(enabled: boolean): boolean;
+	_profilerReset(): void;
+	_profilerAdd(marker: number, milliseconds: number): void;
+	_profilerComputeStats(): number;
+
+	// Only functional when lib/ is compiled with -DtraceEvents=1 (refer to lib/shared.h),
+	// otherwise _traceStart() always returns false
+	_traceStart(capacity: number): boolean;
+	_traceStop(): void;
+	_tracePause(): void;
+	_traceExportJson(): number;
+
+	// Only functional when lib/ is compiled with -DtrackAllocations=1 -DCP_ACCOUNT_ALLOCATIONS (refer to lib/shared.h)
+	_getAllocationStats(): number;
+	_resetAllocationPeaks(): void;
+
+	// Not used by the game yet: claimed records can only be verified by
+	// pixel-headless (refer to bench-physics -r in headless/benchPhysics.c)
+	_allocateRecording(frameCapacity: number): number;
+	_freeRecording(recordingPtr: number): void;
+	_startRecording(levelPtr: number, recordingPtr: number, seed: number): void;
+	_stopRecording(levelPtr: number): void;
+	_replayRecording(levelPtr: number, recordingPtr: number): number;
+}
+
+// View over PhysicsStats, which step() fills every frame (refer to lib/shared.h).
+// The arrays point straight to the heap, so nothing is copied when reading them.
+// Must be in sync with PhysicsStats in lib/shared.h and with cpSpaceStepStats in
+// lib/Chipmunk2D/include/chipmunk/cpSpace.h
+class PhysicsStats {
+	public static readonly PhaseNames = ["integrate", "shapeUpdate", "broadphase", "narrowphase", "components", "arbiterFilter", "preStep", "solver", "postStep"];
+	public static readonly CountNames = ["arbiterCount", "contactCount", "pairCount", "dynamicTreeDepth", "staticTreeDepth", "staticShapeCount"];
+
+	// Times are in milliseconds
+	public readonly phaseMilliseconds: Float64Array;
+	public readonly counts: Int32Array;
+	private readonly stepMilliseconds: Float64Array;
+
+	public constructor(physicsStatsPtr: number) {
+		const buffer = cLib.HEAP8.buffer as ArrayBuffer;
+		// 9 doubles, followed by 6 ints and by 2 doubles
+		this.phaseMilliseconds = new Float64Array(buffer, physicsStatsPtr, 9);
+		this.counts = new Int32Array(buffer, physicsStatsPtr + 72, 6);
+		this.stepMilliseconds = new Float64Array(buffer, physicsStatsPtr + 96, 2);
+	}
+
+	public get totalMilliseconds(): number {
+		return this.stepMilliseconds[0];
+	}
+
+	public get spaceStepMilliseconds(): number {
+		return this.stepMilliseconds[1];
+	}
+
+	public toString(): string {
+		let str = "step " + this.totalMilliseconds.toFixed(3) + " ms | cpSpaceStep " + this.spaceStepMilliseconds.toFixed(3) + " ms";
+		for (let i = 0; i < PhysicsStats.PhaseNames.length; i++)
+			str += " | " + PhysicsStats.PhaseNames[i] + " " + this.phaseMilliseconds[i].toFixed(3);
+		for (let i = 0; i < PhysicsStats.CountNames.length; i++)
+			str += " | " + PhysicsStats.CountNames[i] + " " + this.counts[i];
+		return str;
+	}
+}
+
+// Frame profiler (refer to lib/profiler.c). The markers around renderBackground(),
+// step() and render() live in C, so it only works when lib/ is compiled with
+// -DprofileFrames=1. The flushes performed by JS are added to the same marker
+// used by lib/gl.c to measure drawNative().
+class FrameProfiler {
+	// Must be in sync with lib/shared.h
+	public static readonly MarkerFrame = 0;
+	public static readonly MarkerBackground = 1;
+	public static readonly MarkerStep = 2;
+	public static readonly MarkerRender = 3;
+	public static readonly MarkerFlush = 4;
+	public static readonly MarkerCount = 5;
+	public static readonly MarkerNames = ["frame", "background", "step", "render", "flush"];
+
+	public static enabled = false;
+
+	public static start(): boolean {
+		cLib._profilerReset();
+		FrameProfiler.enabled = cLib._profilerSetEnabled(true);
+		return FrameProfiler.enabled;
+	}
+
+	public static stop(): void {
+		cLib._profilerSetEnabled(false);
+		FrameProfiler.enabled = false;
+	}
+
+	public static addFlush(milliseconds: number): void {
+		cLib._profilerAdd(FrameProfiler.MarkerFlush, milliseconds);
+	}
+
+	public static computeStats(): any {
+		const buffer = cLib.HEAP8.buffer as ArrayBuffer,
+			statsPtr = cLib._profilerComputeStats(),
+			// Must be in sync with ProfilerStats in lib/shared.h (frameCount is
+			// followed by 4 bytes of padding, and each marker has 5 doubles)
+			markers = new Float64Array(buffer, statsPtr + 8, 5 * FrameProfiler.MarkerCount),
+			stats: any = {
+				frameCount: (new Int32Array(buffer, statsPtr, 1))[0]
+			};
+
+		// Times are in milliseconds
+		for (let m = 0, i = 0; m < FrameProfiler.MarkerCount; m++, i += 5) {
+			stats[FrameProfiler.MarkerNames[m]] = {
+				min: markers[i],
+				median: markers[i + 1],
+				p95: markers[i + 2],
+				p99: markers[i + 3],
+				worst: markers[i + 4]
+			};
+		}
+
+		return stats;
+	}
 }
@@ -353,6 +353,10 @@ async function setup(): Promise<void> {
 	let n: void;
 	[n, cLib] = await allPromises;
 
+	// The cache must be allocated before anything else, so that it does not
+	// fragment the heap (refer to lib/imageCache.c)
+	cLib._setImageCacheCapacity(256 * 1024);
+
 	View.initGL();
 
 	window.onpopstate = View.windowHistoryStatePopped;
@@ -368,6 +372,48 @@ async function setup(): Promise<void> {
 
 	View.createInitialView();
 
+	// Tracing is only functional when lib/ is compiled with -DtraceEvents=1
+	// (refer to lib/shared.h). Call pixelTraceStart() from the console, play for
+	// a while, then call pixelTraceDownload() and load the file in chrome://tracing
+	let traceStarted = false;
+	(window as any)["pixelTraceStart"] = function () {
+		// 8192 events take 192 KiB, keeping the exported JSON around 1 MiB
+		traceStarted = cLib._traceStart(8192);
+		if (!traceStarted)
+			console.log("Tracing is not compiled into lib/ (refer to TRACE_EVENTS in Makefile), or there is not enough memory");
+	};
+	(window as any)["pixelTraceDownload"] = function () {
+		if (!traceStarted) {
+			console.log("There is nothing to download (call pixelTraceStart() first)");
+			return;
+		}
+		traceStarted = false;
+		cLib._tracePause();
+		const jsonPtr = cLib._traceExportJson();
+		if (jsonPtr) {
+			const heap = cLib.HEAP8;
+			BlobDownloader.download(new Blob([heap.slice(jsonPtr, heap.indexOf(0, jsonPtr))], { type: "application/json" }), "trace.json");
+			cLib._freeBuffer(jsonPtr);
+		}
+		cLib._traceStop();
+	};
+
+	// Frame profiling is only functional when lib/ is compiled with
+	// -DprofileFrames=1 (refer to lib/shared.h). Call pixelProfilerStart() from
+	// the console, play for a while, then call pixelProfilerStats() as many
+	// times as needed, which reports the percentiles of the last 1024 frames
+	// in milliseconds, and pixelProfilerStop() at the end
+	(window as any)["pixelProfilerStart"] = function () {
+		if (!FrameProfiler.start())
+			console.log("Frame profiling is not compiled into lib/ (refer to PROFILE_FRAMES in Makefile)");
+	};
+	(window as any)["pixelProfilerStats"] = function () {
+		return FrameProfiler.computeStats();
+	};
+	(window as any)["pixelProfilerStop"] = function () {
+		FrameProfiler.stop();
+	};
+
 	const levels = document.createElement("script");
 	levels.async = true;
 	levels.setAttribute("type", "text/javascript");
@@ -52,6 +52,7 @@ class EditorView extends View {
 	private readonly selectionView: boolean;
 
 	private readonly boundDocumentKeyUp: any;
+	private readonly imageProcessor: ImageProcessor;
 
 	private tool: number;
 	private dirty: boolean;
@@ -147,6 +148,8 @@ class EditorView extends View {
 
 		this.boundDocumentKeyUp = ((!androidWrapper && !isPWA) ? this.documentKeyUp.bind(this) : null);
 
+		this.imageProcessor = new ImageProcessor();
+
 		this.tool = EditorView.ToolPencil;
 		this.dirty = false;
 		this.context = null as any;
@@ -299,6 +302,9 @@ class EditorView extends View {
 
 	protected destroyInternal(partial: boolean): void {
 		this.save();
+
+		if (!partial)
+			this.imageProcessor.destroy();
 	}
 
 	private save(): void {
@@ -440,6 +446,7 @@ class EditorView extends View {
 						this.updateBrushColor(rainbowColors[this.lastPencilRainbowIndex]);
 					}
 					this.context.drawImage(this.brushCanvas, offset, 0, width, width, (i | 0) - radius, (j | 0) - radius, width, width);
+					this.imageProcessor.markDirty((i | 0) - radius, (j | 0) - radius, width, width);
 				}
 			}
 		}
@@ -540,6 +547,7 @@ class EditorView extends View {
 		this.dirty = true;
 		this.context.clearRect(0, 0, baseWidth, maxHeight);
 		this.level.clearImage();
+		this.imageProcessor.invalidate();
 		this.scrollContainer.scrollTo(0);
 	}
 
@@ -847,7 +855,7 @@ class EditorView extends View {
 				View.loading = true;
 
 				try {
-					await this.level.prepare();
+					await this.level.prepare(this.imageProcessor);
 					await LevelCache.saveLevel(this.level, false);
 					ok = true;
 				} catch (ex) {
@@ -875,7 +883,7 @@ class EditorView extends View {
 
 		View.loading = true;
 
-		this.level.prepare().then(() => {
+		this.level.prepare(this.imageProcessor).then(() => {
 			View.loading = false;
 			this.fadeTo(() => new GameView({ level: this.level }, true), true);
 		}, (reason) => {
@@ -928,6 +936,7 @@ class EditorView extends View {
 	}
 
 	private devDebug(): void {
+		this.imageProcessor.invalidate();
 		processImage(this.canvas, this.context, true);
 	}
 